@@ -0,0 +1,96 @@
+/*
+ * All-vs-all: scores of every pair of sequences of a FASTA file, for clustering
+ *
+ * The upper triangle is scored in cache-sized tiles on all cores (AllPairs.h); one
+ * process replaces the N^2/2 launches of NeedlemanWunsch.
+ *
+ * Usage:
+ * - AlignAll sequences.fasta [--format dense|condensed|phylip] [--threads N]
+ *   "-" reads the sequences from stdin; the matrix is written on stdout.
+ * - dense (default) and condensed are binary int32 score matrices with a 16-byte
+ *   header (AllPairs.h); phylip is a text matrix of distances (pair_distance).
+ * - --stats prints cells, timings and arena usage as JSON on stderr.
+ * - Adjust parameter scores as desired (Scoring.h).
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+
+#include "AllPairs.h"
+#include "Fasta.h"
+#include "Stats.h"
+
+int main(int argc, char* argv[])
+{
+    const char* file = NULL;
+    const char* format = "dense";
+    int threads = 0;
+    bool usage = false;
+    for (int a=1; a<argc; a++)
+    {
+        if (std::strcmp(argv[a], "--stats") == 0) stats_enabled = true;
+        else if (std::strcmp(argv[a], "--threads") == 0 && a+1 < argc) threads = std::atoi(argv[++a]);
+        else if (std::strcmp(argv[a], "--format") == 0 && a+1 < argc) format = argv[++a];
+        else if (file == NULL && (argv[a][0] != '-' || std::strcmp(argv[a], "-") == 0)) file = argv[a];
+        else usage = true;
+    }
+    const bool phylip = std::strcmp(format, "phylip") == 0;
+    const bool condensed = std::strcmp(format, "condensed") == 0;
+
+    if (usage || file == NULL || !(phylip || condensed || std::strcmp(format, "dense") == 0))
+    {
+        std::cerr << "Please, insert the sequences to compare:" << std::endl
+                <<"• FASTA file as argv[1] (- for stdin)" << std::endl
+                <<"[--format dense|condensed|phylip] [--threads N] [--stats]" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::ios::sync_with_stdio(false);
+
+    std::ifstream sequence_file;
+    if (std::strcmp(file, "-") != 0)
+    {
+        sequence_file.open(file);
+        if (!sequence_file)
+        {
+            std::cerr << "Cannot open sequences " << file << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    FastaReader reader(sequence_file.is_open() ? static_cast<std::istream&>(sequence_file) : std::cin);
+
+    std::vector<std::string> names, sequences;
+    {
+        StatsTimer io(&AlignStats::io_seconds);
+        FastaRecord record;
+        while (reader.next(record))
+        {
+            names.push_back(record.name);
+            sequences.push_back(record.sequence);
+        }
+    }
+
+    const Scoring sc = default_scoring();
+    std::vector<int> scores;
+    {
+        ThreadPool pool(threads);
+        scores = all_pairs_scores(sequences, sc, pool);
+    }
+
+    {
+        StatsTimer io(&AlignStats::io_seconds);
+        if (phylip) write_phylip(std::cout, names, sequences, scores, sc);
+        else write_score_matrix(std::cout, scores, sequences.size(), condensed ? ALLPAIRS_CONDENSED : ALLPAIRS_DENSE);
+        std::cout.flush();
+    }
+
+    if (stats_enabled)
+    {
+        stats_write_json(std::cerr, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * AlignFrames: frames of AlignProtocol.h, see AlignFrames.h
+ */
+
+#include <cstring>
+
+#include <errno.h>
+#include <unistd.h>
+
+#include "AlignFrames.h"
+#include "AlignmentC.h"
+
+void frame_request(const BatchPair* pairs, int count, int mode, int engine, std::vector<char>& frame)
+{
+    std::size_t bytes = sizeof(aln_request_header);
+    for (int k=0; k<count; k++)
+    {
+        bytes += 2 * sizeof(uint32_t) + pairs[k].n + pairs[k].m;
+    }
+    frame.resize(bytes);
+
+    char* out = frame.data() + sizeof(aln_request_header);
+    for (int k=0; k<count; k++)
+    {
+        const uint32_t lengths[2] = { (uint32_t)pairs[k].n, (uint32_t)pairs[k].m };
+        std::memcpy(out, lengths, sizeof(lengths));
+        out += sizeof(lengths);
+        std::memcpy(out, pairs[k].X, pairs[k].n);
+        std::memcpy(out + pairs[k].n, pairs[k].Y, pairs[k].m);
+        out += pairs[k].n + pairs[k].m;
+    }
+
+    aln_request_header header = { ALN_REQUEST_MAGIC, (uint32_t)count, (uint32_t)(bytes - sizeof(aln_request_header)),
+                                  (uint8_t)mode, (uint8_t)engine, 0 };
+    std::memcpy(frame.data(), &header, sizeof(header));
+}
+
+bool frame_pairs(const aln_request_header& header, const char* payload, std::vector<BatchPair>& pairs)
+{
+    const int count = header.count;
+    pairs.resize(count);
+    std::size_t at = 0;
+    for (int k=0; k<count; k++)
+    {
+        uint32_t lengths[2];
+        if (header.payload_bytes - at < sizeof(lengths)) return false;
+        std::memcpy(lengths, payload + at, sizeof(lengths));
+        at += sizeof(lengths);
+        if (lengths[0] > header.payload_bytes - at || lengths[1] > header.payload_bytes - at - lengths[0]) return false;
+        pairs[k].X = payload + at;
+        pairs[k].n = lengths[0];
+        pairs[k].Y = payload + at + lengths[0];
+        pairs[k].m = lengths[1];
+        at += lengths[0] + lengths[1];
+    }
+    return at == header.payload_bytes;
+}
+
+void frame_response(const AlignResult* results, int count, bool with_alignment, std::vector<char>& frame)
+{
+    std::size_t bytes = sizeof(aln_response_header);
+    for (int k=0; k<count; k++)
+    {
+        bytes += sizeof(int32_t) + sizeof(uint32_t) + (with_alignment ? 2 * (std::size_t)results[k].length : 0);
+    }
+    frame.resize(bytes);
+
+    char* out = frame.data() + sizeof(aln_response_header);
+    for (int k=0; k<count; k++)
+    {
+        const AlignResult& r = results[k];
+        const int32_t score = r.score;
+        const uint32_t length = with_alignment ? r.length : 0;
+        std::memcpy(out, &score, sizeof(score));
+        std::memcpy(out + sizeof(score), &length, sizeof(length));
+        out += sizeof(score) + sizeof(length);
+        if (length > 0)
+        {
+            std::memcpy(out, r.A_1, length);
+            std::memcpy(out + length, r.A_2, length);
+            out += 2 * length;
+        }
+    }
+
+    aln_response_header reply = { ALN_RESPONSE_MAGIC, ALN_OK, (uint32_t)count,
+                                  (uint32_t)(bytes - sizeof(aln_response_header)) };
+    std::memcpy(frame.data(), &reply, sizeof(reply));
+}
+
+bool read_full(int fd, void* buffer, std::size_t len)
+{
+    char* p = static_cast<char*>(buffer);
+    while (len > 0)
+    {
+        const ssize_t got = read(fd, p, len);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        len -= got;
+    }
+    return true;
+}
+
+bool write_full(int fd, const void* buffer, std::size_t len)
+{
+    const char* p = static_cast<const char*>(buffer);
+    while (len > 0)
+    {
+        const ssize_t put = write(fd, p, len);
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) return false;
+        p += put;
+        len -= put;
+    }
+    return true;
+}
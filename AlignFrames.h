@@ -0,0 +1,40 @@
+/*
+ * AlignFrames: encoding and decoding of the frames of AlignProtocol.h
+ *
+ * Shared by the alignment server (AlignServer.cpp) and the sharded batch runner
+ * (AlignShards.cpp), whose workers answer the same requests over pipes.
+ *
+ * Usage:
+ *   frame_request(pairs, count, ALN_MODE_SCORE, ALN_ENGINE_AUTO, frame);     //client
+ *   frame_pairs(header, payload, pairs);                                     //worker
+ *   aligner.align_batch(pairs.data(), count, workspace, results.data());
+ *   frame_response(results.data(), count, with_alignment, frame);
+ *
+ */
+
+#ifndef ALIGN_FRAMES_H
+#define ALIGN_FRAMES_H
+
+#include <cstddef>
+#include <vector>
+
+#include "AlignProtocol.h"
+#include "Alignment.h"
+
+//frame_request: header and payload of a request for count pairs
+void frame_request(const BatchPair* pairs, int count, int mode, int engine, std::vector<char>& frame);
+
+//frame_pairs: the pairs of a request payload, pointing into it; false when the payload
+//does not hold exactly header.count pairs
+bool frame_pairs(const aln_request_header& header, const char* payload, std::vector<BatchPair>& pairs);
+
+//frame_response: header and payload of an ALN_OK response; the aligned sequences are
+//included when with_alignment is set
+void frame_response(const AlignResult* results, int count, bool with_alignment, std::vector<char>& frame);
+
+//read_full / write_full: transfer exactly len bytes over fd, retrying on EINTR;
+//false on end of stream or error
+bool read_full(int fd, void* buffer, std::size_t len);
+bool write_full(int fd, const void* buffer, std::size_t len);
+
+#endif //ALIGN_FRAMES_H
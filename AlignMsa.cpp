@@ -0,0 +1,110 @@
+/*
+ * Multiple alignment: progressive alignment of a family of sequences
+ *
+ * Pairwise distances are computed on all cores, a guide tree is built from them, and
+ * profiles are aligned from its leaves up (Msa.h).
+ *
+ * Usage:
+ * - AlignMsa family.fasta [--tree upgma|nj] [--threads N] [--score]
+ *   "-" reads the family from stdin; gaps already in the records are dropped.
+ * - The alignment is printed as FASTA, records in input order, gaps as '-'.
+ * - --score prints the sum-of-pairs score of the alignment on stderr.
+ * - --stats prints cells, timings and arena usage as JSON on stderr.
+ * - Adjust parameter scores as desired (Scoring.h).
+ *
+ */
+
+#include <iostream>
+#include <algorithm>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+
+#include "Fasta.h"
+#include "Msa.h"
+#include "Profile.h"
+#include "Stats.h"
+
+int main(int argc, char* argv[])
+{
+    MsaConfig config = default_msa_config();
+    const char* file = NULL;
+    bool score = false;
+    bool usage = false;
+    for (int a=1; a<argc; a++)
+    {
+        if (std::strcmp(argv[a], "--stats") == 0) stats_enabled = true;
+        else if (std::strcmp(argv[a], "--score") == 0) score = true;
+        else if (std::strcmp(argv[a], "--threads") == 0 && a+1 < argc) config.threads = std::atoi(argv[++a]);
+        else if (std::strcmp(argv[a], "--tree") == 0 && a+1 < argc)
+        {
+            a++;
+            if (std::strcmp(argv[a], "upgma") == 0) config.tree = TREE_UPGMA;
+            else if (std::strcmp(argv[a], "nj") == 0) config.tree = TREE_NEIGHBOR_JOINING;
+            else usage = true;
+        }
+        else if (file == NULL && (argv[a][0] != '-' || std::strcmp(argv[a], "-") == 0)) file = argv[a];
+        else usage = true;
+    }
+
+    if (usage || file == NULL)
+    {
+        std::cerr << "Please, insert the family to align:" << std::endl
+                <<"• FASTA file as argv[1] (- for stdin)" << std::endl
+                <<"[--tree upgma|nj] [--threads N] [--score] [--stats]" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::ios::sync_with_stdio(false);
+
+    std::ifstream family_file;
+    if (std::strcmp(file, "-") != 0)
+    {
+        family_file.open(file);
+        if (!family_file)
+        {
+            std::cerr << "Cannot open family " << file << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    FastaReader reader(family_file.is_open() ? static_cast<std::istream&>(family_file) : std::cin);
+
+    std::vector<std::string> names, sequences;
+    {
+        StatsTimer io(&AlignStats::io_seconds);
+        FastaRecord record;
+        while (reader.next(record))
+        {
+            names.push_back(record.name);
+            record.sequence.erase(std::remove(record.sequence.begin(), record.sequence.end(), '-'), record.sequence.end());
+            sequences.push_back(record.sequence);
+        }
+    }
+    if (sequences.size() > PROFILE_MAX_ROWS)
+    {
+        std::cerr << "At most " << PROFILE_MAX_ROWS << " sequences can be aligned" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    const std::vector<std::string> rows = progressive_align(sequences, config);
+
+    {
+        StatsTimer io(&AlignStats::io_seconds);
+        for (std::size_t r=0; r<rows.size(); r++)
+        {
+            std::cout << ">" << names[r] << '\n' << rows[r] << '\n';
+        }
+        std::cout.flush();
+    }
+    if (score)
+    {
+        std::cerr << "sum-of-pairs score: " << sum_of_pairs(rows, config.scoring) << std::endl;
+    }
+
+    if (stats_enabled)
+    {
+        stats_write_json(std::cerr, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    return 0;
+}
@@ -0,0 +1,49 @@
+/*
+ * AlignProtocol: binary frames of the alignment server (AlignServer.cpp)
+ *
+ * All integers are little-endian as on the host: the server is only reachable through a
+ * local Unix socket or a pipe. Every request gets exactly one response, in order.
+ *
+ *   request  := RequestHeader pair[count]                 (payload_bytes bytes of pairs)
+ *   pair     := uint32 n, uint32 m, X[n], Y[m]
+ *   response := ResponseHeader result[count]              (payload_bytes bytes of results)
+ *   result   := int32 score, uint32 length, A_1[length], A_2[length]
+ *
+ * A_1/A_2 are omitted in ALN_MODE_SCORE. A response with a status other than ALN_OK
+ * (AlignmentC.h) has no results, and the server then closes the connection: ALN_EINVAL
+ * for a malformed frame, ALN_ENOMEM for a request the server has no memory for or whose
+ * full-matrix pairs exceed its cell cap.
+ *
+ */
+
+#ifndef ALIGN_PROTOCOL_H
+#define ALIGN_PROTOCOL_H
+
+#include <stdint.h>
+
+#define ALN_REQUEST_MAGIC 0x514e4c41u       //"ALNQ"
+#define ALN_RESPONSE_MAGIC 0x524e4c41u      //"ALNR"
+
+//Largest request the server accepts
+#define ALN_MAX_PAIRS (1 << 20)
+#define ALN_MAX_PAYLOAD (1u << 28)
+
+typedef struct aln_request_header
+{
+    uint32_t magic;
+    uint32_t count;             //pairs in the payload
+    uint32_t payload_bytes;
+    uint8_t mode;               //ALN_MODE_*
+    uint8_t engine;             //ALN_ENGINE_*
+    uint16_t reserved;
+} aln_request_header;
+
+typedef struct aln_response_header
+{
+    uint32_t magic;
+    int32_t status;             //ALN_OK or ALN_E*
+    uint32_t count;
+    uint32_t payload_bytes;
+} aln_response_header;
+
+#endif //ALIGN_PROTOCOL_H
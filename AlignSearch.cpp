@@ -0,0 +1,96 @@
+/*
+ * Database search: one query against every record of a FASTA database
+ *
+ * The query is prepared once (Search.h) and the database is streamed through the
+ * score-only kernels on all cores; a top-k heap keeps the best records, and only
+ * those are aligned with full traceback.
+ *
+ * Usage:
+ * - AlignSearch query.fasta database.fasta [--top K] [--threads N] [--score-only]
+ *   the query is the first record of query.fasta; "-" reads the database from stdin.
+ * - For every hit, best first: ">name record=R score=S", then the aligned query (A_1)
+ *   and record (A_2) unless --score-only is given.
+ * - --stats prints cells, timings and arena usage as JSON on stderr.
+ * - Adjust parameter scores as desired (Scoring.h).
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+
+#include "Search.h"
+#include "Stats.h"
+
+int main(int argc, char* argv[])
+{
+    SearchConfig config = default_search_config();
+    const char* files[2] = { NULL, NULL };
+    int nfiles = 0;
+    bool usage = false;
+    for (int a=1; a<argc; a++)
+    {
+        if (std::strcmp(argv[a], "--stats") == 0) stats_enabled = true;
+        else if (std::strcmp(argv[a], "--score-only") == 0) config.traceback = false;
+        else if (std::strcmp(argv[a], "--top") == 0 && a+1 < argc) config.top_k = std::atoi(argv[++a]);
+        else if (std::strcmp(argv[a], "--threads") == 0 && a+1 < argc) config.threads = std::atoi(argv[++a]);
+        else if (nfiles < 2 && (argv[a][0] != '-' || std::strcmp(argv[a], "-") == 0)) files[nfiles++] = argv[a];
+        else usage = true;
+    }
+
+    if (usage || nfiles != 2 || config.top_k <= 0)
+    {
+        std::cerr << "Please, insert the files to search:" << std::endl
+                <<"• query FASTA (first record) as argv[1]" << std::endl
+                <<"• database FASTA as argv[2] (- for stdin)" << std::endl
+                <<"[--top K] [--threads N] [--score-only] [--stats]" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::ios::sync_with_stdio(false);
+
+    std::ifstream query_file(files[0]);
+    FastaRecord query;
+    FastaReader query_reader(query_file);
+    if (!query_file || !query_reader.next(query))
+    {
+        std::cerr << "Cannot read a query from " << files[0] << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::ifstream database_file;
+    if (std::strcmp(files[1], "-") != 0)
+    {
+        database_file.open(files[1]);
+        if (!database_file)
+        {
+            std::cerr << "Cannot open database " << files[1] << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    FastaReader database(database_file.is_open() ? static_cast<std::istream&>(database_file) : std::cin);
+
+    const std::vector<SearchHit> hits = search_database(query.sequence, database, config);
+
+    {
+        StatsTimer io(&AlignStats::io_seconds);
+        for (std::size_t h=0; h<hits.size(); h++)
+        {
+            std::cout << ">" << hits[h].name << " record=" << hits[h].record << " score=" << hits[h].score << '\n';
+            if (config.traceback)
+            {
+                std::cout << "A_1 : " << hits[h].A_1 << '\n';
+                std::cout << "A_2 : " << hits[h].A_2 << '\n';
+            }
+        }
+        std::cout.flush();
+    }
+
+    if (stats_enabled)
+    {
+        stats_write_json(std::cerr, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    return 0;
+}
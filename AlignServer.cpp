@@ -0,0 +1,419 @@
+/*
+ * Alignment server: a long-lived process that aligns batches of pairs sent over a
+ * Unix domain socket (or stdin/stdout), so a client pays neither process startup nor
+ * a cold cache per pair.
+ *
+ * One I/O thread polls the listening socket and every connection, and gathers the bytes
+ * of each connection until a whole request is in. The request then goes to a worker of a
+ * ThreadPool started at launch, which aligns it and writes the response. A connection has
+ * at most one request with the workers, so its responses come back in order, and an idle
+ * connection holds no worker. Every worker keeps its thread_arena() workspace and its
+ * response buffer between requests, and every connection its input buffer, so a warm
+ * server makes no heap calls for requests no larger than the ones seen.
+ * Pairs of one request are aligned with Aligner::align_batch (lockstep SIMD kernels
+ * for short pairs). The frames are described in AlignProtocol.h.
+ *
+ * Usage:
+ * - AlignServer --socket path [--threads N]   listen on path, N workers (default: one per core)
+ * - AlignServer --stdio                       serve one stream of frames on stdin/stdout
+ * - --max-cells N: requests with a pair of more than N cells (default 2^28) for
+ *   ALN_ENGINE_NEEDLEMAN_WUNSCH are answered ALN_ENOMEM without being aligned
+ * - --stats prints the telemetry of all workers as JSON on stderr when the server stops
+ *   (end of stdin, SIGINT or SIGTERM).
+ *
+ * A request that runs out of memory (std::bad_alloc) is answered ALN_ENOMEM and the
+ * worker's arena is shrunk back; the server keeps serving the other connections.
+ *
+ * Scores use the default parameters of Scoring.h.
+ *
+ */
+
+#include <iostream>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Alignment.h"
+#include "AlignFrames.h"
+#include "AlignmentC.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+
+//Largest matrix, in cells, of a pair aligned with ALN_ENGINE_NEEDLEMAN_WUNSCH (4 bytes each)
+#define SERVER_MAX_CELLS (1LL << 28)
+
+//Initial input buffer of a connection; it grows to the largest request received
+#define SERVER_READ_BYTES (1 << 16)
+
+//Set by SIGINT/SIGTERM, stops the I/O loop
+static volatile std::sig_atomic_t stop_requested = 0;
+
+//Connection: a client of the socket, read by the I/O thread while no worker holds its request
+struct Connection
+{
+    explicit Connection(int fd) : fd(fd), input(SERVER_READ_BYTES) {}
+
+    int fd;
+    std::vector<char> input;            //bytes received, the front request first
+    std::size_t filled = 0;
+    bool busy = false;                  //a worker holds the front request
+    std::atomic<bool> failed{false};    //set by the worker: error response or lost client
+};
+
+//Written by the workers, one fd per answered request, and polled by the I/O thread
+static int answered[2];
+
+//Cell cap of the full-matrix engine, --max-cells
+static long long max_cells = SERVER_MAX_CELLS;
+
+//serve_stream: answers requests from in_fd on out_fd until end of stream or a bad frame
+void serve_stream(int in_fd, int out_fd);
+
+//serve_socket: accepts clients on listener and hands their requests to the workers of
+//pool until SIGINT/SIGTERM
+void serve_socket(int listener, ThreadPool& pool);
+
+//dispatch: gives the front request of c to a worker once it is complete; false after
+//answering an invalid header, when the connection is to be closed
+bool dispatch(Connection& c, ThreadPool& pool);
+
+//answer: aligns the front request of c and writes its response (on a worker)
+void answer(Connection& c);
+
+//handle_request: parses one payload, aligns it and fills response; returns a status
+int handle_request(const aln_request_header& header, const char* payload, std::vector<char>& response);
+
+//listen_unix: bound and listening socket on path
+int listen_unix(const char* path);
+
+void on_signal(int);
+
+
+int main(int argc, char* argv[])
+{
+    const char* socket_path = NULL;
+    bool use_stdio = false;
+    int threads = 0;
+    for (int a=1; a<argc; a++)
+    {
+        if (std::strcmp(argv[a], "--stats") == 0) stats_enabled = true;
+        else if (std::strcmp(argv[a], "--stdio") == 0) use_stdio = true;
+        else if (std::strcmp(argv[a], "--socket") == 0 && a+1 < argc) socket_path = argv[++a];
+        else if (std::strcmp(argv[a], "--threads") == 0 && a+1 < argc) threads = std::atoi(argv[++a]);
+        else if (std::strcmp(argv[a], "--max-cells") == 0 && a+1 < argc) max_cells = std::atoll(argv[++a]);
+        else
+        {
+            socket_path = NULL;
+            use_stdio = false;
+            break;
+        }
+    }
+
+    if (use_stdio == (socket_path != NULL))
+    {
+        std::cerr << "Please, choose where to serve requests:" << std::endl
+                <<"• --socket path [--threads N] for a Unix domain socket" << std::endl
+                <<"• --stdio for frames on stdin/stdout" << std::endl
+                <<"(--max-cells N caps n*m of full-matrix pairs, --stats prints telemetry as JSON on stderr at exit)" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::signal(SIGPIPE, SIG_IGN);
+
+    if (use_stdio)
+    {
+        serve_stream(STDIN_FILENO, STDOUT_FILENO);
+    }
+    else
+    {
+        //no SA_RESTART: a signal interrupts accept()
+        struct sigaction sa;
+        std::memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_signal;
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+
+        const int listener = listen_unix(socket_path);
+        ThreadPool pool(threads);
+        serve_socket(listener, pool);
+        close(listener);
+        unlink(socket_path);
+    }
+
+    if (stats_enabled)
+    {
+        stats_write_json(std::cerr, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+
+    return 0;
+}
+
+
+//Functions
+void serve_stream(int in_fd, int out_fd)
+{
+    //kept between requests
+    thread_local std::vector<char> payload;
+    thread_local std::vector<char> response;
+
+    aln_request_header header;
+    while (read_full(in_fd, &header, sizeof(header)))
+    {
+        int status = ALN_OK;
+        if (header.magic != ALN_REQUEST_MAGIC || header.count > ALN_MAX_PAIRS || header.payload_bytes > ALN_MAX_PAYLOAD)
+        {
+            status = ALN_EINVAL;
+        }
+        else
+        {
+            payload.resize(header.payload_bytes);
+            if (!read_full(in_fd, payload.data(), header.payload_bytes)) break;
+            status = handle_request(header, payload.data(), response);
+        }
+
+        if (status != ALN_OK)
+        {
+            aln_response_header error = { ALN_RESPONSE_MAGIC, status, 0, 0 };
+            write_full(out_fd, &error, sizeof(error));
+            break;
+        }
+
+        StatsTimer io(&AlignStats::io_seconds);
+        if (!write_full(out_fd, response.data(), response.size())) break;
+    }
+
+    stats_record_arena(thread_arena());
+}
+
+
+void serve_socket(int listener, ThreadPool& pool)
+{
+    std::map< int, std::unique_ptr<Connection> > clients;
+    std::vector<struct pollfd> polled;
+    if (pipe(answered) < 0)
+    {
+        std::cerr << "pipe: " << std::strerror(errno) << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    while (!stop_requested)
+    {
+        //STEP 1: wait for a client, bytes of a connection no worker holds, or an answer
+        polled.clear();
+        const struct pollfd listening = { listener, POLLIN, 0 };
+        const struct pollfd answers = { answered[0], POLLIN, 0 };
+        polled.push_back(listening);
+        polled.push_back(answers);
+        for (std::map< int, std::unique_ptr<Connection> >::iterator c = clients.begin(); c != clients.end(); ++c)
+        {
+            const struct pollfd reading = { c->first, POLLIN, 0 };
+            if (!c->second->busy) polled.push_back(reading);
+        }
+        if (poll(polled.data(), polled.size(), -1) < 0)
+        {
+            if (errno == EINTR) continue;
+            std::cerr << "poll: " << std::strerror(errno) << std::endl;
+            break;
+        }
+
+        //STEP 2: new clients
+        if (polled[0].revents & POLLIN)
+        {
+            const int fd = accept(listener, NULL, NULL);
+            if (fd >= 0) clients[fd].reset(new Connection(fd));
+            else if (errno != EINTR && errno != ECONNABORTED)
+            {
+                std::cerr << "accept: " << std::strerror(errno) << std::endl;
+                break;
+            }
+        }
+
+        //STEP 3: answered requests leave the input; the next one, already received, goes out
+        if (polled[1].revents & POLLIN)
+        {
+            int fds[64];
+            const ssize_t got = read(answered[0], fds, sizeof(fds));
+            const int count = got > 0 ? got / sizeof(int) : 0;
+            for (int k=0; k<count; k++)
+            {
+                Connection& c = *clients[fds[k]];
+                c.busy = false;
+                if (!c.failed.load())
+                {
+                    aln_request_header header;
+                    std::memcpy(&header, c.input.data(), sizeof(header));
+                    const std::size_t frame = sizeof(header) + header.payload_bytes;
+                    std::memmove(c.input.data(), c.input.data() + frame, c.filled - frame);
+                    c.filled -= frame;
+                    if (dispatch(c, pool)) continue;
+                }
+                close(c.fd);
+                clients.erase(fds[k]);
+            }
+        }
+
+        //STEP 4: bytes of the other connections (new or just answered ones were not polled)
+        for (std::size_t p=2; p<polled.size(); p++)
+        {
+            if (!polled[p].revents) continue;
+            Connection& c = *clients[polled[p].fd];
+            if (c.filled == c.input.size()) c.input.resize(2 * c.input.size());
+            const ssize_t got = recv(c.fd, c.input.data() + c.filled, c.input.size() - c.filled, MSG_DONTWAIT);
+            if (got < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+            if (got > 0)
+            {
+                c.filled += got;
+                if (dispatch(c, pool)) continue;
+            }
+            close(c.fd);
+            clients.erase(polled[p].fd);
+        }
+    }
+
+    //unblock the workers writing to clients that stopped reading, then let the pool drain
+    for (std::map< int, std::unique_ptr<Connection> >::iterator c = clients.begin(); c != clients.end(); ++c)
+    {
+        if (c->second->busy) shutdown(c->first, SHUT_RDWR);
+    }
+    pool.wait();
+    for (std::map< int, std::unique_ptr<Connection> >::iterator c = clients.begin(); c != clients.end(); ++c)
+    {
+        close(c->first);
+    }
+    close(answered[0]);
+    close(answered[1]);
+}
+
+
+bool dispatch(Connection& c, ThreadPool& pool)
+{
+    if (c.filled < sizeof(aln_request_header)) return true;
+    aln_request_header header;
+    std::memcpy(&header, c.input.data(), sizeof(header));
+    if (header.magic != ALN_REQUEST_MAGIC || header.count > ALN_MAX_PAIRS || header.payload_bytes > ALN_MAX_PAYLOAD)
+    {
+        aln_response_header error = { ALN_RESPONSE_MAGIC, ALN_EINVAL, 0, 0 };
+        write_full(c.fd, &error, sizeof(error));
+        return false;
+    }
+
+    const std::size_t frame = sizeof(header) + header.payload_bytes;
+    if (c.input.size() < frame) c.input.resize(frame);
+    if (c.filled < frame) return true;
+    c.busy = true;
+    Connection* client = &c;
+    pool.submit([client]{ answer(*client); });
+    return true;
+}
+
+
+void answer(Connection& c)
+{
+    //kept by the worker between requests
+    thread_local std::vector<char> response;
+
+    aln_request_header header;
+    std::memcpy(&header, c.input.data(), sizeof(header));
+    const int status = handle_request(header, c.input.data() + sizeof(header), response);
+    bool sent;
+    if (status != ALN_OK)
+    {
+        aln_response_header error = { ALN_RESPONSE_MAGIC, status, 0, 0 };
+        write_full(c.fd, &error, sizeof(error));
+        sent = false;
+    }
+    else
+    {
+        StatsTimer io(&AlignStats::io_seconds);
+        sent = write_full(c.fd, response.data(), response.size());
+    }
+    stats_record_arena(thread_arena());
+
+    //the I/O thread takes the connection back
+    c.failed.store(!sent);
+    write_full(answered[1], &c.fd, sizeof(c.fd));
+}
+
+
+int handle_request(const aln_request_header& header, const char* payload, std::vector<char>& response)
+{
+    thread_local std::vector<BatchPair> pairs;
+    thread_local std::vector<AlignResult> results;
+
+    if (header.mode > ALN_MODE_SCORE || header.engine > ALN_ENGINE_CHECKPOINT) return ALN_EINVAL;
+    AlignerConfig config = default_config();
+    config.mode = static_cast<AlignMode>(header.mode);
+    config.engine = static_cast<AlignEngine>(header.engine);
+    const Aligner aligner(config);
+    const bool full_matrix = config.mode == MODE_ALIGN && config.engine == ENGINE_NEEDLEMAN_WUNSCH;
+
+    //a request too large for the memory left fails alone, the worker and the others go on
+    try
+    {
+        //pairs point into the payload
+        if (!frame_pairs(header, payload, pairs)) return ALN_EINVAL;
+        for (uint32_t k=0; full_matrix && k<header.count; k++)
+        {
+            if ((long long)pairs[k].n * pairs[k].m > max_cells) return ALN_ENOMEM;
+        }
+        results.resize(header.count);
+        aligner.align_batch(pairs.data(), header.count, thread_arena(), results.data());
+
+        StatsTimer io(&AlignStats::io_seconds);
+        frame_response(results.data(), header.count, config.mode == MODE_ALIGN, response);
+    }
+    catch (const std::bad_alloc&)
+    {
+        thread_arena().shrink();
+        return ALN_ENOMEM;
+    }
+    return ALN_OK;
+}
+
+
+int listen_unix(const char* path)
+{
+    struct sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (std::strlen(path) >= sizeof(address.sun_path))
+    {
+        std::cerr << "Socket path too long: " << path << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    std::strcpy(address.sun_path, path);
+
+    const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        std::cerr << "socket: " << std::strerror(errno) << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    //a stale socket file of a previous run would make bind() fail
+    unlink(path);
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0 || listen(fd, SOMAXCONN) < 0)
+    {
+        std::cerr << "Cannot listen on " << path << ": " << std::strerror(errno) << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+void on_signal(int)
+{
+    stop_requested = 1;
+}
@@ -0,0 +1,429 @@
+/*
+ * Sharded batch: a list of pairs aligned by one worker process per socket
+ *
+ * On multi-socket nodes one process per socket beats a single process with many
+ * threads: each worker allocates and touches only its own socket's memory. The
+ * coordinator forks the workers first and pins each to the CPUs of one NUMA node
+ * (/sys/devices/system/node). It then streams the pairs to them in chunks as request
+ * frames over pipes (AlignProtocol.h), keeping at most SHARD_IN_FLIGHT chunks per
+ * worker. A worker cuts each chunk into length-sorted jobs, most expensive first
+ * (Schedule.h), spreads them over a ThreadPool on its socket and aligns them with
+ * the library engines (Aligner::align_batch), the same ones NeedlemanWunsch and
+ * Hirschberg use. Responses come back in whatever order the
+ * workers finish. The coordinator holds them until every earlier chunk has been
+ * printed, so the output is the input order whatever the number of workers.
+ *
+ * Usage:
+ * - AlignShards pairs.fasta [--workers N] [--engine auto|nw|hirschberg|checkpoint|four-russians] [--score-only]
+ *   records 2k and 2k+1 of the FASTA file are pair k; "-" reads them from stdin.
+ * - N defaults to the number of NUMA nodes; workers beyond it share the nodes in turn.
+ * - Output as Hirschberg --batch: the two aligned lines (or the score) of each pair.
+ * - --stats: every worker prints its telemetry as one JSON object on stderr at exit.
+ * - Adjust parameter scores as desired (Scoring.h).
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "AlignFrames.h"
+#include "AlignmentC.h"
+#include "Fasta.h"
+#include "Schedule.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+
+//Pairs of a chunk, and residues after which a chunk is closed early
+#define SHARD_CHUNK_PAIRS 1024
+#define SHARD_CHUNK_RESIDUES (1 << 22)
+
+//Chunks sent to a worker and not answered yet
+#define SHARD_IN_FLIGHT 2
+
+//Shard: a worker process seen from the coordinator
+struct Shard
+{
+    pid_t pid;
+    int to;                         //request pipe, non-blocking
+    int from;                       //response pipe, non-blocking
+    std::deque<long> chunks;        //chunks in flight, oldest first
+    std::vector<char> out;          //request bytes not written yet
+    std::size_t written;
+    std::vector<char> in;           //response bytes of the oldest chunk so far
+};
+
+//node_cpus: CPUs of each NUMA node the process may run on; one set of all of them
+//when the machine reports no nodes
+std::vector<cpu_set_t> node_cpus();
+
+//worker_main: answers request frames from in_fd on out_fd until end of stream
+void worker_main(int in_fd, int out_fd, int threads);
+
+//print_results: writes the results of a response payload as Hirschberg --batch does
+void print_results(const std::vector<char>& response, bool score_only);
+
+
+int main(int argc, char* argv[])
+{
+    const char* file = NULL;
+    int workers = 0;
+    int engine = ALN_ENGINE_AUTO;
+    bool score_only = false;
+    bool usage = false;
+    for (int a=1; a<argc; a++)
+    {
+        if (std::strcmp(argv[a], "--stats") == 0) stats_enabled = true;
+        else if (std::strcmp(argv[a], "--score-only") == 0) score_only = true;
+        else if (std::strcmp(argv[a], "--workers") == 0 && a+1 < argc) workers = std::atoi(argv[++a]);
+        else if (std::strcmp(argv[a], "--engine") == 0 && a+1 < argc)
+        {
+            a++;
+            if (std::strcmp(argv[a], "auto") == 0) engine = ALN_ENGINE_AUTO;
+            else if (std::strcmp(argv[a], "nw") == 0) engine = ALN_ENGINE_NEEDLEMAN_WUNSCH;
+            else if (std::strcmp(argv[a], "hirschberg") == 0) engine = ALN_ENGINE_HIRSCHBERG;
+            else if (std::strcmp(argv[a], "checkpoint") == 0) engine = ALN_ENGINE_CHECKPOINT;
+            else if (std::strcmp(argv[a], "four-russians") == 0) engine = ALN_ENGINE_FOUR_RUSSIANS;
+            else usage = true;
+        }
+        else if (file == NULL && (argv[a][0] != '-' || std::strcmp(argv[a], "-") == 0)) file = argv[a];
+        else usage = true;
+    }
+
+    if (usage || file == NULL || workers < 0)
+    {
+        std::cerr << "Please, insert the pairs to align:" << std::endl
+                <<"• FASTA file as argv[1], records 2k and 2k+1 form a pair (- for stdin)" << std::endl
+                <<"[--workers N] [--engine auto|nw|hirschberg|checkpoint|four-russians] [--score-only] [--stats]" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::ifstream pair_file;
+    if (std::strcmp(file, "-") != 0)
+    {
+        pair_file.open(file);
+        if (!pair_file)
+        {
+            std::cerr << "Cannot open pairs " << file << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+    }
+    FastaReader reader(pair_file.is_open() ? static_cast<std::istream&>(pair_file) : std::cin);
+
+    //STEP 1: workers, forked before any thread or input exists
+    const std::vector<cpu_set_t> nodes = node_cpus();
+    if (workers == 0) workers = nodes.size();
+    std::vector<Shard> shards(workers);
+    for (int w=0; w<workers; w++)
+    {
+        int requests[2], responses[2];
+        if (pipe(requests) < 0 || pipe(responses) < 0)
+        {
+            std::cerr << "pipe: " << std::strerror(errno) << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        const pid_t pid = fork();
+        if (pid < 0)
+        {
+            std::cerr << "fork: " << std::strerror(errno) << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+        if (pid == 0)
+        {
+            for (int v=0; v<w; v++)
+            {
+                close(shards[v].to);
+                close(shards[v].from);
+            }
+            close(requests[1]);
+            close(responses[0]);
+            const cpu_set_t& cpus = nodes[w % nodes.size()];
+            sched_setaffinity(0, sizeof(cpus), &cpus);
+            worker_main(requests[0], responses[1], CPU_COUNT(&cpus));
+            _exit(0);
+        }
+        close(requests[0]);
+        close(responses[1]);
+        fcntl(requests[1], F_SETFL, O_NONBLOCK);
+        fcntl(responses[0], F_SETFL, O_NONBLOCK);
+        shards[w].pid = pid;
+        shards[w].to = requests[1];
+        shards[w].from = responses[0];
+        shards[w].written = 0;
+    }
+    std::ios::sync_with_stdio(false);
+
+    //STEP 2: chunks to the workers with room, responses printed in chunk order
+    std::vector<FastaRecord> records(2 * SHARD_CHUNK_PAIRS);
+    std::vector<BatchPair> pairs(SHARD_CHUNK_PAIRS);
+    std::map<long, std::vector<char> > done;
+    long next_chunk = 0, next_print = 0;
+    bool more = true;
+    std::vector<struct pollfd> polls;
+    std::vector<int> polled;
+    for (;;)
+    {
+        for (int w=0; w<workers && more; w++)
+        {
+            Shard& s = shards[w];
+            if (s.chunks.size() >= SHARD_IN_FLIGHT || s.written < s.out.size()) continue;
+
+            int count = 0;
+            std::size_t residues = 0;
+            while (count < SHARD_CHUNK_PAIRS && residues < SHARD_CHUNK_RESIDUES)
+            {
+                more = reader.next(records[2*count]);
+                if (!more) break;
+                if (!reader.next(records[2*count+1]))
+                {
+                    std::cerr << "Odd number of records: the last one has no partner" << std::endl;
+                    std::exit(EXIT_FAILURE);
+                }
+                const BatchPair p = { records[2*count].sequence.data(), (int)records[2*count].sequence.length(),
+                                      records[2*count+1].sequence.data(), (int)records[2*count+1].sequence.length() };
+                pairs[count++] = p;
+                residues += p.n + p.m;
+            }
+            if (count == 0) break;
+            frame_request(pairs.data(), count, score_only ? ALN_MODE_SCORE : ALN_MODE_ALIGN, engine, s.out);
+            s.written = 0;
+            s.chunks.push_back(next_chunk++);
+        }
+
+        //the end: input exhausted and every chunk printed
+        if (!more && next_print == next_chunk) break;
+
+        polls.clear();
+        polled.clear();
+        for (int w=0; w<workers; w++)
+        {
+            Shard& s = shards[w];
+            short events = 0;
+            if (s.written < s.out.size()) events |= POLLOUT;
+            if (!s.chunks.empty()) events |= POLLIN;
+            if (events == 0) continue;
+            struct pollfd p = { (events & POLLOUT) ? s.to : s.from, events, 0 };
+            if ((events & POLLOUT) && (events & POLLIN))
+            {
+                //two descriptors: one entry for each
+                p.events = POLLOUT;
+                polls.push_back(p);
+                polled.push_back(w);
+                p.fd = s.from;
+                p.events = POLLIN;
+            }
+            polls.push_back(p);
+            polled.push_back(w);
+        }
+        if (poll(polls.data(), polls.size(), -1) < 0)
+        {
+            if (errno == EINTR) continue;
+            std::cerr << "poll: " << std::strerror(errno) << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+
+        for (std::size_t k=0; k<polls.size(); k++)
+        {
+            Shard& s = shards[polled[k]];
+            if (polls[k].revents == 0) continue;
+            if (polls[k].fd == s.to)
+            {
+                const ssize_t put = write(s.to, s.out.data() + s.written, s.out.size() - s.written);
+                if (put > 0) s.written += put;
+                else if (put < 0 && errno != EAGAIN && errno != EINTR)
+                {
+                    std::cerr << "Worker " << polled[k] << " stopped reading: " << std::strerror(errno) << std::endl;
+                    std::exit(EXIT_FAILURE);
+                }
+                continue;
+            }
+
+            char buffer[1 << 16];
+            const ssize_t got = read(s.from, buffer, sizeof(buffer));
+            if (got < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+            if (got <= 0)
+            {
+                std::cerr << "Worker " << polled[k] << " exited with chunks in flight" << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+            s.in.insert(s.in.end(), buffer, buffer + got);
+
+            //complete responses belong to the oldest chunks of the worker
+            while (s.in.size() >= sizeof(aln_response_header))
+            {
+                aln_response_header header;
+                std::memcpy(&header, s.in.data(), sizeof(header));
+                if (header.magic != ALN_RESPONSE_MAGIC || header.status != ALN_OK)
+                {
+                    std::cerr << "Worker " << polled[k] << " failed with status " << header.status << std::endl;
+                    std::exit(EXIT_FAILURE);
+                }
+                const std::size_t bytes = sizeof(header) + header.payload_bytes;
+                if (s.in.size() < bytes) break;
+                done[s.chunks.front()].assign(s.in.begin(), s.in.begin() + bytes);
+                s.in.erase(s.in.begin(), s.in.begin() + bytes);
+                s.chunks.pop_front();
+            }
+        }
+
+        for (std::map<long, std::vector<char> >::iterator c = done.find(next_print); c != done.end(); c = done.find(next_print))
+        {
+            StatsTimer io(&AlignStats::io_seconds);
+            print_results(c->second, score_only);
+            done.erase(c);
+            next_print++;
+        }
+    }
+    std::cout.flush();
+
+    //STEP 3: end of stream for the workers, which print their telemetry and exit
+    for (int w=0; w<workers; w++)
+    {
+        close(shards[w].to);
+    }
+    int failed = 0;
+    for (int w=0; w<workers; w++)
+    {
+        int status;
+        waitpid(shards[w].pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+        close(shards[w].from);
+    }
+    if (failed > 0)
+    {
+        std::cerr << failed << " worker(s) failed" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
+
+
+//Functions
+std::vector<cpu_set_t> node_cpus()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+
+    //cpulist: ranges such as "0-7,16-23"
+    std::vector<cpu_set_t> nodes;
+    for (int node=0; ; node++)
+    {
+        std::ifstream list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!list) break;
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        std::string range;
+        while (std::getline(list, range, ','))
+        {
+            int first = 0, last = -1;
+            const int fields = std::sscanf(range.c_str(), "%d-%d", &first, &last);
+            if (fields < 1) continue;
+            if (fields == 1) last = first;
+            for (int c=first; c<=last && c<CPU_SETSIZE; c++)
+            {
+                if (CPU_ISSET(c, &allowed)) CPU_SET(c, &cpus);
+            }
+        }
+        if (CPU_COUNT(&cpus) > 0) nodes.push_back(cpus);
+    }
+    if (nodes.empty()) nodes.push_back(allowed);
+    return nodes;
+}
+
+void worker_main(int in_fd, int out_fd, int threads)
+{
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    ThreadPool pool(threads);
+    std::vector<char> payload, response;
+    std::vector<BatchPair> pairs;
+    std::vector<AlignResult> results;
+    BatchPlan plan;
+    BatchOutput output;
+
+    aln_request_header header;
+    while (read_full(in_fd, &header, sizeof(header)))
+    {
+        payload.resize(header.payload_bytes);
+        if (header.magic != ALN_REQUEST_MAGIC || !read_full(in_fd, payload.data(), header.payload_bytes)
+            || !frame_pairs(header, payload.data(), pairs))
+        {
+            aln_response_header error = { ALN_RESPONSE_MAGIC, ALN_EINVAL, 0, 0 };
+            write_full(out_fd, &error, sizeof(error));
+            break;
+        }
+
+        AlignerConfig config = default_config();
+        config.mode = static_cast<AlignMode>(header.mode);
+        config.engine = static_cast<AlignEngine>(header.engine);
+        const Aligner aligner(config);
+
+        //the jobs in plan order, most expensive first; results are copied out of the workspaces
+        const int count = header.count;
+        plan_batch(pairs.data(), count, aligner, NULL, plan, output);
+        for (std::size_t j=0; j<plan.jobs.size(); j++)
+        {
+            const BatchJob& job = plan.jobs[j];
+            pool.submit([&aligner, &plan, &output, &job]
+            {
+                run_job(aligner, plan, job, thread_arena(), output);
+                stats_record_arena(thread_arena());
+            });
+        }
+        pool.wait();
+
+        results.resize(count);
+        for (int k=0; k<count; k++)
+        {
+            const AlignResult r = { output.score(k), output.length(k), output.row_1(k), output.row_2(k),
+                                    output.optimal(k) };
+            results[k] = r;
+        }
+
+        frame_response(results.data(), count, config.mode == MODE_ALIGN, response);
+        if (!write_full(out_fd, response.data(), response.size())) break;
+    }
+
+    if (stats_enabled)
+    {
+        stats_write_json(std::cerr, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+}
+
+void print_results(const std::vector<char>& response, bool score_only)
+{
+    aln_response_header header;
+    std::memcpy(&header, response.data(), sizeof(header));
+    const char* at = response.data() + sizeof(header);
+    for (uint32_t k=0; k<header.count; k++)
+    {
+        int32_t score;
+        uint32_t length;
+        std::memcpy(&score, at, sizeof(score));
+        std::memcpy(&length, at + sizeof(score), sizeof(length));
+        at += sizeof(score) + sizeof(length);
+        if (score_only)
+        {
+            std::cout << score << '\n';
+            continue;
+        }
+        std::cout.write(at, length) << '\n';
+        std::cout.write(at + length, length) << '\n';
+        at += 2 * length;
+    }
+}
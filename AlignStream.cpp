@@ -0,0 +1,115 @@
+/*
+ * Streaming alignment: global alignment of two sequences too long to hold in memory
+ *
+ * Both files are mapped and read a chunk at a time; checkpoints and partial results are
+ * spilled to disk (StreamAlign.h), so the peak resident set stays under --memory
+ * whatever the lengths.
+ *
+ * Usage:
+ * - AlignStream X.fasta Y.fasta [--memory MB] [--tmp DIR] [--cigar FILE] [--stats]
+ *   each file holds one sequence: raw, or a single FASTA record with lines of equal length.
+ * - Prints the score, then the CIGAR of the alignment (M, I for a residue of X only,
+ *   D for a residue of Y only) on its own line; --cigar writes the CIGAR to FILE instead.
+ * - --memory: resident memory limit in MB (default 256); --tmp: directory of the spill
+ *   files (default $TMPDIR or /tmp), which take about n*m/S bytes for S rows per strip.
+ * - --stats prints cells, timings and arena usage as JSON on stderr.
+ * - Adjust parameter scores as desired (Scoring.h).
+ *
+ */
+
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "StreamAlign.h"
+#include "Stats.h"
+
+int main(int argc, char* argv[])
+{
+    const char* files[2] = { NULL, NULL };
+    const char* cigar = NULL;
+    StreamConfig config = default_stream_config();
+    bool usage = false;
+    for (int a=1; a<argc; a++)
+    {
+        if (std::strcmp(argv[a], "--stats") == 0) stats_enabled = true;
+        else if (std::strcmp(argv[a], "--memory") == 0 && a+1 < argc)
+        {
+            config.memory_limit = (std::size_t)std::atol(argv[++a]) << 20;
+        }
+        else if (std::strcmp(argv[a], "--tmp") == 0 && a+1 < argc) config.spill_dir = argv[++a];
+        else if (std::strcmp(argv[a], "--cigar") == 0 && a+1 < argc) cigar = argv[++a];
+        else if (argv[a][0] != '-' && files[0] == NULL) files[0] = argv[a];
+        else if (argv[a][0] != '-' && files[1] == NULL) files[1] = argv[a];
+        else usage = true;
+    }
+
+    if (usage || files[1] == NULL)
+    {
+        std::cerr << "Please, insert the two sequence files:" << std::endl
+                <<"• X as argv[1] and Y as argv[2], one sequence each (raw or FASTA)" << std::endl
+                <<"[--memory MB] [--tmp DIR] [--cigar FILE] [--stats]" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::string error;
+    MappedSequence X, Y;
+    if (!X.open(files[0], error) || !Y.open(files[1], error))
+    {
+        std::cerr << error << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    //the score goes first, so the CIGAR goes to a file until it is known
+    int cigar_fd = -1;
+    std::string spooled;
+    if (cigar != NULL)
+    {
+        cigar_fd = open(cigar, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    else
+    {
+        spooled = config.spill_dir + "/alignstream-cigar.XXXXXX";
+        cigar_fd = mkstemp(&spooled[0]);
+        if (cigar_fd >= 0) unlink(spooled.c_str());
+    }
+    if (cigar_fd < 0)
+    {
+        std::cerr << "Cannot create " << (cigar ? cigar : "the CIGAR file in " + config.spill_dir) << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    StreamResult result;
+    if (!stream_align(X, Y, config, cigar_fd, result, error))
+    {
+        std::cerr << error << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::cout << result.score << std::endl;
+    if (cigar == NULL)
+    {
+        std::cout.flush();
+        char buffer[STREAM_IO_CHUNK / 16];
+        ssize_t got;
+        lseek(cigar_fd, 0, SEEK_SET);
+        while ((got = read(cigar_fd, buffer, sizeof(buffer))) > 0)
+        {
+            std::cout.write(buffer, got);
+        }
+        std::cout << std::endl;
+    }
+    close(cigar_fd);
+
+    if (stats_enabled)
+    {
+        stats_write_json(std::cerr, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return 0;
+}
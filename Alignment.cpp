@@ -0,0 +1,897 @@
+/*
+ * Alignment library: Needleman-Wunsch, checkpoint and Hirschberg engines, see Alignment.h
+ *
+ * Needleman-Wunsch computes the optimal global alignment score with dynamic programming
+ * and traces back the aligned sequences [1]. Hirschberg improves it in space: it splits X
+ * in half, finds where the optimal path crosses the middle row from a forward and a
+ * backward NWScore, and recurses on the two halves, in linear space [2]. Checkpointing sits
+ * in between: the forward fill keeps every sqrt(n)-th row, and the traceback recomputes one
+ * strip of sqrt(n) rows at a time, so each cell is computed at most twice in O(m sqrt(n)) memory.
+ *
+ * References:
+ * - [1] Needleman, S. B., & Wunsch, C. D. (1970). A general method applicable to the search for similarities
+ *   in the amino acid sequence of two proteins. Journal of Molecular Biology, 48(3), 443–453.
+ * - [2] Hirschberg, D. S. (1975). A linear space algorithm for computing maximal common subsequences.
+ *   Communications of the ACM, 18(6), 341–343.
+ *
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "Alignment.h"
+#include "FourRussians.h"
+#include "SeedExtend.h"
+#include "Stats.h"
+#include "Steps.h"
+#include "ThreadPool.h"
+
+//Useful tools
+//auto_engine: the engine ENGINE_AUTO runs on an n x m pair; one with a full forward fill when counted
+static AlignEngine auto_engine(int n, int m, bool counted);
+
+//reversed_copy: S[0...len) backwards, in arena
+static const char* reversed_copy(const char* S, int len, Arena& arena);
+
+//fill_matrix: the full (n+1) x (m+1) matrix of Needleman-Wunsch into M; with optimal, the
+//number of co-optimal alignments goes there
+static void fill_matrix(const char* X, int n, const char* Y, int m, const Scoring& sc, Arena& arena, int* M,
+                        double* optimal);
+
+//count_score: score of the pair in one row pass, the number of co-optimal alignments into optimal
+static int count_score(const char* X, int n, const char* Y, int m, const Scoring& sc, Arena& arena,
+                       double& optimal);
+
+//enumerate_paths: up to list.limit optimal paths through the filled matrix M, appended to
+//list.alignments, by a depth-first traceback over every tied move (diagonal, then up, then left)
+static void enumerate_paths(const int* M, const char* X, int n, const char* Y, int m, const Scoring& sc,
+                            Arena& arena, CoOptimalList& list);
+
+//count_rows: fill_rows without steps, counts[0...m] advanced alongside: the number of
+//optimal paths from (0, 0) into each cell, the sum over the moves that tie for its maximum
+static void count_rows(const char* X, int r0, int r1, const char* Y, int m, const Scoring& sc,
+                       int* row, double* counts);
+
+
+AlignerConfig default_config()
+{
+    AlignerConfig config;
+    config.scoring = default_scoring();
+    config.mode = MODE_ALIGN;
+    config.engine = ENGINE_AUTO;
+    config.ties = TIES_LEFT;
+    config.count_optimal = false;
+    return config;
+}
+
+Aligner::Aligner(const AlignerConfig& config) : cfg(config)
+{
+}
+
+AlignResult Aligner::align(const char* X, int n, const char* Y, int m, Arena& workspace) const
+{
+    workspace.reset();
+    AlignResult r = { 0, 0, NULL, NULL, 0 };
+    double* optimal = cfg.count_optimal ? &r.optimal : NULL;
+
+    if (cfg.mode == MODE_SCORE && cfg.count_optimal)
+    {
+        r.score = count_score(X, n, Y, m, cfg.scoring, workspace, r.optimal);
+        return r;
+    }
+    if (cfg.mode == MODE_SCORE && cfg.engine == ENGINE_FOUR_RUSSIANS)
+    {
+        r.score = four_russians_score(X, n, Y, m, cfg.scoring, workspace);
+        return r;
+    }
+    if (cfg.mode == MODE_SCORE)
+    {
+        int* Lastline = workspace.alloc<int>(m+1);
+        NWScore_row(X, n, Y, m, false, cfg.scoring, Lastline);
+        r.score = Lastline[m];
+        return r;
+    }
+
+    //TIES_RIGHT: both sequences reversed here, the rows reversed back at the end
+    const bool mirror = cfg.ties == TIES_RIGHT;
+    if (mirror)
+    {
+        X = reversed_copy(X, n, workspace);
+        Y = reversed_copy(Y, m, workspace);
+    }
+    char* A_1 = workspace.alloc<char>(n+m);
+    char* A_2 = workspace.alloc<char>(n+m);
+    const AlignEngine engine = cfg.engine == ENGINE_AUTO ? auto_engine(n, m, cfg.count_optimal) : cfg.engine;
+    if (engine == ENGINE_NEEDLEMAN_WUNSCH)
+    {
+        r.score = NeedlemanWunsch_into(X, n, Y, m, cfg.scoring, workspace, A_1, A_2, r.length, optimal);
+    }
+    else if (engine == ENGINE_CHECKPOINT)
+    {
+        r.score = Checkpoint_into(X, n, Y, m, cfg.scoring, workspace, A_1, A_2, r.length, optimal);
+    }
+    else if (engine == ENGINE_SEED_EXTEND)
+    {
+        seed_extend_into(X, n, Y, m, cfg.scoring, workspace, A_1, A_2, r.length);
+        r.score = alignment_score(A_1, A_2, r.length, cfg.scoring);
+    }
+    else
+    {
+        Hirschberg_into(X, n, Y, m, cfg.scoring, workspace, A_1, A_2, r.length);
+        r.score = alignment_score(A_1, A_2, r.length, cfg.scoring);
+    }
+    if (mirror)
+    {
+        std::reverse(A_1, A_1 + r.length);
+        std::reverse(A_2, A_2 + r.length);
+    }
+    r.A_1 = A_1;
+    r.A_2 = A_2;
+    return r;
+}
+
+void Aligner::align_batch(const BatchPair* pairs, int count, Arena& workspace, AlignResult* results) const
+{
+    workspace.reset();
+    const bool score_only = cfg.mode == MODE_SCORE;
+
+    //TIES_RIGHT: every pair reversed, as in align
+    const bool mirror = !score_only && cfg.ties == TIES_RIGHT;
+    if (mirror)
+    {
+        BatchPair* reversed = workspace.alloc<BatchPair>(count);
+        for (int k=0; k<count; k++)
+        {
+            const BatchPair& p = pairs[k];
+            reversed[k].X = reversed_copy(p.X, p.n, workspace);
+            reversed[k].n = p.n;
+            reversed[k].Y = reversed_copy(p.Y, p.m, workspace);
+            reversed[k].m = p.m;
+        }
+        pairs = reversed;
+    }
+
+    BatchPair* lanes = workspace.alloc<BatchPair>(count);
+    int* lane_of = workspace.alloc<int>(count);
+    char** A_1 = workspace.alloc<char*>(count);
+    char** A_2 = workspace.alloc<char*>(count);
+    int nlanes = 0;
+
+    //short pairs go to the lockstep kernels, the others (and all when counted) to the scalar engines
+    for (int k=0; k<count; k++)
+    {
+        const BatchPair& p = pairs[k];
+        if (!score_only)
+        {
+            A_1[k] = workspace.alloc<char>(p.n + p.m);
+            A_2[k] = workspace.alloc<char>(p.n + p.m);
+        }
+        lane_of[k] = -1;
+        if (p.n <= BATCH_MAX_LEN && p.m <= BATCH_MAX_LEN && !cfg.count_optimal)
+        {
+            lane_of[k] = nlanes;
+            lanes[nlanes++] = p;
+        }
+    }
+
+    int* lane_scores = workspace.alloc<int>(nlanes);
+    int* lane_lens = workspace.alloc<int>(nlanes);
+    char** lane_A_1 = workspace.alloc<char*>(nlanes);
+    char** lane_A_2 = workspace.alloc<char*>(nlanes);
+    for (int k=0; k<count; k++)
+    {
+        if (lane_of[k] >= 0 && !score_only)
+        {
+            lane_A_1[lane_of[k]] = A_1[k];
+            lane_A_2[lane_of[k]] = A_2[k];
+        }
+    }
+    if (nlanes > 0)
+    {
+        if (score_only) batch_score(lanes, nlanes, cfg.scoring, workspace, lane_scores);
+        else batch_align(lanes, nlanes, cfg.scoring, workspace, lane_scores, lane_A_1, lane_A_2, lane_lens);
+    }
+
+    for (int k=0; k<count; k++)
+    {
+        const BatchPair& p = pairs[k];
+        AlignResult& r = results[k];
+        const AlignEngine engine = cfg.engine == ENGINE_AUTO ? auto_engine(p.n, p.m, cfg.count_optimal) : cfg.engine;
+        double* optimal = cfg.count_optimal ? &r.optimal : NULL;
+        r.length = 0;
+        r.A_1 = score_only ? NULL : A_1[k];
+        r.A_2 = score_only ? NULL : A_2[k];
+        r.optimal = 0;
+        if (lane_of[k] >= 0)
+        {
+            r.score = lane_scores[lane_of[k]];
+            if (!score_only) r.length = lane_lens[lane_of[k]];
+        }
+        else if (score_only && cfg.count_optimal)
+        {
+            r.score = count_score(p.X, p.n, p.Y, p.m, cfg.scoring, workspace, r.optimal);
+        }
+        else if (score_only && cfg.engine == ENGINE_FOUR_RUSSIANS)
+        {
+            r.score = four_russians_score(p.X, p.n, p.Y, p.m, cfg.scoring, workspace);
+        }
+        else if (score_only)
+        {
+            const ArenaMark mark = workspace.mark();
+            int* Lastline = workspace.alloc<int>(p.m + 1);
+            NWScore_row(p.X, p.n, p.Y, p.m, false, cfg.scoring, Lastline);
+            r.score = Lastline[p.m];
+            workspace.rewind(mark);
+        }
+        else if (engine == ENGINE_NEEDLEMAN_WUNSCH)
+        {
+            r.score = NeedlemanWunsch_into(p.X, p.n, p.Y, p.m, cfg.scoring, workspace, A_1[k], A_2[k], r.length,
+                                           optimal);
+        }
+        else if (engine == ENGINE_CHECKPOINT)
+        {
+            r.score = Checkpoint_into(p.X, p.n, p.Y, p.m, cfg.scoring, workspace, A_1[k], A_2[k], r.length, optimal);
+        }
+        else if (engine == ENGINE_SEED_EXTEND)
+        {
+            seed_extend_into(p.X, p.n, p.Y, p.m, cfg.scoring, workspace, A_1[k], A_2[k], r.length);
+            r.score = alignment_score(A_1[k], A_2[k], r.length, cfg.scoring);
+        }
+        else
+        {
+            Hirschberg_into(p.X, p.n, p.Y, p.m, cfg.scoring, workspace, A_1[k], A_2[k], r.length);
+            r.score = alignment_score(A_1[k], A_2[k], r.length, cfg.scoring);
+        }
+    }
+
+    for (int k=0; mirror && k<count; k++)
+    {
+        std::reverse(A_1[k], A_1[k] + results[k].length);
+        std::reverse(A_2[k], A_2[k] + results[k].length);
+    }
+
+    if (stats_enabled) thread_stats().pairs += count;
+}
+
+AlignResult Aligner::co_optimal(const char* X, int n, const char* Y, int m, CoOptimalList& list,
+                                Arena& workspace) const
+{
+    workspace.reset();
+    AlignResult r = { 0, 0, NULL, NULL, 0 };
+    const bool mirror = cfg.ties == TIES_RIGHT;
+    if (mirror)
+    {
+        X = reversed_copy(X, n, workspace);
+        Y = reversed_copy(Y, m, workspace);
+    }
+    char* A_1 = workspace.alloc<char>(n+m);
+    char* A_2 = workspace.alloc<char>(n+m);
+    const std::size_t first = list.alignments.size();
+    r.score = NeedlemanWunsch_into(X, n, Y, m, cfg.scoring, workspace, A_1, A_2, r.length,
+                                   cfg.count_optimal ? &r.optimal : NULL, &list);
+    if (mirror)
+    {
+        std::reverse(A_1, A_1 + r.length);
+        std::reverse(A_2, A_2 + r.length);
+        for (std::size_t k=first; k<list.alignments.size(); k++)
+        {
+            std::reverse(list.alignments[k].first.begin(), list.alignments[k].first.end());
+            std::reverse(list.alignments[k].second.begin(), list.alignments[k].second.end());
+        }
+    }
+    r.A_1 = A_1;
+    r.A_2 = A_2;
+    return r;
+}
+
+double Aligner::cost(int n, int m) const
+{
+    const double cells = (double)n * m;
+    if (n <= BATCH_MAX_LEN && m <= BATCH_MAX_LEN && !cfg.count_optimal) return cells / BATCH_LANES;
+    if (cfg.mode == MODE_SCORE) return cfg.engine == ENGINE_FOUR_RUSSIANS && !cfg.count_optimal ? cells / 4 : cells;
+
+    const AlignEngine engine = cfg.engine == ENGINE_AUTO ? auto_engine(n, m, cfg.count_optimal) : cfg.engine;
+    if (engine == ENGINE_NEEDLEMAN_WUNSCH) return cells;
+    if (engine == ENGINE_SEED_EXTEND) return (double)(n + m) * SEED_LOOKBACK;
+
+    //checkpoint fills every cell twice; Hirschberg n*m/2 per level, about twice in all
+    return 2 * cells;
+}
+
+
+void NWScore_row(const char* X, int n, const char* Y, int m, bool reversed, const Scoring& sc, int* Lastline)
+{
+    StatsTimer fill(&AlignStats::fill_seconds);
+    if (stats_enabled) thread_stats().cells += (unsigned long long)n * m;
+
+    //Step 1: first row penalties, the row is then updated in place
+    Lastline[0] = 0;
+    for (int j=1;j<=m;j++)
+    {
+        Lastline[j] = Lastline[j-1] + sc.gap;
+    }
+
+    for (int i=1; i<=n;i++)
+    {
+        const char x = reversed ? X[n-i] : X[i-1];
+        int diag = Lastline[0];     //Score[i-1][j-1]
+        Lastline[0] += sc.gap;
+        for (int j=1; j<=m;j++)
+        {
+            const char y = reversed ? Y[m-j] : Y[j-1];
+            const int up = Lastline[j];
+            Lastline[j] = max3(
+                               Lastline[j-1] + sc.gap,
+                               up + sc.gap,
+                               diag + match_or_mismatch(x,y,sc)
+                               );
+            diag = up;
+        }
+    }
+}
+
+int NeedlemanWunsch_into(const char* X, int n, const char* Y, int m, const Scoring& sc, Arena& arena,
+                         char* A_1, char* A_2, int& len, double* optimal, CoOptimalList* list)
+{
+    const ArenaMark start = arena.mark();
+    const int w = m+1;
+    int* M = arena.alloc<int>((size_t)(n+1)*w);
+    fill_matrix(X, n, Y, m, sc, arena, M, optimal);
+
+    //STEP 3: Reconstruct alignment, backwards, then copy it after position len
+    StatsTimer traceback(&AlignStats::traceback_seconds);
+    char* R_1 = arena.alloc<char>(n+m);
+    char* R_2 = arena.alloc<char>(n+m);
+    int k = 0;
+    int i = n, j = m;
+    while (i>0 || j>0)
+    {
+        if (i>0
+            && j>0
+            && (M[(size_t)i*w+j] == M[(size_t)(i-1)*w+j-1] + match_or_mismatch(X[i-1], Y[j-1], sc)))
+        {
+            R_1[k] = X[i-1];
+            R_2[k] = Y[j-1];
+            i--;
+            j--;
+        }
+
+        else if (i>0
+            && (M[(size_t)i*w+j] == M[(size_t)(i-1)*w+j] + sc.gap))
+        {
+            R_1[k] = X[i-1];
+            R_2[k] = '-';
+            i--;
+        }
+
+        else
+        {
+            R_1[k] = '-';
+            R_2[k] = Y[j-1];
+            j--;
+        }
+        k++;
+    }
+
+    for (int t=0; t<k; t++)
+    {
+        A_1[len+t] = R_1[k-1-t];
+        A_2[len+t] = R_2[k-1-t];
+    }
+    len += k;
+
+    //STEP 4: the co-optimal alignments, out of the same matrix
+    if (list) enumerate_paths(M, X, n, Y, m, sc, arena, *list);
+    const int score = M[(size_t)n*w + m];
+    arena.rewind(start);
+    return score;
+}
+
+
+int argmax_split(const int* L, const int* R, int m)
+{
+    int max = L[0] + R[m];
+    int max_index=0;
+    for (int j=1; j<=m;j++)
+    {
+        if(max < L[j] + R[m-j])
+        {
+            max = L[j] + R[m-j];
+            max_index = j;
+        }
+    }
+
+    return max_index;
+}
+
+
+void Hirschberg_into(const char* X, int n, const char* Y, int m, const Scoring& sc, Arena& arena,
+                     char* A_1, char* A_2, int& len)
+{
+    if (stats_enabled)
+    {
+        AlignStats& stats = thread_stats();
+        stats.nodes++;
+        if (++stats.depth > stats.max_depth) stats.max_depth = stats.depth;
+    }
+
+    if (n==0)
+    {
+        for (int i=1; i<=m; i++)
+        {
+            A_1[len] = '-';
+            A_2[len] = Y[i-1];
+            len++;
+        }
+
+    }
+
+    else if (m==0)
+    {
+        for (int i=1; i<=n; i++)
+        {
+            A_1[len] = X[i-1];
+            A_2[len] = '-';
+            len++;
+        }
+    }
+
+    else if (n==1 || m ==1)
+    {
+        NeedlemanWunsch_into(X, n, Y, m, sc, arena, A_1, A_2, len);
+    }
+
+    else
+    {
+        const int xmid = n/2; //defect truncation (.5 -> .0)
+        const ArenaMark start = arena.mark();
+        ThreadPool* pool = ThreadPool::current();
+        const bool parallel = pool != NULL && pool->size() > 1 && (double)n * m > HIRSCHBERG_TASK_MIN_CELLS;
+
+        //scoreL on X[1...xmid], scoreR on reversed X[xmid+1 ... n] and reversed Y:
+        //no substring is materialised, the kernel reads the ranges backwards
+        int* scoreL = arena.alloc<int>(m+1);
+        int* scoreR = arena.alloc<int>(m+1);
+        if (parallel)
+        {
+            TaskGroup group;
+            pool->spawn(group, [=, &sc]{ NWScore_row(X + xmid, n - xmid, Y, m, true, sc, scoreR); });
+            NWScore_row(X, xmid, Y, m, false, sc, scoreL);
+            pool->wait(group);
+        }
+        else
+        {
+            NWScore_row(X, xmid, Y, m, false, sc, scoreL);
+            NWScore_row(X + xmid, n - xmid, Y, m, true, sc, scoreR);
+        }
+
+        const int ymid = argmax_split(scoreL, scoreR, m);
+        arena.rewind(start);
+
+        if (parallel)
+        {
+            //the second half is written after the longest first half could end, on the
+            //thread that runs it, then moved down next to the first half
+            const int second = len + xmid + ymid;
+            int end = second;
+            TaskGroup group;
+            pool->spawn(group, [=, &sc, &end]
+            {
+                Hirschberg_into(X + xmid, n - xmid, Y + ymid, m - ymid, sc, thread_arena(), A_1, A_2, end);
+            });
+            Hirschberg_into(X, xmid, Y, ymid, sc, arena, A_1, A_2, len);
+            pool->wait(group);
+            std::memmove(A_1 + len, A_1 + second, end - second);
+            std::memmove(A_2 + len, A_2 + second, end - second);
+            len += end - second;
+        }
+        else
+        {
+            Hirschberg_into(X, xmid, Y, ymid, sc, arena, A_1, A_2, len);
+            Hirschberg_into(X + xmid, n - xmid, Y + ymid, m - ymid, sc, arena, A_1, A_2, len);
+        }
+    }
+
+    if (stats_enabled) thread_stats().depth--;
+}
+
+
+int Checkpoint_into(const char* X, int n, const char* Y, int m, const Scoring& sc, Arena& arena,
+                    char* A_1, char* A_2, int& len, double* optimal)
+{
+    //row differences D(i,j) - D(i,j-1) - gap lie in [0...best - 2*gap] and are kept as bytes
+    const int best = sc.match > sc.mismatch ? sc.match : sc.mismatch;
+    if (best - 2*sc.gap > 255)
+    {
+        const int start = len;
+        Hirschberg_into(X, n, Y, m, sc, arena, A_1, A_2, len);
+        return alignment_score(A_1 + start, A_2 + start, len - start, sc);
+    }
+
+    const ArenaMark start = arena.mark();
+    const int stride = checkpoint_stride(n);
+    const int checkpoints = (n + stride - 1) / stride;
+    int* row = arena.alloc<int>(m+1);
+    uint8_t* saved = arena.alloc<uint8_t>((size_t)checkpoints * m);
+    double* counts = optimal ? arena.alloc<double>(m+1) : NULL;
+    int score;
+    {
+        StatsTimer fill(&AlignStats::fill_seconds);
+        if (stats_enabled) thread_stats().cells += (unsigned long long)n * m;
+
+        //STEP 1: forward fill in one row, every stride-th row saved as differences;
+        //counted, the number of optimal paths into each cell of the row alongside
+        row[0] = 0;
+        for (int j=1; j<=m; j++)
+        {
+            row[j] = row[j-1] + sc.gap;
+        }
+        for (int j=0; counts && j<=m; j++)
+        {
+            counts[j] = 1;
+        }
+        for (int i=0; i<n; i+=stride)
+        {
+            uint8_t* d = saved + (size_t)(i / stride) * m;
+            for (int j=1; j<=m; j++)
+            {
+                d[j-1] = row[j] - row[j-1] - sc.gap;
+            }
+            if (counts) count_rows(X, i, i + stride < n ? i + stride : n, Y, m, sc, row, counts);
+            else fill_rows<false>(X, i, i + stride < n ? i + stride : n, Y, m, sc, row, NULL, 0);
+        }
+        score = row[m];
+        if (optimal) *optimal = counts[m];
+    }
+
+    //STEP 2: strips from the last one up: rebuild the strip's checkpoint row, record the
+    //steps of its rows up to the column where the path enters, follow the path out of it.
+    //Ties are broken as in NeedlemanWunsch_into (diagonal, then up), so is the alignment
+    StatsTimer traceback(&AlignStats::traceback_seconds);
+    uint8_t* steps = arena.alloc<uint8_t>((size_t)stride * (m+1));
+    char* R_1 = arena.alloc<char>(n+m);
+    char* R_2 = arena.alloc<char>(n+m);
+    int k = 0;
+    int i = n, j = m;
+    while (i > 0)
+    {
+        const int i0 = (i-1) / stride * stride;
+        const int w = j+1;
+        const uint8_t* d = saved + (size_t)(i0 / stride) * m;
+        row[0] = i0 * sc.gap;
+        for (int c=1; c<=j; c++)
+        {
+            row[c] = row[c-1] + d[c-1] + sc.gap;
+        }
+        if (stats_enabled) thread_stats().cells += (unsigned long long)(i - i0) * j;
+        fill_rows<true>(X, i0, i, Y, j, sc, row, steps, w);
+
+        while (i > i0)
+        {
+            const uint8_t step = steps[(size_t)(i-i0-1) * w + j];
+            R_1[k] = step == STEP_LEFT ? '-' : X[i-1];
+            R_2[k] = step == STEP_UP ? '-' : Y[j-1];
+            if (step != STEP_LEFT) i--;
+            if (step != STEP_UP) j--;
+            k++;
+        }
+    }
+    for (; j>0; j--, k++)
+    {
+        R_1[k] = '-';
+        R_2[k] = Y[j-1];
+    }
+
+    for (int t=0; t<k; t++)
+    {
+        A_1[len+t] = R_1[k-1-t];
+        A_2[len+t] = R_2[k-1-t];
+    }
+    len += k;
+    arena.rewind(start);
+    return score;
+}
+
+
+int alignment_score(const char* A_1, const char* A_2, int len, const Scoring& sc)
+{
+    int score = 0;
+    for (int k=0; k<len; k++)
+    {
+        if (A_1[k] == '-' || A_2[k] == '-') score += sc.gap;
+        else score += match_or_mismatch(A_1[k], A_2[k], sc);
+    }
+    return score;
+}
+
+
+std::vector<int> NWScore(const std::string& X, const std::string& Y)
+{
+    std::vector<int> Lastline(Y.length() + 1);
+    NWScore_row(X.data(), X.length(), Y.data(), Y.length(), false, default_scoring(), Lastline.data());
+    return Lastline;
+}
+
+std::pair < std::string, std::string > NeedlemanWunsch (const std::string& X, const std::string& Y)
+{
+    const int n = X.length(), m = Y.length();
+    Arena& arena = thread_arena();
+    const ArenaMark start = arena.mark();
+    char* A_1 = arena.alloc<char>(n+m);
+    char* A_2 = arena.alloc<char>(n+m);
+    int len = 0;
+    NeedlemanWunsch_into(X.data(), n, Y.data(), m, default_scoring(), arena, A_1, A_2, len);
+
+    std::pair < std::string, std::string > alignment_pair;
+    alignment_pair.first.assign(A_1, len);
+    alignment_pair.second.assign(A_2, len);
+    arena.rewind(start);
+    return alignment_pair;
+}
+
+std::pair< std::string, std::string > Checkpoint(const std::string& X, const std::string& Y)
+{
+    const int n = X.length(), m = Y.length();
+    Arena& arena = thread_arena();
+    const ArenaMark start = arena.mark();
+    char* A_1 = arena.alloc<char>(n+m);
+    char* A_2 = arena.alloc<char>(n+m);
+    int len = 0;
+    Checkpoint_into(X.data(), n, Y.data(), m, default_scoring(), arena, A_1, A_2, len);
+
+    std::pair< std::string, std::string > alignment_pair;
+    alignment_pair.first.assign(A_1, len);
+    alignment_pair.second.assign(A_2, len);
+    arena.rewind(start);
+    return alignment_pair;
+}
+
+std::vector< std::pair<std::string, std::string> > CoOptimal(const std::string& X, const std::string& Y, int limit)
+{
+    const int n = X.length(), m = Y.length();
+    Arena& arena = thread_arena();
+    const ArenaMark start = arena.mark();
+    char* A_1 = arena.alloc<char>(n+m);
+    char* A_2 = arena.alloc<char>(n+m);
+    int len = 0;
+    CoOptimalList list;
+    list.limit = limit;
+    NeedlemanWunsch_into(X.data(), n, Y.data(), m, default_scoring(), arena, A_1, A_2, len, NULL, &list);
+    arena.rewind(start);
+    return list.alignments;
+}
+
+std::pair< std::string, std::string > Hirschberg(const std::string& X, const std::string& Y)
+{
+    const int n = X.length(), m = Y.length();
+    Arena& arena = thread_arena();
+    const ArenaMark start = arena.mark();
+    char* A_1 = arena.alloc<char>(n+m);
+    char* A_2 = arena.alloc<char>(n+m);
+    int len = 0;
+    Hirschberg_into(X.data(), n, Y.data(), m, default_scoring(), arena, A_1, A_2, len);
+
+    std::pair< std::string, std::string > ZWpair;
+    ZWpair.first.assign(A_1, len);
+    ZWpair.second.assign(A_2, len);
+    arena.rewind(start);
+    return ZWpair;
+}
+
+
+static AlignEngine auto_engine(int n, int m, bool counted)
+{
+    if ((double)(n+1)*(m+1) <= AUTO_NW_MAX_CELLS) return ENGINE_NEEDLEMAN_WUNSCH;
+    if (counted || checkpoint_bytes(n, m) <= AUTO_CHECKPOINT_MAX_BYTES) return ENGINE_CHECKPOINT;
+    return ENGINE_HIRSCHBERG;
+}
+
+static const char* reversed_copy(const char* S, int len, Arena& arena)
+{
+    char* R = arena.alloc<char>(len);
+    std::reverse_copy(S, S + len, R);
+    return R;
+}
+
+static int count_score(const char* X, int n, const char* Y, int m, const Scoring& sc, Arena& arena,
+                       double& optimal)
+{
+    const ArenaMark start = arena.mark();
+    int* row = arena.alloc<int>(m+1);
+    double* counts = arena.alloc<double>(m+1);
+    row[0] = 0;
+    counts[0] = 1;
+    for (int j=1; j<=m; j++)
+    {
+        row[j] = row[j-1] + sc.gap;
+        counts[j] = 1;
+    }
+    {
+        StatsTimer fill(&AlignStats::fill_seconds);
+        if (stats_enabled) thread_stats().cells += (unsigned long long)n * m;
+        count_rows(X, 0, n, Y, m, sc, row, counts);
+    }
+    const int score = row[m];
+    optimal = counts[m];
+    arena.rewind(start);
+    return score;
+}
+
+template <bool STEPS>
+void fill_rows(const char* X, int r0, int r1, const char* Y, int m, const Scoring& sc,
+                      int* row, uint8_t* steps, int w)
+{
+    //two rows per sweep, the second one column behind the first: two dependency chains
+    //run side by side instead of one
+    int r = r0;
+    for (; r+2 <= r1; r+=2)
+    {
+        const char xa = X[r], xb = X[r+1];
+        uint8_t* sa = STEPS ? steps + (size_t)(r-r0) * w : NULL;
+        uint8_t* sb = STEPS ? sa + w : NULL;
+        int diag_a = row[0];
+        int left_a = row[0] + sc.gap;
+        int diag_b = left_a;
+        int left_b = left_a + sc.gap;
+        row[0] = left_b;
+        if (STEPS) sa[0] = sb[0] = STEP_UP;
+        for (int c=1; c<=m; c++)
+        {
+            const char y = Y[c-1];
+            const int up_a = row[c];
+            const int a = best_step<STEPS>(diag_a + match_or_mismatch(xa, y, sc), up_a + sc.gap, left_a + sc.gap,
+                                           STEPS ? sa + c : NULL);
+            diag_a = up_a;
+            left_a = a;
+            const int b = best_step<STEPS>(diag_b + match_or_mismatch(xb, y, sc), a + sc.gap, left_b + sc.gap,
+                                           STEPS ? sb + c : NULL);
+            diag_b = a;
+            left_b = b;
+            row[c] = b;
+        }
+    }
+
+    if (r < r1)
+    {
+        const char x = X[r];
+        uint8_t* sa = STEPS ? steps + (size_t)(r-r0) * w : NULL;
+        int diag = row[0];
+        row[0] += sc.gap;
+        if (STEPS) sa[0] = STEP_UP;
+        for (int c=1; c<=m; c++)
+        {
+            const int up = row[c];
+            row[c] = best_step<STEPS>(diag + match_or_mismatch(x, Y[c-1], sc), up + sc.gap, row[c-1] + sc.gap,
+                                      STEPS ? sa + c : NULL);
+            diag = up;
+        }
+    }
+}
+
+template void fill_rows<false>(const char* X, int r0, int r1, const char* Y, int m, const Scoring& sc,
+                               int* row, uint8_t* steps, int w);
+template void fill_rows<true>(const char* X, int r0, int r1, const char* Y, int m, const Scoring& sc,
+                              int* row, uint8_t* steps, int w);
+
+static void enumerate_paths(const int* M, const char* X, int n, const char* Y, int m, const Scoring& sc,
+                            Arena& arena, CoOptimalList& list)
+{
+    const ArenaMark start = arena.mark();
+    const int w = m+1;
+    //STEP 1: depth first from (n, m): cell k of the path is (I[k], J[k]), with the moves out
+    //of it tried so far; the columns from cell k to cell k+1 are R_1[k]/R_2[k]
+    char* R_1 = arena.alloc<char>(n+m);
+    char* R_2 = arena.alloc<char>(n+m);
+    int* I = arena.alloc<int>(n+m+1);
+    int* J = arena.alloc<int>(n+m+1);
+    uint8_t* tried = arena.alloc<uint8_t>(n+m+1);
+    std::vector< std::pair<std::string, std::string> >& alignments = list.alignments;
+    int k = 0;
+    I[0] = n;
+    J[0] = m;
+    tried[0] = 0;
+    while (k >= 0 && (int)alignments.size() < list.limit)
+    {
+        const int i = I[k], j = J[k];
+
+        //STEP 2: (0, 0) reached, the path read forwards is one more alignment
+        if (i == 0 && j == 0)
+        {
+            alignments.push_back(std::make_pair(std::string(R_1, k), std::string(R_2, k)));
+            std::reverse(alignments.back().first.begin(), alignments.back().first.end());
+            std::reverse(alignments.back().second.begin(), alignments.back().second.end());
+            k--;
+            continue;
+        }
+        if (tried[k] > STEP_LEFT)
+        {
+            k--;
+            continue;
+        }
+
+        //STEP 3: the next move out of the cell, followed when it ties for the maximum
+        const int step = tried[k]++;
+        const int h = M[(size_t)i*w+j];
+        if (step == STEP_DIAG
+            && !(i > 0 && j > 0 && h == M[(size_t)(i-1)*w+j-1] + match_or_mismatch(X[i-1], Y[j-1], sc))) continue;
+        if (step == STEP_UP && !(i > 0 && h == M[(size_t)(i-1)*w+j] + sc.gap)) continue;
+        if (step == STEP_LEFT && !(j > 0 && h == M[(size_t)i*w+j-1] + sc.gap)) continue;
+        R_1[k] = step == STEP_LEFT ? '-' : X[i-1];
+        R_2[k] = step == STEP_UP ? '-' : Y[j-1];
+        k++;
+        I[k] = step == STEP_LEFT ? i : i-1;
+        J[k] = step == STEP_UP ? j : j-1;
+        tried[k] = 0;
+    }
+    arena.rewind(start);
+}
+
+static void count_rows(const char* X, int r0, int r1, const char* Y, int m, const Scoring& sc,
+                       int* row, double* counts)
+{
+    for (int r=r0; r<r1; r++)
+    {
+        const char x = X[r];
+        int diag = row[0];
+        double diag_count = counts[0];
+        row[0] += sc.gap;
+        for (int c=1; c<=m; c++)
+        {
+            const int up = row[c];
+            const double up_count = counts[c];
+            const int d = diag + match_or_mismatch(x, Y[c-1], sc);
+            const int h = max3(row[c-1] + sc.gap, up + sc.gap, d);
+            counts[c] = (h == d ? diag_count : 0) + (h == up + sc.gap ? up_count : 0)
+                      + (h == row[c-1] + sc.gap ? counts[c-1] : 0);
+            row[c] = h;
+            diag = up;
+            diag_count = up_count;
+        }
+    }
+}
+
+
+static void fill_matrix(const char* X, int n, const char* Y, int m, const Scoring& sc, Arena& arena, int* M,
+                        double* optimal)
+{
+    const int w = m+1;
+    StatsTimer fill(&AlignStats::fill_seconds);
+    if (stats_enabled) thread_stats().cells += (unsigned long long)n * m;
+
+    //STEP 1: assign first row and column
+    M[0] = 0;
+    for (int i=1;i<n+1;i++)
+    {
+        M[(size_t)i*w] = M[(size_t)(i-1)*w] + sc.gap;
+    }
+    for (int i=1;i<m+1;i++)
+    {
+        M[i] = M[i-1] + sc.gap;
+    }
+
+    //STEP 2: Needelman-Wunsch; counted, each row is advanced in place from a copy of the
+    //one above, the number of optimal paths into its cells alongside
+    if (optimal)
+    {
+        double* counts = arena.alloc<double>(w);
+        for (int j=0;j<m+1;j++)
+        {
+            counts[j] = 1;
+        }
+        for (int i=1;i<n+1;i++)
+        {
+            std::memcpy(&M[(size_t)i*w], &M[(size_t)(i-1)*w], w * sizeof(int));
+            count_rows(X, i-1, i, Y, m, sc, &M[(size_t)i*w], counts);
+        }
+        *optimal = counts[m];
+    }
+    else for (int i=1;i<n+1;i++)
+    {
+        for (int j=1;j<m+1;j++)
+        {
+            M[(size_t)i*w+j] = max3(M[(size_t)(i-1)*w+j-1] + match_or_mismatch(X[i-1], Y[j-1], sc),
+                            M[(size_t)i*w+j-1] + sc.gap,
+                            M[(size_t)(i-1)*w+j] + sc.gap);
+        }
+    }
+}
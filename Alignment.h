@@ -0,0 +1,202 @@
+/*
+ * Alignment library: global pairwise alignment engines and the Aligner API
+ *
+ * The engines work on pointer/length ranges and take their scratch memory from an
+ * Arena (Arena.h), which is the workspace of the C++ and C (AlignmentC.h) APIs:
+ * allocate one per thread, reuse it for every call and no heap calls are made once
+ * it has grown to the largest pair.
+ *
+ * Usage:
+ *   AlignerConfig config = default_config();
+ *   config.engine = ENGINE_HIRSCHBERG;
+ *   const Aligner aligner(config);          //configured once
+ *   Arena workspace;                        //one per thread
+ *   AlignResult r = aligner.align(X, n, Y, m, workspace);
+ *   //r.A_1 / r.A_2 point into the workspace until its next use
+ *
+ * ALIGNMENT_API_VERSION changes whenever a declaration of this header or of
+ * AlignmentC.h changes incompatibly.
+ *
+ */
+
+#ifndef ALIGNMENT_H
+#define ALIGNMENT_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Arena.h"
+#include "BatchAlign.h"
+#include "Scoring.h"
+
+#define ALIGNMENT_API_VERSION 2
+
+//Pairs whose full matrix has at most this many cells use Needleman-Wunsch under ENGINE_AUTO
+#define AUTO_NW_MAX_CELLS (1 << 22)
+
+//Larger pairs whose checkpoints and strip fit in this many bytes use ENGINE_CHECKPOINT under
+//ENGINE_AUTO (up to about 100 kb x 100 kb), Hirschberg above
+#define AUTO_CHECKPOINT_MAX_BYTES (1 << 26)
+
+//Hirschberg splits of more cells than this, on a ThreadPool worker (ThreadPool.h), run their
+//backward half and their second half as subtasks, which idle workers steal
+#define HIRSCHBERG_TASK_MIN_CELLS (1 << 24)
+
+//AlignMode: what a call returns
+enum AlignMode
+{
+    MODE_ALIGN = 0,         //score and aligned sequences
+    MODE_SCORE = 1          //score only, linear memory
+};
+
+//AlignEngine: algorithm behind MODE_ALIGN, and behind MODE_SCORE for ENGINE_FOUR_RUSSIANS
+enum AlignEngine
+{
+    ENGINE_AUTO = 0,                //Needleman-Wunsch, then checkpoints, then Hirschberg, by size
+    ENGINE_NEEDLEMAN_WUNSCH = 1,    //full matrix, O(nm) memory
+    ENGINE_HIRSCHBERG = 2,          //divide and conquer, O(m) memory
+    ENGINE_SEED_EXTEND = 3,         //chained minimizer anchors, exact engines between them (approximate)
+    ENGINE_FOUR_RUSSIANS = 4,       //MODE_SCORE by block table lookups (FourRussians.h); Hirschberg in MODE_ALIGN
+    ENGINE_CHECKPOINT = 5           //every sqrt(n)-th row kept, traceback strip by strip, O(m sqrt(n)) memory
+};
+
+//TieBreak: which of several optimal alignments MODE_ALIGN returns. Needleman-Wunsch, the
+//checkpoints and the lockstep kernels trace back from the end preferring the diagonal, then
+//up, then left, which moves every gap as far left as it goes (homopolymer and repeat indels
+//at their leftmost position, as variant callers normalise them). Hirschberg and
+//seed-and-extend pick by their splits and anchors: optimal, but no placement guaranteed
+enum TieBreak
+{
+    TIES_LEFT = 0,          //gaps left-aligned
+    TIES_RIGHT = 1          //gaps right-aligned: the TIES_LEFT alignment of both sequences reversed, mirrored
+};
+
+struct AlignerConfig
+{
+    Scoring scoring;
+    AlignMode mode;
+    AlignEngine engine;
+    TieBreak ties;
+    bool count_optimal;     //AlignResult::optimal counted during the forward fill, see below
+};
+
+//AlignResult: A_1/A_2 hold length characters (not terminated) inside the workspace; NULL in MODE_SCORE.
+//optimal: with count_optimal, the number of co-optimal alignments (exact up to 2^53), summed
+//over the tied moves into each cell during the fill; 0 when not counted. Under
+//count_optimal, ENGINE_AUTO and the batches skip Hirschberg and the lockstep kernels, which
+//have no full forward fill, and MODE_SCORE counts in its row pass whatever the engine;
+//ENGINE_HIRSCHBERG, ENGINE_SEED_EXTEND and ENGINE_FOUR_RUSSIANS in MODE_ALIGN leave it at 0
+struct AlignResult
+{
+    int score;
+    int length;
+    const char* A_1;
+    const char* A_2;
+    double optimal;
+};
+
+//CoOptimalList: up to limit co-optimal alignments, as pairs of rows
+struct CoOptimalList
+{
+    int limit;
+    std::vector< std::pair<std::string, std::string> > alignments;
+};
+
+//default_config: default scoring, MODE_ALIGN, ENGINE_AUTO, TIES_LEFT, no counting
+AlignerConfig default_config();
+
+class Aligner
+{
+public:
+    explicit Aligner(const AlignerConfig& config);
+
+    const AlignerConfig& config() const { return cfg; }
+
+    //align: one pair; resets the workspace first
+    AlignResult align(const char* X, int n, const char* Y, int m, Arena& workspace) const;
+
+    //align_batch: count pairs, results[k] for pairs[k]; resets the workspace first.
+    //Pairs up to BATCH_MAX_LEN go to the lockstep SIMD kernels
+    void align_batch(const BatchPair* pairs, int count, Arena& workspace, AlignResult* results) const;
+
+    //co_optimal: the Needleman-Wunsch alignment of the pair under the tie policy, and up to
+    //list.limit co-optimal ones appended to list, that one first, traced out of the same full
+    //matrix (O(nm) memory whatever the engine); resets the workspace first
+    AlignResult co_optimal(const char* X, int n, const char* Y, int m, CoOptimalList& list, Arena& workspace) const;
+
+    //cost: estimated cell updates of an n x m pair with this configuration, for scheduling
+    //(Schedule.h): n*m per DP pass of the engine, divided by the lanes of the lockstep kernels
+    double cost(int n, int m) const;
+
+private:
+    AlignerConfig cfg;
+};
+
+
+//Engines: X[0...n) against Y[0...m), scratch from arena, released before returning
+
+//NWScore_row: last line of score matrix into Lastline[0...m];
+//with reversed=true both sequences are read backwards
+void NWScore_row(const char* X, int n, const char* Y, int m, bool reversed, const Scoring& sc, int* Lastline);
+
+//NeedlemanWunsch_into: appends the alignment to A_1/A_2 from position len, returns the score;
+//with optimal, the number of co-optimal alignments goes there, and with list up to
+//list->limit of them (the returned one first) are appended to it, out of the same matrix
+int NeedlemanWunsch_into(const char* X, int n, const char* Y, int m, const Scoring& sc, Arena& arena,
+                         char* A_1, char* A_2, int& len, double* optimal = NULL, CoOptimalList* list = NULL);
+
+//Hirschberg_into: appends the alignment to A_1/A_2 from position len;
+//A_1 and A_2 must hold n+m characters. On a ThreadPool worker, large splits run in parallel
+void Hirschberg_into(const char* X, int n, const char* Y, int m, const Scoring& sc, Arena& arena,
+                     char* A_1, char* A_2, int& len);
+
+//Checkpoint_into: appends the alignment to A_1/A_2 from position len, returns the score;
+//the alignment is the one NeedlemanWunsch_into returns. Keeps every sqrt(n)-th row of the
+//forward fill, then recomputes one strip of sqrt(n) rows at a time with its steps. With
+//optimal, the number of co-optimal alignments goes there (left as it is when scores too
+//large for the byte checkpoints send the pair to Hirschberg)
+int Checkpoint_into(const char* X, int n, const char* Y, int m, const Scoring& sc, Arena& arena,
+                    char* A_1, char* A_2, int& len, double* optimal = NULL);
+
+//checkpoint_stride: rows between two checkpoints of Checkpoint_into, ceil(sqrt(n))
+inline int checkpoint_stride(int n)
+{
+    int stride = 1;
+    while ((long)stride * stride < n) stride++;
+    return stride;
+}
+
+//checkpoint_bytes: scratch of Checkpoint_into for an n x m pair, checkpoints plus strip
+inline double checkpoint_bytes(int n, int m)
+{
+    const int stride = checkpoint_stride(n);
+    return (double)((n + stride - 1) / stride + stride) * (m + 1);
+}
+
+//argmax_split: returns position of max element of L[j] + R[m-j]
+int argmax_split(const int* L, const int* R, int m);
+
+//alignment_score: score of an alignment of length len
+int alignment_score(const char* A_1, const char* A_2, int len, const Scoring& sc);
+
+
+//String API with the default scoring, scratch from thread_arena()
+
+//NWScore: return last line of score matrix
+std::vector<int> NWScore(const std::string& X, const std::string& Y);
+
+//NeedlemanWunsch: returns the alignment pair with standard algorithm
+std::pair < std::string, std::string > NeedlemanWunsch(const std::string& X, const std::string& Y);
+
+//Checkpoint: the NeedlemanWunsch alignment in O(m sqrt(n)) memory
+std::pair< std::string, std::string > Checkpoint(const std::string& X, const std::string& Y);
+
+//CoOptimal: up to limit optimal alignments, the NeedlemanWunsch one first, by a depth-first
+//traceback over every tied move of its matrix (diagonal, then up, then left)
+std::vector< std::pair<std::string, std::string> > CoOptimal(const std::string& X, const std::string& Y, int limit);
+
+//Hirschberg: main algorithm; returns alignments-pair space-efficiently
+std::pair< std::string, std::string > Hirschberg(const std::string& X, const std::string& Y);
+
+#endif //ALIGNMENT_H
@@ -0,0 +1,161 @@
+/*
+ * AlignmentC: C ABI over the Aligner, see AlignmentC.h
+ *
+ * The opaque handles wrap the C++ objects; exceptions (a workspace that cannot grow)
+ * are turned into return codes before they reach the caller.
+ *
+ */
+
+#include <new>
+
+#include "Alignment.h"
+#include "AlignmentC.h"
+#include "Extend.h"
+
+struct aln_aligner
+{
+    Aligner aligner;
+    explicit aln_aligner(const AlignerConfig& config) : aligner(config) {}
+};
+
+struct aln_workspace
+{
+    Arena arena;
+};
+
+//Useful tools
+static void copy_result(const AlignResult& r, aln_result* out);
+
+
+int aln_version(void)
+{
+    return ALIGNMENT_API_VERSION;
+}
+
+void aln_default_config(aln_config* config)
+{
+    if (!config) return;
+    const AlignerConfig d = default_config();
+    config->match = d.scoring.match;
+    config->mismatch = d.scoring.mismatch;
+    config->gap = d.scoring.gap;
+    config->mode = d.mode;
+    config->engine = d.engine;
+    config->ties = d.ties;
+    config->count_optimal = d.count_optimal;
+}
+
+int aln_aligner_new(const aln_config* config, aln_aligner** aligner)
+{
+    if (!config || !aligner) return ALN_EINVAL;
+    if (config->mode != ALN_MODE_ALIGN && config->mode != ALN_MODE_SCORE) return ALN_EINVAL;
+    if (config->engine < ALN_ENGINE_AUTO || config->engine > ALN_ENGINE_CHECKPOINT) return ALN_EINVAL;
+    if (config->ties != ALN_TIES_LEFT && config->ties != ALN_TIES_RIGHT) return ALN_EINVAL;
+
+    AlignerConfig c;
+    c.scoring.match = config->match;
+    c.scoring.mismatch = config->mismatch;
+    c.scoring.gap = config->gap;
+    c.mode = static_cast<AlignMode>(config->mode);
+    c.engine = static_cast<AlignEngine>(config->engine);
+    c.ties = static_cast<TieBreak>(config->ties);
+    c.count_optimal = config->count_optimal != 0;
+
+    *aligner = new (std::nothrow) aln_aligner(c);
+    return *aligner ? ALN_OK : ALN_ENOMEM;
+}
+
+void aln_aligner_free(aln_aligner* aligner)
+{
+    delete aligner;
+}
+
+int aln_workspace_new(aln_workspace** workspace)
+{
+    if (!workspace) return ALN_EINVAL;
+    *workspace = new (std::nothrow) aln_workspace;
+    return *workspace ? ALN_OK : ALN_ENOMEM;
+}
+
+void aln_workspace_free(aln_workspace* workspace)
+{
+    delete workspace;
+}
+
+int aln_align(const aln_aligner* aligner, aln_workspace* workspace,
+              const char* X, int n, const char* Y, int m, aln_result* result)
+{
+    if (!aligner || !workspace || !result || n < 0 || m < 0) return ALN_EINVAL;
+    if ((n > 0 && !X) || (m > 0 && !Y)) return ALN_EINVAL;
+    try
+    {
+        copy_result(aligner->aligner.align(X, n, Y, m, workspace->arena), result);
+    }
+    catch (const std::bad_alloc&)
+    {
+        return ALN_ENOMEM;
+    }
+    return ALN_OK;
+}
+
+int aln_align_batch(const aln_aligner* aligner, aln_workspace* workspace,
+                    const aln_pair* pairs, int count, aln_result* results)
+{
+    if (!aligner || !workspace || count < 0) return ALN_EINVAL;
+    if (count == 0) return ALN_OK;
+    if (!pairs || !results) return ALN_EINVAL;
+    for (int k=0; k<count; k++)
+    {
+        const aln_pair& p = pairs[k];
+        if (p.n < 0 || p.m < 0 || (p.n > 0 && !p.X) || (p.m > 0 && !p.Y)) return ALN_EINVAL;
+    }
+
+    //aln_pair / aln_result mirror BatchPair / AlignResult, so no copy is needed
+    static_assert(sizeof(aln_pair) == sizeof(BatchPair), "aln_pair must mirror BatchPair");
+    static_assert(sizeof(aln_result) == sizeof(AlignResult), "aln_result must mirror AlignResult");
+    try
+    {
+        aligner->aligner.align_batch(reinterpret_cast<const BatchPair*>(pairs), count, workspace->arena,
+                                     reinterpret_cast<AlignResult*>(results));
+    }
+    catch (const std::bad_alloc&)
+    {
+        return ALN_ENOMEM;
+    }
+    return ALN_OK;
+}
+
+int aln_extend(const aln_aligner* aligner, aln_workspace* workspace,
+               const char* X, int n, const char* Y, int m, int reversed, int xdrop, int zdrop,
+               aln_extension* extension)
+{
+    if (!aligner || !workspace || !extension || n < 0 || m < 0 || xdrop < 0) return ALN_EINVAL;
+    if ((n > 0 && !X) || (m > 0 && !Y)) return ALN_EINVAL;
+    try
+    {
+        workspace->arena.reset();
+        const Extension e = xdrop_extend(X, n, Y, m, reversed != 0, aligner->aligner.config().scoring,
+                                         xdrop, zdrop, workspace->arena);
+        extension->score = e.score;
+        extension->x_len = e.x_len;
+        extension->y_len = e.y_len;
+        extension->cigar = e.cigar;
+        extension->cigar_len = e.cigar_len;
+    }
+    catch (const std::bad_alloc&)
+    {
+        return ALN_ENOMEM;
+    }
+    return ALN_OK;
+}
+
+
+//Functions
+static void copy_result(const AlignResult& r, aln_result* out)
+{
+    out->score = r.score;
+    out->length = r.length;
+    out->A_1 = r.A_1;
+    out->A_2 = r.A_2;
+    out->optimal = r.optimal;
+}
@@ -0,0 +1,117 @@
+/*
+ * AlignmentC: C ABI of the alignment library, for in-process use from C, Python (ctypes/cffi)
+ * or Rust (extern "C") without spawning the command line programs
+ *
+ * Handles are opaque; every function returns ALN_OK or a negative ALN_E* code and
+ * never throws or exits. Results point into the workspace and stay valid until the
+ * next call that uses it. A workspace must not be shared between threads; an aligner can.
+ *
+ * Usage:
+ *   aln_config config;
+ *   aln_default_config(&config);
+ *   aln_aligner* aligner;  aln_aligner_new(&config, &aligner);
+ *   aln_workspace* ws;     aln_workspace_new(&ws);
+ *   aln_result r;          aln_align(aligner, ws, X, n, Y, m, &r);
+ *   ...
+ *   aln_workspace_free(ws);  aln_aligner_free(aligner);
+ *
+ */
+
+#ifndef ALIGNMENT_C_H
+#define ALIGNMENT_C_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//Return codes
+#define ALN_OK 0
+#define ALN_EINVAL -1           //NULL handle or pointer, negative length, unknown mode, engine or tie policy
+#define ALN_ENOMEM -2           //workspace could not grow
+
+//Values of aln_config.mode, aln_config.engine and aln_config.ties, same as AlignMode / AlignEngine / TieBreak
+#define ALN_MODE_ALIGN 0
+#define ALN_MODE_SCORE 1
+#define ALN_ENGINE_AUTO 0
+#define ALN_ENGINE_NEEDLEMAN_WUNSCH 1
+#define ALN_ENGINE_HIRSCHBERG 2
+#define ALN_ENGINE_SEED_EXTEND 3
+#define ALN_ENGINE_FOUR_RUSSIANS 4
+#define ALN_ENGINE_CHECKPOINT 5
+#define ALN_TIES_LEFT 0
+#define ALN_TIES_RIGHT 1
+
+typedef struct aln_aligner aln_aligner;
+typedef struct aln_workspace aln_workspace;
+
+typedef struct aln_config
+{
+    int match;
+    int mismatch;
+    int gap;
+    int mode;
+    int engine;
+    int ties;
+    int count_optimal;      //non-zero: aln_result.optimal counted (AlignerConfig::count_optimal)
+} aln_config;
+
+typedef struct aln_pair
+{
+    const char* X;
+    int n;
+    const char* Y;
+    int m;
+} aln_pair;
+
+//aln_result: A_1/A_2 hold length characters (not terminated), NULL in ALN_MODE_SCORE;
+//optimal: number of co-optimal alignments when counted, 0 otherwise
+typedef struct aln_result
+{
+    int score;
+    int length;
+    const char* A_1;
+    const char* A_2;
+    double optimal;
+} aln_result;
+
+//aln_extension: best X-drop extension; cigar holds cigar_len characters (not terminated)
+typedef struct aln_extension
+{
+    int score;
+    int x_len;
+    int y_len;
+    const char* cigar;
+    int cigar_len;
+} aln_extension;
+
+//aln_version: ALIGNMENT_API_VERSION the library was built with
+int aln_version(void);
+
+//aln_default_config: default scoring, ALN_MODE_ALIGN, ALN_ENGINE_AUTO, ALN_TIES_LEFT, no counting
+void aln_default_config(aln_config* config);
+
+int aln_aligner_new(const aln_config* config, aln_aligner** aligner);
+void aln_aligner_free(aln_aligner* aligner);
+
+int aln_workspace_new(aln_workspace** workspace);
+void aln_workspace_free(aln_workspace* workspace);
+
+//aln_align: one pair
+int aln_align(const aln_aligner* aligner, aln_workspace* workspace,
+              const char* X, int n, const char* Y, int m, aln_result* result);
+
+//aln_align_batch: count pairs, results[k] for pairs[k]
+int aln_align_batch(const aln_aligner* aligner, aln_workspace* workspace,
+                    const aln_pair* pairs, int count, aln_result* results);
+
+//aln_extend: X-drop / Z-drop extension of X against Y from their start (their end when
+//reversed is non-zero), with the aligner's scoring; zdrop <= 0 disables Z-drop (Extend.h)
+int aln_extend(const aln_aligner* aligner, aln_workspace* workspace,
+               const char* X, int n, const char* Y, int m, int reversed, int xdrop, int zdrop,
+               aln_extension* extension);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //ALIGNMENT_C_H
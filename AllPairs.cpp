@@ -0,0 +1,181 @@
+/*
+ * AllPairs: all-vs-all scores in cache-sized tiles, see AllPairs.h
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+
+#include "AllPairs.h"
+#include "Alignment.h"
+#include "Stats.h"
+
+//Useful tools
+static void score_tile(const std::vector<std::string>& sequences, const Aligner& aligner, AllPairsTile tile,
+                       const std::function<void(const AllPairsTile&)>& sink);
+
+
+void all_pairs(const std::vector<std::string>& sequences, const Scoring& sc, ThreadPool& pool,
+               const std::function<void(const AllPairsTile&)>& sink)
+{
+    const int N = sequences.size();
+    AlignerConfig config = default_config();
+    config.scoring = sc;
+    config.mode = MODE_SCORE;
+    const Aligner aligner(config);
+
+    //STEP 1: blocks of consecutive sequences, at least one each; small sets are cut
+    //finer, so that there are a few tiles per worker
+    std::size_t total = 0;
+    for (int k=0; k<N; k++)
+    {
+        total += sequences[k].length();
+    }
+    const std::size_t min_blocks = (std::size_t)std::ceil(std::sqrt(8.0 * pool.size()));
+    const std::size_t block_residues = std::min<std::size_t>(ALLPAIRS_TILE_RESIDUES, total / min_blocks + 1);
+    std::vector<int> starts;
+    std::size_t residues = 0;
+    for (int k=0; k<N; k++)
+    {
+        if (k == 0 || residues + sequences[k].length() > block_residues)
+        {
+            starts.push_back(k);
+            residues = 0;
+        }
+        residues += sequences[k].length();
+    }
+    starts.push_back(N);
+
+    //STEP 2: tiles of the upper triangle, row block by row block
+    const int blocks = starts.size() - 1;
+    for (int b=0; b<blocks; b++)
+    {
+        for (int c=b; c<blocks; c++)
+        {
+            const AllPairsTile tile = { starts[b], starts[b+1], starts[c], starts[c+1], NULL };
+            pool.submit([&sequences, &aligner, &sink, tile]
+            {
+                score_tile(sequences, aligner, tile, sink);
+            });
+        }
+    }
+    pool.wait();
+}
+
+
+std::vector<int> all_pairs_scores(const std::vector<std::string>& sequences, const Scoring& sc, ThreadPool& pool)
+{
+    const int N = sequences.size();
+    std::vector<int> scores((std::size_t)N*(N+1)/2);
+    all_pairs(sequences, sc, pool, [&scores](const AllPairsTile& tile)
+    {
+        const int* s = tile.scores;
+        for (int j=tile.j0; j<tile.j1; j++)
+        {
+            for (int i=tile.i0; i<tile.i1 && i<=j; i++)
+            {
+                scores[triangle_index(i, j)] = *s++;
+            }
+        }
+    });
+    return scores;
+}
+
+
+void write_score_matrix(std::ostream& out, const std::vector<int>& scores, int N, int layout)
+{
+    const uint32_t header[4] = { ALLPAIRS_MAGIC, ALLPAIRS_VERSION, (uint32_t)N, (uint32_t)layout };
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    if (layout == ALLPAIRS_CONDENSED)
+    {
+        out.write(reinterpret_cast<const char*>(scores.data()), scores.size() * sizeof(int32_t));
+        return;
+    }
+
+    std::vector<int32_t> row(N);
+    for (int i=0; i<N; i++)
+    {
+        for (int j=0; j<N; j++)
+        {
+            row[j] = i <= j ? scores[triangle_index(i, j)] : scores[triangle_index(j, i)];
+        }
+        out.write(reinterpret_cast<const char*>(row.data()), N * sizeof(int32_t));
+    }
+}
+
+void write_phylip(std::ostream& out, const std::vector<std::string>& names, const std::vector<std::string>& sequences,
+                  const std::vector<int>& scores, const Scoring& sc)
+{
+    const int N = sequences.size();
+    out << N << '\n' << std::fixed << std::setprecision(6);
+    for (int i=0; i<N; i++)
+    {
+        out << std::left << std::setw(10) << names[i].substr(0, 10);
+        for (int j=0; j<N; j++)
+        {
+            const int score = i <= j ? scores[triangle_index(i, j)] : scores[triangle_index(j, i)];
+            const float d = i == j ? 0.0f : pair_distance(score, sequences[i].length(), sequences[j].length(), sc);
+            out << ' ' << d;
+        }
+        out << '\n';
+    }
+}
+
+
+//Functions
+//score_tile: copies both blocks into the worker's buffer, scores their pairs and hands them to sink
+static void score_tile(const std::vector<std::string>& sequences, const Aligner& aligner, AllPairsTile tile,
+                       const std::function<void(const AllPairsTile&)>& sink)
+{
+    //kept by the worker between tiles, first touched (and so placed) by it
+    thread_local std::vector<char> local;
+    thread_local std::vector<std::size_t> offset;
+    thread_local std::vector<BatchPair> pairs;
+    thread_local std::vector<AlignResult> results;
+    thread_local std::vector<int> scores;
+
+    //STEP 1: local copies, the column block only when it differs from the row block
+    const bool diagonal = tile.i0 == tile.j0;
+    const int count = (tile.i1 - tile.i0) + (diagonal ? 0 : tile.j1 - tile.j0);
+    offset.resize(count + 1);
+    offset[0] = 0;
+    for (int k=0; k<count; k++)
+    {
+        const int s = k < tile.i1 - tile.i0 ? tile.i0 + k : tile.j0 + k - (tile.i1 - tile.i0);
+        offset[k+1] = offset[k] + sequences[s].length();
+    }
+    local.resize(offset[count]);
+    for (int k=0; k<count; k++)
+    {
+        const int s = k < tile.i1 - tile.i0 ? tile.i0 + k : tile.j0 + k - (tile.i1 - tile.i0);
+        std::memcpy(local.data() + offset[k], sequences[s].data(), sequences[s].length());
+    }
+    const int column_base = diagonal ? 0 : tile.i1 - tile.i0;
+
+    //STEP 2: pairs by column then row, the layout of AllPairsTile
+    pairs.clear();
+    for (int j=tile.j0; j<tile.j1; j++)
+    {
+        const int cj = column_base + j - tile.j0;
+        for (int i=tile.i0; i<tile.i1 && i<=j; i++)
+        {
+            const int ci = i - tile.i0;
+            const BatchPair p = { local.data() + offset[ci], (int)(offset[ci+1] - offset[ci]),
+                                  local.data() + offset[cj], (int)(offset[cj+1] - offset[cj]) };
+            pairs.push_back(p);
+        }
+    }
+    results.resize(pairs.size());
+    aligner.align_batch(pairs.data(), pairs.size(), thread_arena(), results.data());
+    stats_record_arena(thread_arena());
+
+    scores.resize(pairs.size());
+    for (std::size_t k=0; k<pairs.size(); k++)
+    {
+        scores[k] = results[k].score;
+    }
+    tile.scores = scores.data();
+    sink(tile);
+}
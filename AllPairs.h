@@ -0,0 +1,81 @@
+/*
+ * AllPairs: scores of every pair of a set of sequences, for clustering and guide trees
+ *
+ * The sequences are cut into blocks of consecutive sequences holding about
+ * ALLPAIRS_TILE_RESIDUES residues, or fewer when the set is too small to give every
+ * worker a few tiles. The upper triangle of the N x N matrix is cut into tiles, one for
+ * each pair of blocks. A tile is one ThreadPool task: its worker copies
+ * both blocks into a buffer of its own, so they stay in cache for the whole tile and,
+ * on a NUMA machine, sit in the worker's local memory (first touch). It then scores
+ * the tile's pairs with the score-only Aligner::align_batch, which uses the lockstep
+ * SIMD kernels for short sequences. Tiles are queued row by row, so workers started
+ * together share the same row block.
+ *
+ * Results reach the caller one tile at a time through a sink called on the worker;
+ * different tiles never write the same pair. Self scores (i = j) are part of the
+ * diagonal tiles.
+ *
+ * Usage:
+ *   ThreadPool pool(threads);
+ *   std::vector<int> scores = all_pairs_scores(sequences, sc, pool);   //i <= j at triangle_index(i, j)
+ *   write_score_matrix(out, scores, N, dense);
+ *
+ */
+
+#ifndef ALL_PAIRS_H
+#define ALL_PAIRS_H
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Scoring.h"
+#include "ThreadPool.h"
+
+//Residues of one block: a tile copies two blocks (about 128 KB), which fit in a core's L2
+#define ALLPAIRS_TILE_RESIDUES (1 << 16)
+
+//Binary matrix files: "ALNM", then version, N and layout as uint32, then int32 scores
+#define ALLPAIRS_MAGIC 0x4d4e4c41u
+#define ALLPAIRS_VERSION 1
+#define ALLPAIRS_DENSE 0            //N x N, row by row
+#define ALLPAIRS_CONDENSED 1        //pairs i <= j at triangle_index(i, j)
+
+//AllPairsTile: scores of the pairs (i, j) with i in [i0...i1), j in [j0...j1) and i <= j,
+//listed by j then i
+struct AllPairsTile
+{
+    int i0, i1;
+    int j0, j1;
+    const int* scores;
+};
+
+//triangle_index: position of the pair i <= j in the upper triangle with its diagonal
+inline std::size_t triangle_index(int i, int j)
+{
+    return (std::size_t)j*(j+1)/2 + i;
+}
+
+//all_pairs: calls sink once per tile, on the worker that scored it
+void all_pairs(const std::vector<std::string>& sequences, const Scoring& sc, ThreadPool& pool,
+               const std::function<void(const AllPairsTile&)>& sink);
+
+//all_pairs_scores: the whole upper triangle, self scores included
+std::vector<int> all_pairs_scores(const std::vector<std::string>& sequences, const Scoring& sc, ThreadPool& pool);
+
+//pair_distance: how far score falls below the best score of the two lengths
+//(completion_bound), per residue of the pair
+inline float pair_distance(int score, int n, int m, const Scoring& sc)
+{
+    return n + m > 0 ? (float)(completion_bound(n, m, sc) - score) / (n + m) : 0.0f;
+}
+
+//write_score_matrix: binary file of N sequences' scores, ALLPAIRS_DENSE or ALLPAIRS_CONDENSED
+void write_score_matrix(std::ostream& out, const std::vector<int>& scores, int N, int layout);
+
+//write_phylip: square PHYLIP distance matrix (pair_distance), names cut to 10 characters
+void write_phylip(std::ostream& out, const std::vector<std::string>& names, const std::vector<std::string>& sequences,
+                  const std::vector<int>& scores, const Scoring& sc);
+
+#endif //ALL_PAIRS_H
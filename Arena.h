@@ -0,0 +1,187 @@
+/*
+ * Arena: bump allocator for per-alignment scratch buffers
+ *
+ * DP rows, direction matrices and output buffers of one alignment are carved out
+ * of one contiguous block and released all together with reset(), which is O(1).
+ * When an alignment does not fit, extra blocks are chained; the next reset()
+ * merges them into a single block large enough for that alignment, so after the
+ * largest pair of a batch has been seen no further heap calls are made.
+ *
+ * Usage:
+ * - Arena& arena = thread_arena();        //one arena per thread
+ * - int* row = arena.alloc<int>(m+1);     //64-byte aligned, uninitialised
+ * - ArenaMark mark = arena.mark();        //scoped scratch inside a recursion
+ *   ...
+ *   arena.rewind(mark);
+ * - arena.reset();                        //between two alignments
+ * - arena.shrink();                       //back to one default block, e.g. after std::bad_alloc
+ *
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+#define ARENA_ALIGNMENT 64
+#define ARENA_DEFAULT_BLOCK (1 << 20)
+
+//Position inside the arena, used to release scratch allocated after it
+struct ArenaMark
+{
+    std::size_t block;
+    std::size_t offset;
+};
+
+class Arena
+{
+public:
+    explicit Arena(std::size_t initial_bytes = ARENA_DEFAULT_BLOCK)
+    {
+        add_block(initial_bytes);
+    }
+
+    ~Arena()
+    {
+        for (std::size_t b=0; b<blocks.size(); b++)
+        {
+            release(blocks[b]);
+        }
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    //alloc: uninitialised storage for count objects of type T
+    template <typename T>
+    T* alloc(std::size_t count)
+    {
+        return static_cast<T*>(alloc_bytes(count * sizeof(T)));
+    }
+
+    void* alloc_bytes(std::size_t bytes)
+    {
+        bytes = round_up(bytes);
+        while (current < blocks.size() && offset + bytes > blocks[current].size)
+        {
+            current++;
+            offset = 0;
+        }
+        if (current == blocks.size())
+        {
+            const std::size_t last = blocks.back().size;
+            add_block(bytes > 2*last ? bytes : 2*last);
+        }
+        void* p = blocks[current].data + offset;
+        offset += bytes;
+        if (in_use() > peak) peak = in_use();
+        return p;
+    }
+
+    ArenaMark mark() const
+    {
+        ArenaMark m = { current, offset };
+        return m;
+    }
+
+    //rewind: release everything allocated after mark
+    void rewind(const ArenaMark& m)
+    {
+        current = m.block;
+        offset = m.offset;
+    }
+
+    //reset: release everything; chained blocks are merged into one for the next alignment
+    void reset()
+    {
+        if (blocks.size() > 1)
+        {
+            std::size_t total = 0;
+            for (std::size_t b=0; b<blocks.size(); b++)
+            {
+                total += blocks[b].size;
+                release(blocks[b]);
+            }
+            blocks.clear();
+            add_block(total);
+        }
+        current = 0;
+        offset = 0;
+    }
+
+    //shrink: release every block and start over with one of bytes; after a failed
+    //allocation, when merging the chained blocks in reset() could fail again
+    void shrink(std::size_t bytes = ARENA_DEFAULT_BLOCK)
+    {
+        for (std::size_t b=0; b<blocks.size(); b++)
+        {
+            release(blocks[b]);
+        }
+        blocks.clear();
+        current = 0;
+        offset = 0;
+        add_block(bytes);
+    }
+
+    //Bytes currently handed out
+    std::size_t in_use() const
+    {
+        std::size_t used = offset;
+        for (std::size_t b=0; b<current; b++) used += blocks[b].size;
+        return used;
+    }
+
+    //Largest in_use() seen since construction
+    std::size_t high_water() const { return peak; }
+
+    //Number of blocks requested from the heap since construction
+    std::size_t heap_allocations() const { return heap_calls; }
+
+    //Bytes requested from the heap since construction
+    std::size_t heap_bytes() const { return heap_total; }
+
+private:
+    struct Block
+    {
+        char* data;
+        std::size_t size;
+    };
+
+    static std::size_t round_up(std::size_t bytes)
+    {
+        return (bytes + ARENA_ALIGNMENT - 1) & ~static_cast<std::size_t>(ARENA_ALIGNMENT - 1);
+    }
+
+    void add_block(std::size_t bytes)
+    {
+        Block b;
+        b.size = round_up(bytes);
+        b.data = static_cast<char*>(::operator new(b.size, std::align_val_t(ARENA_ALIGNMENT)));
+        blocks.push_back(b);
+        heap_calls++;
+        heap_total += b.size;
+    }
+
+    static void release(Block& b)
+    {
+        ::operator delete(b.data, std::align_val_t(ARENA_ALIGNMENT));
+    }
+
+    std::vector<Block> blocks;
+    std::size_t current = 0;
+    std::size_t offset = 0;
+    std::size_t peak = 0;
+    std::size_t heap_calls = 0;
+    std::size_t heap_total = 0;
+};
+
+//thread_arena: the calling thread's scratch arena
+inline Arena& thread_arena()
+{
+    thread_local Arena arena;
+    return arena;
+}
+
+#endif //ARENA_H
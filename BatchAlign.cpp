@@ -0,0 +1,564 @@
+/*
+ * Inter-sequence SIMD kernels, see BatchAlign.h
+ *
+ * Every kernel is a template over the lane type T. Narrow lanes track the lowest and
+ * highest cell of each lane; a lane that left the range where one more addition
+ * could wrap is reported as saturated and rerun by the caller with wider lanes, so
+ * scores always match the int implementation.
+ *
+ * Cells of a lane past the end of its pair (padding) get zero penalties: they are
+ * the maximum of their neighbours and stay inside the range of the real cells, so
+ * they never raise a false saturation.
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#include "BatchAlign.h"
+#include "Stats.h"
+
+//Direction bits of the lockstep traceback, same preference as NeedlemanWunsch()
+#define DIR_DIAG 1
+#define DIR_UP 2
+
+template <typename T>
+struct SimdVec
+{
+    typedef T type __attribute__((vector_size(SIMD_BYTES)));
+    static const int lanes = SIMD_BYTES / sizeof(T);
+};
+
+//Index of the T kernel in BatchQuery
+template <typename T>
+static inline int width_index()
+{
+    return sizeof(T) == 1 ? 0 : (sizeof(T) == 2 ? 1 : 2);
+}
+
+//Lane-wise maximum and minimum
+template <typename V>
+static inline V vmax(V a, V b)
+{
+    return a > b ? a : b;
+}
+
+template <typename V>
+static inline V vmin(V a, V b)
+{
+    return a < b ? a : b;
+}
+
+//Largest change of a cell in one step of the recurrence
+static int max_step(const Scoring& sc)
+{
+    int step = std::abs(sc.gap);
+    if (std::abs(sc.match) > step) step = std::abs(sc.match);
+    if (std::abs(sc.mismatch) > step) step = std::abs(sc.mismatch);
+    return step;
+}
+
+//Cells of a T lane are safe in [safe_lo, safe_hi]: one more step cannot wrap
+template <typename T>
+static int safe_lo(const Scoring& sc)
+{
+    return (int)std::numeric_limits<T>::min() + max_step(sc);
+}
+
+template <typename T>
+static int safe_hi(const Scoring& sc)
+{
+    return (int)std::numeric_limits<T>::max() - max_step(sc);
+}
+
+//cell_bounds: expected range of the cells of p (corners, the all-mismatch and the
+//all-match diagonal), used to centre the lane and to skip lanes too narrow for the pair
+static void cell_bounds(const BatchPair& p, const Scoring& sc, int& lo, int& hi)
+{
+    const int d = p.n < p.m ? p.n : p.m;
+    const int e = p.n < p.m ? p.m - p.n : p.n - p.m;
+    const int mismatch_diag = sc.mismatch > 2*sc.gap ? sc.mismatch : 2*sc.gap;
+    lo = 0;
+    hi = 0;
+    const int corners[4] = { p.n*sc.gap, p.m*sc.gap, d*mismatch_diag + e*sc.gap, d*sc.match };
+    for (int c=0; c<4; c++)
+    {
+        if (corners[c] < lo) lo = corners[c];
+        if (corners[c] > hi) hi = corners[c];
+    }
+}
+
+//may_fit: false when the pair surely saturates T lanes
+template <typename T>
+static bool may_fit(const BatchPair& p, const Scoring& sc)
+{
+    if (sizeof(T) >= sizeof(int)) return true;
+    int lo, hi;
+    cell_bounds(p, sc, lo, hi);
+    return hi - lo <= safe_hi<T>(sc) - safe_lo<T>(sc);
+}
+
+//fill_query: Q broadcast to every T lane, and the matching all-ones column mask
+template <typename T>
+static void fill_query(BatchQuery& query, Arena& storage)
+{
+    typedef typename SimdVec<T>::type V;
+    V* yv = storage.alloc<V>(query.m);
+    V* colmask = storage.alloc<V>(query.m);
+    for (int j=0; j<query.m; j++)
+    {
+        yv[j] = V{} + (T)(unsigned char)query.Q[j];
+        colmask[j] = V{} + (T)-1;
+    }
+    query.yv[width_index<T>()] = yv;
+    query.colmask[width_index<T>()] = colmask;
+}
+
+BatchQuery::BatchQuery(const char* Q, int m) : Q(Q), m(m), storage(3 * 2 * (std::size_t)SIMD_BYTES * (m+1))
+{
+    fill_query<int8_t>(*this, storage);
+    fill_query<int16_t>(*this, storage);
+    fill_query<int32_t>(*this, storage);
+}
+
+//Lockstep: vectors shared by the score and traceback kernels of one group of pairs
+template <typename T>
+struct Lockstep
+{
+    typedef typename SimdVec<T>::type V;
+    int maxn;
+    int maxm;
+    V* xv;          //xv[i]: X_k[i] of every lane
+    V* yv;          //yv[j]: Y_k[j] of every lane
+    V* rowmask;     //rowmask[i]: all ones in lanes with i < n_k
+    V* colmask;     //colmask[j]: all ones in lanes with j < m_k
+    V bias;         //value of cell (0,0), centres the lane on the pair's cell range
+};
+
+//prepare: transposed sequences and masks of one group; Y comes from query when given
+template <typename T>
+static void prepare(const BatchPair* pairs, int count, const Scoring& sc, Arena& arena, Lockstep<T>& ls,
+                    const BatchQuery* query)
+{
+    typedef typename SimdVec<T>::type V;
+    const int L = SimdVec<T>::lanes;
+
+    ls.maxn = 0;
+    ls.maxm = 0;
+    for (int k=0; k<count; k++)
+    {
+        if (pairs[k].n > ls.maxn) ls.maxn = pairs[k].n;
+        if (pairs[k].m > ls.maxm) ls.maxm = pairs[k].m;
+    }
+
+    ls.xv = arena.alloc<V>(ls.maxn);
+    ls.rowmask = arena.alloc<V>(ls.maxn);
+    T* x = reinterpret_cast<T*>(ls.xv);
+    T* rm = reinterpret_cast<T*>(ls.rowmask);
+    std::memset(x, 0, sizeof(V) * ls.maxn);
+    std::memset(rm, 0, sizeof(V) * ls.maxn);
+
+    T* y = NULL;
+    T* cm = NULL;
+    if (query)
+    {
+        ls.yv = static_cast<V*>(query->yv[width_index<T>()]);
+        ls.colmask = static_cast<V*>(query->colmask[width_index<T>()]);
+    }
+    else
+    {
+        ls.yv = arena.alloc<V>(ls.maxm);
+        ls.colmask = arena.alloc<V>(ls.maxm);
+        y = reinterpret_cast<T*>(ls.yv);
+        cm = reinterpret_cast<T*>(ls.colmask);
+        std::memset(y, 0, sizeof(V) * ls.maxm);
+        std::memset(cm, 0, sizeof(V) * ls.maxm);
+    }
+
+    T* b = reinterpret_cast<T*>(&ls.bias);
+    ls.bias = V{};
+    for (int k=0; k<count; k++)
+    {
+        const BatchPair& p = pairs[k];
+        for (int c=0; c<p.n; c++)
+        {
+            x[c*L + k] = (unsigned char)p.X[c];
+            rm[c*L + k] = -1;
+        }
+        for (int c=0; !query && c<p.m; c++)
+        {
+            y[c*L + k] = (unsigned char)p.Y[c];
+            cm[c*L + k] = -1;
+        }
+        if (sizeof(T) < sizeof(int))
+        {
+            int lo, hi;
+            cell_bounds(p, sc, lo, hi);
+            b[k] = (T)(-(lo + hi) / 2);
+        }
+    }
+}
+
+//any_alive: after row i, marks dead the unfinished lanes whose best cell plus the best
+//completion of their remaining rows stays below cutoff, with that bound as score.
+//A lane that may have saturated is kept alive: its cells are not trusted
+template <typename T>
+static bool any_alive(const BatchPair* pairs, int count, const Scoring& sc, const typename SimdVec<T>::type* row,
+                      int maxm, const typename SimdVec<T>::type& low, const typename SimdVec<T>::type& high,
+                      const T* bias, int i, int cutoff, bool* dead, int* scores)
+{
+    typedef typename SimdVec<T>::type V;
+    V top = row[0];
+    for (int j=1; j<=maxm; j++)
+    {
+        top = vmax(top, row[j]);
+    }
+
+    const T* t = reinterpret_cast<const T*>(&top);
+    const T* lo = reinterpret_cast<const T*>(&low);
+    const T* hi = reinterpret_cast<const T*>(&high);
+    bool alive = false;
+    for (int k=0; k<count; k++)
+    {
+        const BatchPair& p = pairs[k];
+        if (p.n <= i || dead[k]) continue;
+        if (sizeof(T) < sizeof(int) && (lo[k] < safe_lo<T>(sc) || hi[k] > safe_hi<T>(sc)))
+        {
+            alive = true;
+            continue;
+        }
+
+        //the remaining rows meet some suffix of Y: its best length is 0, m or n-i
+        const int rest = p.n - i;
+        int completion = completion_bound(rest, 0, sc);
+        if (completion_bound(rest, p.m, sc) > completion) completion = completion_bound(rest, p.m, sc);
+        if (rest < p.m && completion_bound(rest, rest, sc) > completion) completion = completion_bound(rest, rest, sc);
+
+        const int bound = (int)t[k] - bias[k] + completion;
+        if (bound < cutoff)
+        {
+            dead[k] = true;
+            scores[k] = bound;
+        }
+        else alive = true;
+    }
+    return alive;
+}
+
+template <typename T>
+static void lockstep_score(const BatchPair* pairs, int count, const Scoring& sc, Arena& arena,
+                           int* scores, bool* saturated, const BatchQuery* query, int cutoff)
+{
+    typedef typename SimdVec<T>::type V;
+    const int L = SimdVec<T>::lanes;
+    const ArenaMark start = arena.mark();
+
+    StatsTimer fill(&AlignStats::fill_seconds);
+
+    Lockstep<T> ls;
+    prepare<T>(pairs, count, sc, arena, ls, query);
+    const int maxm = ls.maxm;
+
+    const V gap = V{} + (T)sc.gap;
+    const V match = V{} + (T)sc.match;
+    const V mismatch = V{} + (T)sc.mismatch;
+    const T* bias = reinterpret_cast<const T*>(&ls.bias);
+
+    //Step 1: first row penalties, the row is then updated in place
+    V* row = arena.alloc<V>(maxm+1);
+    row[0] = ls.bias;
+    for (int j=1; j<=maxm; j++)
+    {
+        row[j] = row[j-1] + (gap & ls.colmask[j-1]);
+    }
+    V low = row[0], high = row[0];
+    for (int j=1; j<=maxm; j++)
+    {
+        low = vmin(low, row[j]);
+        high = vmax(high, row[j]);
+    }
+
+    for (int k=0; k<count; k++)
+    {
+        if (pairs[k].n == 0) scores[k] = pairs[k].m * sc.gap;
+    }
+
+    //lanes proven unable to reach cutoff
+    bool* dead = arena.alloc<bool>(count);
+    std::memset(dead, 0, count);
+
+    int rows = ls.maxn;
+    for (int i=1; i<=ls.maxn; i++)
+    {
+        const V x = ls.xv[i-1];
+        const V rm = ls.rowmask[i-1];
+        V diag = row[0];
+        row[0] += gap & rm;
+        V left = row[0];
+        low = vmin(low, left);
+        for (int j=1; j<=maxm; j++)
+        {
+            const V mask = rm & ls.colmask[j-1];
+            const V g = gap & mask;
+            const V sub = ((x == ls.yv[j-1]) ? match : mismatch) & mask;
+            const V up = row[j];
+            left = vmax(vmax(left + g, up + g), diag + sub);
+            row[j] = left;
+            diag = up;
+            if (sizeof(T) < sizeof(int))
+            {
+                low = vmin(low, left);
+                high = vmax(high, left);
+            }
+        }
+
+        //read back the lanes whose X ends on this row
+        const T* flat = reinterpret_cast<const T*>(row);
+        for (int k=0; k<count; k++)
+        {
+            if (pairs[k].n == i) scores[k] = (int)flat[pairs[k].m*L + k] - bias[k];
+        }
+
+        if (cutoff != INT_MIN && i % BATCH_BOUND_ROWS == 0 && i < ls.maxn && !any_alive(pairs, count, sc, row, maxm,
+                                                                                        low, high, bias, i, cutoff, dead, scores))
+        {
+            rows = i;
+            break;
+        }
+    }
+
+    const T* lo = reinterpret_cast<const T*>(&low);
+    const T* hi = reinterpret_cast<const T*>(&high);
+    for (int k=0; k<count; k++)
+    {
+        saturated[k] = sizeof(T) < sizeof(int) && !dead[k] && (lo[k] < safe_lo<T>(sc) || hi[k] > safe_hi<T>(sc));
+        if (stats_enabled) thread_stats().cells += (unsigned long long)(pairs[k].n < rows ? pairs[k].n : rows) * pairs[k].m;
+    }
+
+    arena.rewind(start);
+}
+
+template <typename T>
+static void lockstep_align(const BatchPair* pairs, int count, const Scoring& sc, Arena& arena,
+                           int* scores, char** A_1, char** A_2, int* lens, bool* saturated)
+{
+    typedef typename SimdVec<T>::type V;
+    const int L = SimdVec<T>::lanes;
+    const ArenaMark start = arena.mark();
+
+    StatsTimer fill(&AlignStats::fill_seconds);
+    if (stats_enabled)
+    {
+        for (int k=0; k<count; k++) thread_stats().cells += (unsigned long long)pairs[k].n * pairs[k].m;
+    }
+
+    Lockstep<T> ls;
+    prepare<T>(pairs, count, sc, arena, ls, NULL);
+    const int maxn = ls.maxn, maxm = ls.maxm;
+
+    const V gap = V{} + (T)sc.gap;
+    const V match = V{} + (T)sc.match;
+    const V mismatch = V{} + (T)sc.mismatch;
+    const V diag_bit = V{} + (T)DIR_DIAG;
+    const V up_bit = V{} + (T)DIR_UP;
+    const T* bias = reinterpret_cast<const T*>(&ls.bias);
+
+    //STEP 1: score row as in the score-only kernel, plus a direction matrix D[i-1][j-1]
+    V* row = arena.alloc<V>(maxm+1);
+    V* D = arena.alloc<V>((size_t)maxn * maxm);
+    row[0] = ls.bias;
+    for (int j=1; j<=maxm; j++)
+    {
+        row[j] = row[j-1] + (gap & ls.colmask[j-1]);
+    }
+    V low = row[0], high = row[0];
+    for (int j=1; j<=maxm; j++)
+    {
+        low = vmin(low, row[j]);
+        high = vmax(high, row[j]);
+    }
+
+    for (int k=0; k<count; k++)
+    {
+        if (pairs[k].n == 0) scores[k] = pairs[k].m * sc.gap;
+    }
+
+    //STEP 2: lockstep fill
+    for (int i=1; i<=maxn; i++)
+    {
+        const V x = ls.xv[i-1];
+        const V rm = ls.rowmask[i-1];
+        V* Drow = D + (size_t)(i-1) * maxm;
+        V diag = row[0];
+        row[0] += gap & rm;
+        V left = row[0];
+        low = vmin(low, left);
+        for (int j=1; j<=maxm; j++)
+        {
+            const V mask = rm & ls.colmask[j-1];
+            const V g = gap & mask;
+            const V sub = ((x == ls.yv[j-1]) ? match : mismatch) & mask;
+            const V up = row[j];
+            const V from_diag = diag + sub;
+            const V from_up = up + g;
+            const V h = vmax(vmax(left + g, from_up), from_diag);
+            Drow[j-1] = ((h == from_diag) & diag_bit) | ((h == from_up) & up_bit);
+            row[j] = h;
+            left = h;
+            diag = up;
+            if (sizeof(T) < sizeof(int))
+            {
+                low = vmin(low, h);
+                high = vmax(high, h);
+            }
+        }
+
+        const T* flat = reinterpret_cast<const T*>(row);
+        for (int k=0; k<count; k++)
+        {
+            if (pairs[k].n == i) scores[k] = (int)flat[pairs[k].m*L + k] - bias[k];
+        }
+    }
+
+    //STEP 3: scalar traceback of every lane that did not saturate, backwards then reversed in place
+    fill.stop();
+    StatsTimer traceback(&AlignStats::traceback_seconds);
+    const T* lo = reinterpret_cast<const T*>(&low);
+    const T* hi = reinterpret_cast<const T*>(&high);
+    const T* flatD = reinterpret_cast<const T*>(D);
+    for (int k=0; k<count; k++)
+    {
+        saturated[k] = sizeof(T) < sizeof(int) && (lo[k] < safe_lo<T>(sc) || hi[k] > safe_hi<T>(sc));
+        if (saturated[k]) continue;
+
+        const BatchPair& p = pairs[k];
+        char* a1 = A_1[k];
+        char* a2 = A_2[k];
+        int len = 0;
+        int i = p.n, j = p.m;
+        while (i>0 || j>0)
+        {
+            const int d = (i>0 && j>0) ? flatD[((size_t)(i-1)*maxm + (j-1))*L + k] : 0;
+            if (i>0 && j>0 && (d & DIR_DIAG))
+            {
+                a1[len] = p.X[i-1];
+                a2[len] = p.Y[j-1];
+                i--;
+                j--;
+            }
+            else if (i>0 && (j==0 || (d & DIR_UP)))
+            {
+                a1[len] = p.X[i-1];
+                a2[len] = '-';
+                i--;
+            }
+            else
+            {
+                a1[len] = '-';
+                a2[len] = p.Y[j-1];
+                j--;
+            }
+            len++;
+        }
+        for (int t=0; t<len/2; t++)
+        {
+            std::swap(a1[t], a1[len-1-t]);
+            std::swap(a2[t], a2[len-1-t]);
+        }
+        lens[k] = len;
+    }
+
+    arena.rewind(start);
+}
+
+//Pairs waiting for one lane width: indices into the caller's arrays
+struct LaneQueue
+{
+    int* idx;
+    int count;
+};
+
+//run_width: runs the T kernel on the queued pairs, SimdVec<T>::lanes at a time;
+//saturated pairs are appended to wider
+template <typename T>
+static void run_width(const BatchPair* pairs, LaneQueue& queue, LaneQueue& wider, const Scoring& sc,
+                      Arena& arena, int* scores, char** A_1, char** A_2, int* lens, const BatchQuery* query, int cutoff)
+{
+    const int L = SimdVec<T>::lanes;
+    const ArenaMark start = arena.mark();
+    BatchPair* group = arena.alloc<BatchPair>(L);
+    int* group_scores = arena.alloc<int>(L);
+    int* group_lens = arena.alloc<int>(L);
+    char** group_A_1 = arena.alloc<char*>(L);
+    char** group_A_2 = arena.alloc<char*>(L);
+    bool* saturated = arena.alloc<bool>(L);
+
+    for (int first=0; first<queue.count; first+=L)
+    {
+        const int count = queue.count - first < L ? queue.count - first : L;
+        for (int k=0; k<count; k++)
+        {
+            const int q = queue.idx[first+k];
+            group[k] = pairs[q];
+            if (A_1)
+            {
+                group_A_1[k] = A_1[q];
+                group_A_2[k] = A_2[q];
+            }
+        }
+
+        if (A_1) lockstep_align<T>(group, count, sc, arena, group_scores, group_A_1, group_A_2, group_lens, saturated);
+        else lockstep_score<T>(group, count, sc, arena, group_scores, saturated, query, cutoff);
+
+        for (int k=0; k<count; k++)
+        {
+            const int q = queue.idx[first+k];
+            if (saturated[k])
+            {
+                wider.idx[wider.count++] = q;
+                continue;
+            }
+            scores[q] = group_scores[k];
+            if (A_1) lens[q] = group_lens[k];
+        }
+    }
+    queue.count = 0;
+    arena.rewind(start);
+}
+
+//run_promoted: 8-bit lanes first, saturated pairs rerun with 16-bit and then 32-bit lanes
+static void run_promoted(const BatchPair* pairs, int count, const Scoring& sc, Arena& arena,
+                         int* scores, char** A_1, char** A_2, int* lens, const BatchQuery* query, int cutoff)
+{
+    const ArenaMark start = arena.mark();
+    LaneQueue q8 = { arena.alloc<int>(count), 0 };
+    LaneQueue q16 = { arena.alloc<int>(count), 0 };
+    LaneQueue q32 = { arena.alloc<int>(count), 0 };
+    LaneQueue overflow = { arena.alloc<int>(count), 0 };
+
+    for (int k=0; k<count; k++)
+    {
+        if (may_fit<int8_t>(pairs[k], sc)) q8.idx[q8.count++] = k;
+        else if (may_fit<int16_t>(pairs[k], sc)) q16.idx[q16.count++] = k;
+        else q32.idx[q32.count++] = k;
+    }
+
+    run_width<int8_t>(pairs, q8, q16, sc, arena, scores, A_1, A_2, lens, query, cutoff);
+    run_width<int16_t>(pairs, q16, q32, sc, arena, scores, A_1, A_2, lens, query, cutoff);
+    run_width<int32_t>(pairs, q32, overflow, sc, arena, scores, A_1, A_2, lens, query, cutoff);
+
+    arena.rewind(start);
+}
+
+void batch_score(const BatchPair* pairs, int count, const Scoring& sc, Arena& arena, int* scores,
+                 const BatchQuery* query, int cutoff)
+{
+    run_promoted(pairs, count, sc, arena, scores, NULL, NULL, NULL, query, cutoff);
+}
+
+void batch_align(const BatchPair* pairs, int count, const Scoring& sc, Arena& arena,
+                 int* scores, char** A_1, char** A_2, int* lens)
+{
+    run_promoted(pairs, count, sc, arena, scores, A_1, A_2, lens, NULL, INT_MIN);
+}
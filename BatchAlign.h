@@ -0,0 +1,89 @@
+/*
+ * Inter-sequence SIMD: independent pairs aligned in lockstep lanes
+ *
+ * One vector register holds the same DP cell (i,j) of BATCH_LANES different pairs.
+ * Sequences are transposed so that lane k of column i is X_k[i]; shorter pairs are
+ * padded, and since cell (i,j) only depends on cells above and to the left, the
+ * padding never reaches the cells (n_k, m_k) read back for lane k.
+ *
+ * Vectors are GCC/Clang vector extensions sized by the widest instruction set the
+ * build targets (-march=native): 32 lanes of int8 on AVX2, 64 on AVX-512BW.
+ * Pairs are tried on 8-bit lanes first; a lane whose cells leave the 8-bit range
+ * is detected and that pair alone is rerun on 16-bit and then 32-bit lanes, so the
+ * scores are exactly those of the int implementation.
+ *
+ * - batch_score: NWScore recurrence, last cell of each pair; with a BatchQuery every
+ *   pair shares Y, whose broadcast lanes are built once instead of once per group.
+ *   With a cutoff, every BATCH_BOUND_ROWS rows each lane's best cell plus the best
+ *   possible completion is compared with it; a group stops as soon as no lane can
+ *   reach the cutoff any more
+ * - batch_align: score-plus-traceback, same alignment as NeedlemanWunsch()
+ *
+ */
+
+#ifndef BATCH_ALIGN_H
+#define BATCH_ALIGN_H
+
+#include <climits>
+#include <cstdint>
+
+#include "Arena.h"
+#include "Scoring.h"
+
+#if defined(__AVX512BW__)
+#define SIMD_BYTES 64
+#elif defined(__AVX2__)
+#define SIMD_BYTES 32
+#else
+#define SIMD_BYTES 16
+#endif
+
+//Pairs per lockstep call (8-bit lanes)
+#define BATCH_LANES SIMD_BYTES
+
+//Longest sequence sent to the lockstep kernels by the batch front end
+#define BATCH_MAX_LEN 512
+
+//Rows between two score-bound checks of batch_score with a cutoff
+#define BATCH_BOUND_ROWS 16
+
+//BatchPair: one pair of a lockstep batch
+struct BatchPair
+{
+    const char* X;
+    int n;
+    const char* Y;
+    int m;
+};
+
+//BatchQuery: one sequence broadcast to every lane at each lane width, for pairs that all
+//have it as Y (one query against many database records)
+class BatchQuery
+{
+public:
+    BatchQuery(const char* Q, int m);
+
+    BatchQuery(const BatchQuery&) = delete;
+    BatchQuery& operator=(const BatchQuery&) = delete;
+
+    const char* Q;
+    int m;
+    void* yv[3];            //Lockstep yv / colmask of the 8, 16 and 32-bit kernels
+    void* colmask[3];
+
+private:
+    Arena storage;
+};
+
+//batch_score: global alignment scores of count pairs into scores[0...count);
+//with query, every pairs[k].Y must be query->Q. Scores below cutoff are only
+//upper bounds: the pair was stopped once it could not reach cutoff
+void batch_score(const BatchPair* pairs, int count, const Scoring& sc, Arena& arena, int* scores,
+                 const BatchQuery* query = NULL, int cutoff = INT_MIN);
+
+//batch_align: scores and alignments of count pairs;
+//A_1[k]/A_2[k] must hold n_k+m_k characters, lens[k] receives the alignment length
+void batch_align(const BatchPair* pairs, int count, const Scoring& sc, Arena& arena,
+                 int* scores, char** A_1, char** A_2, int* lens);
+
+#endif //BATCH_ALIGN_H
@@ -0,0 +1,361 @@
+/*
+ * Benchmark suite for the alignment engines (Google Benchmark)
+ *
+ * Every engine is run on synthetic pairs swept over:
+ * - length: 100 bp ... 1 Mb (powers of ten)
+ * - identity of Y to X: 60%, 80%, 90%, 100% (substitutions and 1-base indels)
+ * - alphabet: DNA (4 letters) or protein (20 letters)
+ *
+ * Reported counters:
+ * - GCUPS: giga cell updates per second, n*m cells per alignment (per edit for Realign:
+ *   the cells a fresh alignment would compute)
+ * - allocs: heap allocations per alignment (operator new calls)
+ * - peak_RSS_MB: peak resident set size of the process so far
+ *
+ * Usage:
+ * - make bench && ./build/Bench
+ * - --max_len=N caps the sweep (default 100000: one 1 Mb Hirschberg run costs about
+ *   10^12 cells); --max_len=1000000 runs the megabase regime.
+ * - Google Benchmark flags work as usual, e.g. --benchmark_filter=Hirschberg
+ *
+ * Full-matrix NeedlemanWunsch stops at 10 kb, Checkpoint at 100 kb and the lockstep kernels
+ * at BATCH_MAX_LEN, where they leave their working regime. Realign stops at 10 kb too:
+ * building its checkpoints costs two full passes, outside the timing.
+ *
+ */
+
+#include <benchmark/benchmark.h>
+#include <sys/resource.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Alignment.h"
+#include "FourRussians.h"
+#include "Realign.h"
+
+#define NW_MAX_LEN 10000
+#define CHECKPOINT_MAX_LEN 100000
+#define REALIGN_MAX_LEN 10000
+#define REALIGN_STEP 97                 //bases between two edits of a polishing pass
+
+static const char DNA[] = "ACGT";
+static const char PROTEIN[] = "ACDEFGHIKLMNPQRSTVWY";
+
+static long max_len = 100000;
+
+
+//Heap allocation counter
+static std::atomic<long> allocations(0);
+
+void* operator new(std::size_t size)
+{
+    allocations++;
+    void* p = std::malloc(size ? size : 1);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(std::size_t size, std::align_val_t align)
+{
+    allocations++;
+    std::size_t a = static_cast<std::size_t>(align);
+    void* p = std::aligned_alloc(a, (size + a - 1) / a * a);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+
+//random_sequence: len letters of the alphabet
+static std::string random_sequence(int len, const char* alphabet, std::mt19937& rng)
+{
+    const int size = std::strlen(alphabet);
+    std::string s(len, 'A');
+    for (int i=0; i<len; i++)
+    {
+        s[i] = alphabet[rng() % size];
+    }
+    return s;
+}
+
+//mutate: copy of X at the given identity (percent), 80% substitutions, 20% single-base indels
+static std::string mutate(const std::string& X, int identity, const char* alphabet, std::mt19937& rng)
+{
+    const int size = std::strlen(alphabet);
+    std::uniform_int_distribution<int> percent(0, 9999);
+    std::string Y;
+    Y.reserve(X.size() + X.size()/10);
+    for (std::size_t i=0; i<X.size(); i++)
+    {
+        if (percent(rng) >= identity*100)
+        {
+            const int kind = rng() % 10;
+            if (kind < 8) Y += alphabet[(std::strchr(alphabet, X[i]) - alphabet + 1 + rng() % (size-1)) % size];
+            else if (kind == 8) continue;
+            else
+            {
+                Y += X[i];
+                Y += alphabet[rng() % size];
+            }
+        }
+        else
+        {
+            Y += X[i];
+        }
+    }
+    return Y;
+}
+
+//Workload: one pair per (length, identity, alphabet), shared by all engines
+struct Workload
+{
+    std::string X;
+    std::string Y;
+};
+
+static const Workload& workload(int len, int identity, int alphabet)
+{
+    static std::vector<std::pair<long, Workload> > cache;
+    const long key = ((long)len * 1000 + identity) * 2 + alphabet;
+    for (std::size_t c=0; c<cache.size(); c++)
+    {
+        if (cache[c].first == key) return cache[c].second;
+    }
+    std::mt19937 rng(key);
+    const char* letters = alphabet ? PROTEIN : DNA;
+    Workload w;
+    w.X = random_sequence(len, letters, rng);
+    w.Y = mutate(w.X, identity, letters, rng);
+    cache.push_back(std::make_pair(key, w));
+    return cache.back().second;
+}
+
+static long peak_rss_kb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+//report: GCUPS, allocations per alignment and peak RSS of a finished run
+static void report(benchmark::State& state, double cells_per_iteration, long allocs_before, long alignments_per_iteration)
+{
+    const double alignments = (double)state.iterations() * alignments_per_iteration;
+    state.counters["GCUPS"] = benchmark::Counter(cells_per_iteration / 1e9, benchmark::Counter::kIsIterationInvariantRate);
+    state.counters["allocs"] = alignments > 0 ? (allocations - allocs_before) / alignments : 0;
+    state.counters["peak_RSS_MB"] = peak_rss_kb() / 1024.0;
+}
+
+static void BM_NWScore(benchmark::State& state)
+{
+    const Workload& w = workload(state.range(0), state.range(1), state.range(2));
+    const long before = allocations;
+    for (auto _ : state)
+    {
+        std::vector<int> Lastline = NWScore(w.X, w.Y);
+        benchmark::DoNotOptimize(Lastline.data());
+    }
+    report(state, (double)w.X.size() * w.Y.size(), before, 1);
+}
+
+static void BM_FourRussians(benchmark::State& state)
+{
+    const Workload& w = workload(state.range(0), state.range(1), state.range(2));
+    const Scoring sc = default_scoring();
+    four_russians_table(sc);        //built or loaded once, outside the timing
+    Arena& arena = thread_arena();
+    const long before = allocations;
+    for (auto _ : state)
+    {
+        arena.reset();
+        int score = four_russians_score(w.X.data(), w.X.size(), w.Y.data(), w.Y.size(), sc, arena);
+        benchmark::DoNotOptimize(score);
+    }
+    report(state, (double)w.X.size() * w.Y.size(), before, 1);
+}
+
+static void BM_NeedlemanWunsch(benchmark::State& state)
+{
+    const Workload& w = workload(state.range(0), state.range(1), state.range(2));
+    const long before = allocations;
+    for (auto _ : state)
+    {
+        std::pair<std::string, std::string> alignment = NeedlemanWunsch(w.X, w.Y);
+        benchmark::DoNotOptimize(alignment.first.data());
+    }
+    report(state, (double)w.X.size() * w.Y.size(), before, 1);
+}
+
+static void BM_Checkpoint(benchmark::State& state)
+{
+    const Workload& w = workload(state.range(0), state.range(1), state.range(2));
+    const long before = allocations;
+    for (auto _ : state)
+    {
+        std::pair<std::string, std::string> alignment = Checkpoint(w.X, w.Y);
+        benchmark::DoNotOptimize(alignment.first.data());
+    }
+    report(state, (double)w.X.size() * w.Y.size(), before, 1);
+}
+
+static void BM_Hirschberg(benchmark::State& state)
+{
+    const Workload& w = workload(state.range(0), state.range(1), state.range(2));
+    const long before = allocations;
+    for (auto _ : state)
+    {
+        std::pair<std::string, std::string> alignment = Hirschberg(w.X, w.Y);
+        benchmark::DoNotOptimize(alignment.first.data());
+    }
+    report(state, (double)w.X.size() * w.Y.size(), before, 1);
+}
+
+//Realign: one single-base substitution per iteration, moving REALIGN_STEP bases down X
+static void BM_Realign(benchmark::State& state)
+{
+    const Workload& w = workload(state.range(0), state.range(1), state.range(2));
+    const char* letters = state.range(2) ? PROTEIN : DNA;
+    const int n = w.X.size();
+    Arena& arena = thread_arena();
+    Realigner realigner(w.X.data(), n, w.Y.data(), w.Y.size(), default_scoring(), arena);
+    int pos = 0;
+    long edits = 0;
+    const long before = allocations;
+    for (auto _ : state)
+    {
+        const char c = letters[edits++ % std::strlen(letters)];
+        int score = realigner.edit(pos, 1, &c, 1, arena);
+        benchmark::DoNotOptimize(score);
+        pos = (pos + REALIGN_STEP) % n;
+    }
+    report(state, (double)w.X.size() * w.Y.size(), before, 1);
+}
+
+//Lockstep kernels: BATCH_LANES pairs of the same regime per iteration
+static void lockstep_pairs(benchmark::State& state, std::vector<BatchPair>& pairs, std::vector<Workload>& storage, double& cells)
+{
+    const int len = state.range(0), identity = state.range(1), alphabet = state.range(2);
+    std::mt19937 rng(len * 7 + identity + alphabet);
+    const char* letters = alphabet ? PROTEIN : DNA;
+    storage.resize(BATCH_LANES);
+    pairs.resize(BATCH_LANES);
+    cells = 0;
+    for (int k=0; k<BATCH_LANES; k++)
+    {
+        storage[k].X = random_sequence(len, letters, rng);
+        storage[k].Y = mutate(storage[k].X, identity, letters, rng);
+        BatchPair p = { storage[k].X.data(), (int)storage[k].X.size(), storage[k].Y.data(), (int)storage[k].Y.size() };
+        pairs[k] = p;
+        cells += (double)p.n * p.m;
+    }
+}
+
+static void BM_BatchScore(benchmark::State& state)
+{
+    const Scoring sc = default_scoring();
+    std::vector<BatchPair> pairs;
+    std::vector<Workload> storage;
+    double cells;
+    lockstep_pairs(state, pairs, storage, cells);
+    std::vector<int> scores(BATCH_LANES);
+    Arena& arena = thread_arena();
+    const long before = allocations;
+    for (auto _ : state)
+    {
+        arena.reset();
+        batch_score(pairs.data(), BATCH_LANES, sc, arena, scores.data());
+        benchmark::DoNotOptimize(scores.data());
+    }
+    report(state, cells, before, BATCH_LANES);
+}
+
+static void BM_BatchAlign(benchmark::State& state)
+{
+    const Scoring sc = default_scoring();
+    std::vector<BatchPair> pairs;
+    std::vector<Workload> storage;
+    double cells;
+    lockstep_pairs(state, pairs, storage, cells);
+    std::vector<int> scores(BATCH_LANES), lens(BATCH_LANES);
+    std::vector<std::string> out_1(BATCH_LANES), out_2(BATCH_LANES);
+    std::vector<char*> A_1(BATCH_LANES), A_2(BATCH_LANES);
+    for (int k=0; k<BATCH_LANES; k++)
+    {
+        out_1[k].resize(pairs[k].n + pairs[k].m);
+        out_2[k].resize(pairs[k].n + pairs[k].m);
+        A_1[k] = &out_1[k][0];
+        A_2[k] = &out_2[k][0];
+    }
+    Arena& arena = thread_arena();
+    const long before = allocations;
+    for (auto _ : state)
+    {
+        arena.reset();
+        batch_align(pairs.data(), BATCH_LANES, sc, arena, scores.data(), A_1.data(), A_2.data(), lens.data());
+        benchmark::DoNotOptimize(lens.data());
+    }
+    report(state, cells, before, BATCH_LANES);
+}
+
+//sweep: registers length x identity x alphabet (0 DNA, 1 protein) up to limit
+static void sweep(const char* name, void (*fn)(benchmark::State&), long limit)
+{
+    const long lengths[] = { 100, 300, 1000, 10000, 100000, 1000000 };
+    const long identities[] = { 60, 80, 90, 100 };
+    benchmark::internal::Benchmark* b = benchmark::RegisterBenchmark(name, fn);
+    b->ArgNames({"len", "identity", "protein"});
+    b->Unit(benchmark::kMillisecond);
+    for (int a=0; a<2; a++)
+    {
+        for (int l=0; l<6; l++)
+        {
+            if (lengths[l] > limit || lengths[l] > max_len) continue;
+            for (int i=0; i<4; i++)
+            {
+                b->Args({lengths[l], identities[i], a});
+            }
+        }
+    }
+}
+
+
+int main(int argc, char* argv[])
+{
+    //--max_len is ours, everything else goes to Google Benchmark
+    int kept = 1;
+    for (int a=1; a<argc; a++)
+    {
+        if (std::strncmp(argv[a], "--max_len=", 10) == 0) max_len = std::atol(argv[a] + 10);
+        else argv[kept++] = argv[a];
+    }
+    argc = kept;
+
+    sweep("NWScore", BM_NWScore, 1000000);
+    sweep("FourRussians", BM_FourRussians, 1000000);
+    sweep("NeedlemanWunsch", BM_NeedlemanWunsch, NW_MAX_LEN);
+    sweep("Checkpoint", BM_Checkpoint, CHECKPOINT_MAX_LEN);
+    sweep("Hirschberg", BM_Hirschberg, 1000000);
+    sweep("Realign", BM_Realign, REALIGN_MAX_LEN);
+    sweep("BatchScore", BM_BatchScore, BATCH_MAX_LEN);
+    sweep("BatchAlign", BM_BatchAlign, BATCH_MAX_LEN);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
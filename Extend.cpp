@@ -0,0 +1,191 @@
+/*
+ * Extend: X-drop / Z-drop extension along anti-diagonals, see Extend.h
+ *
+ * Rows of the three live anti-diagonals are indexed by i (the position in X), shifted
+ * by one so that i-1 is always a valid index; the cells just outside the computed
+ * range hold NEG_SCORE, so the recurrence needs no bounds tests.
+ */
+
+#include <climits>
+#include <cstring>
+
+#include "Extend.h"
+#include "Stats.h"
+
+//Pruned cell; far enough from INT_MIN that adding penalties cannot wrap
+#define NEG_SCORE (INT_MIN / 4)
+
+//Direction bits of the traceback, same preference as NeedlemanWunsch()
+#define DIR_DIAG 1
+#define DIR_UP 2
+#define DIR_LEFT 4
+
+//extend_diagonal: cells lo...hi of anti-diagonal d, all with 1 <= i and 1 <= j;
+//the arrays never overlap, which lets the loop vectorise
+template <bool reversed>
+static void extend_diagonal(const char* __restrict__ X, int n, const char* __restrict__ Y, int m, const Scoring& sc,
+                            int d, int lo, int hi, int floor, const int* __restrict__ prev2,
+                            const int* __restrict__ prev, int* __restrict__ cur, unsigned char* __restrict__ dir)
+{
+    const int match = sc.match, mismatch = sc.mismatch, gap = sc.gap;
+    for (int i=lo; i<=hi; i++)
+    {
+        const int j = d - i;
+        const char x = reversed ? X[n-i] : X[i-1];
+        const char y = reversed ? Y[m-j] : Y[j-1];
+        const int from_diag = prev2[i] + (x == y ? match : mismatch);   //H[i-1][j-1]
+        const int from_up = prev[i] + gap;                              //H[i-1][j]
+        const int from_left = prev[i+1] + gap;                          //H[i][j-1]
+        int h = from_diag > from_up ? from_diag : from_up;
+        h = h > from_left ? h : from_left;
+        dir[i-lo] = h == from_diag ? DIR_DIAG : (h == from_up ? DIR_UP : DIR_LEFT);
+        cur[i+1] = h < floor ? NEG_SCORE : h;
+    }
+}
+
+Extension xdrop_extend(const char* X, int n, const char* Y, int m, bool reversed, const Scoring& sc,
+                       int xdrop, int zdrop, Arena& arena)
+{
+    const ArenaMark start = arena.mark();
+    StatsTimer fill(&AlignStats::fill_seconds);
+
+    int* rows[3];
+    for (int r=0; r<3; r++)
+    {
+        rows[r] = arena.alloc<int>(n+3);
+    }
+    int* dlo = arena.alloc<int>(n+m+1);
+    unsigned char** dirs = arena.alloc<unsigned char*>(n+m+1);
+
+    //STEP 1: anti-diagonal 0 is cell (0,0)
+    int* cur = rows[0];
+    cur[0] = NEG_SCORE;
+    cur[1] = 0;
+    cur[2] = NEG_SCORE;
+    int lo = 0, hi = 0;
+    int best = 0, bi = 0, bj = 0;
+    unsigned long long cells = 1;
+
+    //STEP 2: one anti-diagonal at a time, over the cells reachable from the surviving ones
+    for (int d=1; d<=n+m; d++)
+    {
+        const int first = lo > d-m ? lo : d-m;
+        const int last = hi+1 < n ? hi+1 : n;
+        if (first > last) break;
+
+        const int* prev2 = rows[(d+1) % 3];
+        const int* prev = rows[(d+2) % 3];
+        cur = rows[d % 3];
+        unsigned char* dir = arena.alloc<unsigned char>(last - first + 1);
+        const int floor = best - xdrop;
+
+        //borders of the matrix: a single move
+        int inner_lo = first, inner_hi = last;
+        if (first == 0)
+        {
+            const int h = prev[1] + sc.gap;
+            cur[1] = h < floor ? NEG_SCORE : h;
+            dir[0] = DIR_LEFT;
+            inner_lo = 1;
+        }
+        if (last == d)
+        {
+            const int h = prev[d] + sc.gap;
+            cur[d+1] = h < floor ? NEG_SCORE : h;
+            dir[d - first] = DIR_UP;
+            inner_hi = d-1;
+        }
+        if (reversed)
+        {
+            extend_diagonal<true>(X, n, Y, m, sc, d, inner_lo, inner_hi, floor, prev2, prev, cur, dir + (inner_lo - first));
+        }
+        else
+        {
+            extend_diagonal<false>(X, n, Y, m, sc, d, inner_lo, inner_hi, floor, prev2, prev, cur, dir + (inner_lo - first));
+        }
+        cur[first] = NEG_SCORE;
+        cur[last+2] = NEG_SCORE;
+        cells += last - first + 1;
+
+        //surviving range and best cell of the anti-diagonal
+        int top = NEG_SCORE, ti = -1;
+        for (int i=first; i<=last; i++)
+        {
+            if (cur[i+1] > top)
+            {
+                top = cur[i+1];
+                ti = i;
+            }
+        }
+        if (ti < 0) break;
+        lo = first;
+        while (cur[lo+1] == NEG_SCORE) lo++;
+        hi = last;
+        while (cur[hi+1] == NEG_SCORE) hi--;
+        dlo[d] = first;
+        dirs[d] = dir;
+
+        if (top > best)
+        {
+            best = top;
+            bi = ti;
+            bj = d - ti;
+        }
+        else if (zdrop > 0)
+        {
+            const int shift = (ti - bi) - (d - ti - bj);
+            const int gaps = (shift < 0 ? -shift : shift) * (sc.gap < 0 ? -sc.gap : sc.gap);
+            if (best - top > zdrop + gaps) break;
+        }
+    }
+    if (stats_enabled) thread_stats().cells += cells;
+    fill.stop();
+
+    //STEP 3: traceback from the best cell, operations written backwards into ops[k...bi+bj)
+    StatsTimer traceback(&AlignStats::traceback_seconds);
+    char* ops = arena.alloc<char>(bi + bj);
+    int k = bi + bj;
+    int i = bi, j = bj;
+    while (i > 0 || j > 0)
+    {
+        const unsigned char c = dirs[i+j][i - dlo[i+j]];
+        if (c == DIR_DIAG)
+        {
+            ops[--k] = 'M';
+            i--;
+            j--;
+        }
+        else if (c == DIR_UP)
+        {
+            ops[--k] = 'I';
+            i--;
+        }
+        else
+        {
+            ops[--k] = 'D';
+            j--;
+        }
+    }
+
+    //run-length CIGAR after the operations (a run of r takes at most r+1 <= 2r characters),
+    //then moved down to the start of the scratch
+    char* cigar = arena.alloc<char>(2 * (bi + bj) + 1);
+    int len = 0;
+    for (int o=k; o<bi+bj; )
+    {
+        int run = o;
+        while (run < bi+bj && ops[run] == ops[o]) run++;
+        char digits[12];
+        int nd = 0;
+        for (int v = run - o; v > 0; v /= 10) digits[nd++] = '0' + v % 10;
+        while (nd > 0) cigar[len++] = digits[--nd];
+        cigar[len++] = ops[o];
+        o = run;
+    }
+    arena.rewind(start);
+    char* out = arena.alloc<char>(len);
+    std::memmove(out, cigar, len);
+
+    Extension r = { best, bi, bj, out, len };
+    return r;
+}
@@ -0,0 +1,47 @@
+/*
+ * Extend: X-drop / Z-drop extension from an anchor
+ *
+ * Grows the DP from cell (0,0) of X[0...n) and Y[0...m) (the sequences right after
+ * an anchor, or right before it with reversed=true) one anti-diagonal at a time.
+ * A cell scoring more than xdrop below the best cell so far is pruned, the next
+ * anti-diagonal only covers the cells reachable from the surviving ones, and the
+ * extension stops when a whole anti-diagonal is pruned. With zdrop > 0 it also
+ * stops when the best cell of an anti-diagonal falls more than zdrop below the
+ * best so far, beyond the gaps needed to reach it (long poor stretches).
+ *
+ * Cells of one anti-diagonal do not depend on each other, so the inner loop is a
+ * straight pass over contiguous arrays that the compiler vectorises.
+ *
+ * The result is the best cell: the extension covers X[0...x_len) and Y[0...y_len),
+ * and its CIGAR uses M (aligned), I (residue of X only) and D (residue of Y only),
+ * in the order of the extension away from the anchor.
+ *
+ * References:
+ * - Zhang, Z., et al. (2000). A greedy algorithm for aligning DNA sequences.
+ *   Journal of Computational Biology, 7(1-2), 203–214.
+ * - Li, H. (2018). Minimap2: pairwise alignment for nucleotide sequences.
+ *   Bioinformatics, 34(18), 3094–3100.
+ *
+ */
+
+#ifndef EXTEND_H
+#define EXTEND_H
+
+#include "Arena.h"
+#include "Scoring.h"
+
+struct Extension
+{
+    int score;
+    int x_len;
+    int y_len;
+    const char* cigar;          //cigar_len characters (not terminated) inside the arena
+    int cigar_len;
+};
+
+//xdrop_extend: best extension of X against Y from their start (their end with reversed);
+//the CIGAR stays in arena until the caller rewinds it, the scratch is released
+Extension xdrop_extend(const char* X, int n, const char* Y, int m, bool reversed, const Scoring& sc,
+                       int xdrop, int zdrop, Arena& arena);
+
+#endif //EXTEND_H
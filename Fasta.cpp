@@ -0,0 +1,42 @@
+/*
+ * Fasta: streaming reader of FASTA files, see Fasta.h
+ */
+
+#include <cctype>
+
+#include "Fasta.h"
+
+FastaReader::FastaReader(std::istream& in) : in(in), pending(false), count(0)
+{
+}
+
+bool FastaReader::next(FastaRecord& record)
+{
+    //skip anything before the first header
+    while (!pending)
+    {
+        if (!std::getline(in, line)) return false;
+        pending = !line.empty() && line[0] == '>';
+    }
+
+    std::size_t end = 1;
+    while (end < line.size() && !std::isspace((unsigned char)line[end])) end++;
+    record.name.assign(line, 1, end - 1);
+    record.sequence.clear();
+
+    pending = false;
+    while (std::getline(in, line))
+    {
+        if (!line.empty() && line[0] == '>')
+        {
+            pending = true;
+            break;
+        }
+        for (std::size_t c=0; c<line.size(); c++)
+        {
+            if (!std::isspace((unsigned char)line[c])) record.sequence += line[c];
+        }
+    }
+    count++;
+    return true;
+}
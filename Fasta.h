@@ -0,0 +1,45 @@
+/*
+ * Fasta: streaming reader of FASTA files
+ *
+ * Records are read one at a time into a caller-owned FastaRecord whose strings are
+ * reused, so streaming a large database does not allocate once the longest record
+ * has been seen. Sequence lines are concatenated; whitespace is dropped.
+ *
+ * Usage:
+ *   FastaReader reader(in);
+ *   FastaRecord record;
+ *   while (reader.next(record)) { ... }
+ *
+ */
+
+#ifndef FASTA_H
+#define FASTA_H
+
+#include <istream>
+#include <string>
+
+struct FastaRecord
+{
+    std::string name;           //header up to the first whitespace, without '>'
+    std::string sequence;
+};
+
+class FastaReader
+{
+public:
+    explicit FastaReader(std::istream& in);
+
+    //next: the following record, false at the end of the stream
+    bool next(FastaRecord& record);
+
+    //records: records returned so far
+    long records() const { return count; }
+
+private:
+    std::istream& in;
+    std::string line;
+    bool pending;               //line holds the header of the next record
+    long count;
+};
+
+#endif //FASTA_H
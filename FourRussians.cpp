@@ -0,0 +1,304 @@
+/*
+ * FourRussians: blocked score-only DP with precomputed block tables, see FourRussians.h
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "FourRussians.h"
+#include "Alignment.h"
+#include "Stats.h"
+
+//Useful tools
+static void build_table(FourRussiansTable& table);
+static std::string cache_path(const Scoring& sc, int t);
+static bool load_table(const std::string& path, FourRussiansTable& table);
+static void save_table(const std::string& path, const FourRussiansTable& table);
+
+//fill_band: one lookup per block of a band of T rows, updating the top row of every
+//block column; returns the right column of the last block
+template <int T>
+static uint32_t fill_band(const uint32_t* entries, uint32_t Kt, const uint8_t* const* rows, int blocks, uint16_t* top)
+{
+    uint32_t left = 0;
+    for (int b=0; b<blocks; b++)
+    {
+        uint32_t equal = 0;
+        for (int r=0; r<T; r++)
+        {
+            equal |= (uint32_t)rows[r][b] << (r*T);
+        }
+        const uint32_t e = entries[((left * Kt + top[b]) << (T*T)) | equal];
+        left = e & 0xffff;
+        top[b] = e >> 16;
+    }
+    return left;
+}
+
+//fr_cell: D(i,j) from the differences around it: top = D(i-1,j) - D(i-1,j-1) and
+//left = D(i,j-1) - D(i-1,j-1) become bottom = D(i,j) - D(i,j-1) and right = D(i,j) - D(i-1,j)
+static inline void fr_cell(int s, int gap, int& top, int& left)
+{
+    const int d = max3(s, top + gap, left + gap);
+    const int bottom = d - left;
+    left = d - top;
+    top = bottom;
+}
+
+
+const FourRussiansTable* four_russians_table(const Scoring& sc)
+{
+    static std::mutex lock;
+    static std::vector<std::unique_ptr<FourRussiansTable> > tables;
+
+    std::lock_guard<std::mutex> guard(lock);
+    for (std::size_t k=0; k<tables.size(); k++)
+    {
+        const Scoring& s = tables[k]->sc;
+        if (s.match == sc.match && s.mismatch == sc.mismatch && s.gap == sc.gap) return tables[k].get();
+    }
+
+    //STEP 1: digits per difference, then the largest block whose table fits
+    const int best = sc.match > sc.mismatch ? sc.match : sc.mismatch;
+    const int K = (best - sc.gap > sc.gap ? best - sc.gap : sc.gap) - sc.gap + 1;
+    int t = FR_MAX_BLOCK;
+    double entries = 0;
+    for (; t>=2; t--)
+    {
+        double Kt = 1;
+        for (int c=0; c<t; c++) Kt *= K;
+        entries = Kt * Kt * (double)(1u << (t*t));
+        if (Kt < 65536 && entries <= FR_MAX_ENTRIES) break;
+    }
+    if (t < 2) return NULL;
+
+    std::unique_ptr<FourRussiansTable> table(new FourRussiansTable);
+    table->sc = sc;
+    table->t = t;
+    table->K = K;
+    table->Kt = 1;
+    for (int c=0; c<t; c++) table->Kt *= K;
+
+    //STEP 2: from the disk cache, or built and stored there for the next process
+    const std::string path = cache_path(sc, t);
+    if (path.empty() || !load_table(path, *table))
+    {
+        build_table(*table);
+        if (!path.empty()) save_table(path, *table);
+    }
+    tables.push_back(std::move(table));
+    return tables.back().get();
+}
+
+
+int four_russians_score(const char* X, int n, const char* Y, int m, const Scoring& sc, Arena& arena)
+{
+    const FourRussiansTable* table = four_russians_table(sc);
+    if (table == NULL)
+    {
+        const ArenaMark mark = arena.mark();
+        int* Lastline = arena.alloc<int>(m+1);
+        NWScore_row(X, n, Y, m, false, sc, Lastline);
+        const int score = Lastline[m];
+        arena.rewind(mark);
+        return score;
+    }
+
+    StatsTimer fill(&AlignStats::fill_seconds);
+    if (stats_enabled) thread_stats().cells += (unsigned long long)n * m;
+    const ArenaMark start = arena.mark();
+    const int t = table->t, K = table->K, Kt = table->Kt;
+    const uint32_t* entries = table->entries.data();
+    const int blocks = m / t;
+    const int bands = n / t;
+    const int tail = m - blocks * t;
+
+    //STEP 1: a code for every residue of Y's blocks (0: absent), then for each code and
+    //block the columns holding it
+    int code[256] = { 0 };
+    int codes = 1;
+    for (int j=0; j<blocks*t; j++)
+    {
+        const unsigned char y = Y[j];
+        if (code[y] == 0) code[y] = codes++;
+    }
+    uint8_t* masks = arena.alloc<uint8_t>((std::size_t)codes * blocks);
+    std::memset(masks, 0, (std::size_t)codes * blocks);
+    for (int b=0; b<blocks; b++)
+    {
+        for (int c=0; c<t; c++)
+        {
+            masks[(std::size_t)code[(unsigned char)Y[b*t+c]] * blocks + b] |= 1 << c;
+        }
+    }
+
+    //STEP 2: the first row, all gaps: digit 0 everywhere
+    uint16_t* top = arena.alloc<uint16_t>(blocks);
+    std::memset(top, 0, blocks * sizeof(uint16_t));
+    int* tail_top = arena.alloc<int>(tail + 1);
+    for (int c=0; c<tail; c++)
+    {
+        tail_top[c] = sc.gap;
+    }
+
+    //STEP 3: bands of t rows, one lookup per block, the columns left over cell by cell
+    const uint8_t* rows[FR_MAX_BLOCK];
+    for (int band=0; band<bands; band++)
+    {
+        const int i0 = band * t;
+        for (int r=0; r<t; r++)
+        {
+            rows[r] = masks + (std::size_t)code[(unsigned char)X[i0+r]] * blocks;
+        }
+
+        uint32_t left;
+        switch (t)
+        {
+            case 2: left = fill_band<2>(entries, Kt, rows, blocks, top); break;
+            case 3: left = fill_band<3>(entries, Kt, rows, blocks, top); break;
+            default: left = fill_band<4>(entries, Kt, rows, blocks, top); break;
+        }
+
+        for (int r=0; r<t && tail>0; r++)
+        {
+            int v = left % K + sc.gap;
+            left /= K;
+            for (int c=0; c<tail; c++)
+            {
+                fr_cell(match_or_mismatch(X[i0+r], Y[blocks*t+c], sc), sc.gap, tail_top[c], v);
+            }
+        }
+    }
+
+    //STEP 4: the rows left over, cell by cell from the decoded last row
+    int* h = arena.alloc<int>(m + 1);
+    for (int b=0; b<blocks; b++)
+    {
+        int digits = top[b];
+        for (int c=0; c<t; c++)
+        {
+            h[b*t+c] = digits % K + sc.gap;
+            digits /= K;
+        }
+    }
+    for (int c=0; c<tail; c++)
+    {
+        h[blocks*t+c] = tail_top[c];
+    }
+    for (int i=bands*t; i<n; i++)
+    {
+        int v = sc.gap;
+        for (int j=0; j<m; j++)
+        {
+            fr_cell(match_or_mismatch(X[i], Y[j], sc), sc.gap, h[j], v);
+        }
+    }
+
+    //D(n,m) = D(n,0) + the differences along the last row
+    int score = n * sc.gap;
+    for (int j=0; j<m; j++)
+    {
+        score += h[j];
+    }
+    arena.rewind(start);
+    return score;
+}
+
+
+//Functions
+//build_table: runs every block input through t x t cells
+static void build_table(FourRussiansTable& table)
+{
+    const int t = table.t, K = table.K, Kt = table.Kt, tt = t*t;
+    const int gap = table.sc.gap;
+    table.entries.resize((std::size_t)Kt * Kt << tt);
+    int left[FR_MAX_BLOCK], top[FR_MAX_BLOCK];
+    for (int l=0; l<Kt; l++)
+    {
+        for (int u=0; u<Kt; u++)
+        {
+            for (uint32_t equal=0; equal < (1u << tt); equal++)
+            {
+                for (int c=0, digits=l; c<t; c++, digits/=K) left[c] = digits % K + gap;
+                for (int c=0, digits=u; c<t; c++, digits/=K) top[c] = digits % K + gap;
+                for (int r=0; r<t; r++)
+                {
+                    for (int c=0; c<t; c++)
+                    {
+                        const int s = (equal >> (r*t + c)) & 1 ? table.sc.match : table.sc.mismatch;
+                        fr_cell(s, gap, top[c], left[r]);
+                    }
+                }
+
+                uint32_t right = 0, bottom = 0;
+                for (int c=t-1; c>=0; c--)
+                {
+                    right = right * K + (left[c] - gap);
+                    bottom = bottom * K + (top[c] - gap);
+                }
+                table.entries[(((std::size_t)l * Kt + u) << tt) | equal] = right | bottom << 16;
+            }
+        }
+    }
+}
+
+//cache_path: file of the table in the cache directory, created if needed; empty without one
+static std::string cache_path(const Scoring& sc, int t)
+{
+    std::string dir;
+    if (const char* env = std::getenv("ALN_CACHE_DIR")) dir = env;
+    else if (const char* xdg = std::getenv("XDG_CACHE_HOME")) dir = std::string(xdg) + "/alignment";
+    else if (const char* home = std::getenv("HOME")) dir = std::string(home) + "/.cache/alignment";
+    if (dir.empty()) return dir;
+
+    for (std::size_t slash = dir.find('/', 1); ; slash = dir.find('/', slash + 1))
+    {
+        mkdir(dir.substr(0, slash).c_str(), 0755);
+        if (slash == std::string::npos) break;
+    }
+    char name[96];
+    std::snprintf(name, sizeof(name), "/four_russians_%d_%d_%d_t%d.bin", sc.match, sc.mismatch, sc.gap, t);
+    return dir + name;
+}
+
+//load_table: false when the file is missing, truncated or for another table
+static bool load_table(const std::string& path, FourRussiansTable& table)
+{
+    std::ifstream in(path.c_str(), std::ios::binary);
+    int32_t header[7];
+    if (!in.read(reinterpret_cast<char*>(header), sizeof(header))) return false;
+    const std::size_t count = (std::size_t)table.Kt * table.Kt << (table.t * table.t);
+    if ((uint32_t)header[0] != FR_MAGIC || header[1] != FR_VERSION || header[2] != table.sc.match
+        || header[3] != table.sc.mismatch || header[4] != table.sc.gap || header[5] != table.t
+        || (std::size_t)header[6] != count)
+    {
+        return false;
+    }
+    table.entries.resize(count);
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(table.entries.data()), count * sizeof(uint32_t)));
+}
+
+//save_table: written aside and renamed, so that readers never see half a table
+static void save_table(const std::string& path, const FourRussiansTable& table)
+{
+    const std::string partial = path + "." + std::to_string(getpid());
+    bool written;
+    {
+        std::ofstream out(partial.c_str(), std::ios::binary);
+        const int32_t header[7] = { (int32_t)FR_MAGIC, FR_VERSION, table.sc.match, table.sc.mismatch, table.sc.gap,
+                                    table.t, (int32_t)table.entries.size() };
+        out.write(reinterpret_cast<const char*>(header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(table.entries.data()), table.entries.size() * sizeof(uint32_t));
+        out.close();
+        written = static_cast<bool>(out);
+    }
+    if (!written || std::rename(partial.c_str(), path.c_str()) != 0) std::remove(partial.c_str());
+}
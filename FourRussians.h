@@ -0,0 +1,71 @@
+/*
+ * FourRussians: score-only global alignment in O(nm / t^2) table lookups
+ *
+ * With linear gaps, two neighbouring cells of the score matrix differ by a bounded
+ * amount: D(i,j) - D(i-1,j) and D(i,j) - D(i,j-1) lie in [gap, max(match, mismatch) - gap],
+ * only K values (K = 3 for unit costs: match 0, mismatch and gap -1). Cut into
+ * t x t blocks, the matrix is fully described by these differences. The bottom row
+ * and right column of a block depend only on its top row, its left column and which
+ * residues of its t rows equal which of its t columns. That gives K^t * K^t * 2^(t*t)
+ * possible inputs, and the Method of Four Russians [1] computes the outputs of all of
+ * them once. Filling the matrix then takes one table lookup per block. The
+ * equality pattern ignores the residues themselves, so one table serves every
+ * alphabet.
+ *
+ * A table depends only on the Scoring. It is built on first use, kept for the life of
+ * the process and cached on disk: in $ALN_CACHE_DIR, else $XDG_CACHE_HOME/alignment,
+ * else ~/.cache/alignment. Later processes read the file back instead of
+ * rebuilding it. t is the largest block size (up to FR_MAX_BLOCK) whose table holds at
+ * most FR_MAX_ENTRIES entries. For the default scoring (K = 4) and for unit costs that
+ * is t = 3, so each lookup replaces 9 cells. When even t = 2 would not fit, there is no
+ * table and the score comes from NWScore_row.
+ *
+ * Lookups pay off on long pairs of low identity, where banded and diagonal-pruned
+ * engines gain nothing; short pairs are better served by the lockstep kernels.
+ *
+ * References:
+ * - [1] Masek, W. J., & Paterson, M. S. (1980). A faster algorithm computing string edit
+ *   distances. Journal of Computer and System Sciences, 20(1), 18–31.
+ *
+ * Usage:
+ *   const int score = four_russians_score(X, n, Y, m, sc, arena);   //== NWScore_row(...)[m]
+ *
+ */
+
+#ifndef FOUR_RUSSIANS_H
+#define FOUR_RUSSIANS_H
+
+#include <cstdint>
+#include <vector>
+
+#include "Arena.h"
+#include "Scoring.h"
+
+#define FR_MAX_BLOCK 4
+#define FR_MAX_ENTRIES (1 << 22)
+
+//Cache files: "ALN4", then version, match, mismatch, gap, t and entry count as int32, then entries
+#define FR_MAGIC 0x344e4c41u
+#define FR_VERSION 1
+
+//FourRussiansTable: outputs of every t x t block for one Scoring. Differences are stored
+//as digits d - gap in [0...K), a row or column of t of them as the base-K number
+//sum digit_c * K^c. Entry ((left * K^t + top) << t*t) | equal holds right | bottom << 16;
+//bit r*t + c of equal is set when residue r of the block's rows equals residue c of its columns
+struct FourRussiansTable
+{
+    Scoring sc;
+    int t;
+    int K;
+    int Kt;                             //K^t
+    std::vector<uint32_t> entries;
+};
+
+//four_russians_table: the table of sc, built or read from the disk cache on first use;
+//NULL when even 2 x 2 blocks would exceed FR_MAX_ENTRIES. Thread safe
+const FourRussiansTable* four_russians_table(const Scoring& sc);
+
+//four_russians_score: score of the optimal global alignment of X[0...n) against Y[0...m)
+int four_russians_score(const char* X, int n, const char* Y, int m, const Scoring& sc, Arena& arena);
+
+#endif //FOUR_RUSSIANS_H
@@ -0,0 +1,398 @@
+/*
+ * Msa: progressive multiple sequence alignment, see Msa.h
+ */
+
+#include <algorithm>
+#include <cfloat>
+
+#include "AllPairs.h"
+#include "Msa.h"
+#include "Profile.h"
+#include "Stats.h"
+
+//MsaCluster: profile of the sequences below a node of the guide tree; the rows are not
+//kept, only the operations that merged the node's children
+struct MsaCluster
+{
+    int rows;                               //sequences below the node
+    std::string ops;                        //ops of profile_align_into, one per column of an inner node
+    std::vector<unsigned char> residues;    //codes of the sequence of a leaf
+    std::vector<int16_t> freq;              //profile of an inner node, length * stride
+    std::vector<int16_t> gaps;
+    int length;
+};
+
+//cluster_view: a leaf is aligned as a sequence, an inner node as a profile
+static ProfileView cluster_view(const MsaCluster& c, int stride)
+{
+    if (c.rows == 1) return sequence_view(c.residues.data(), c.length, stride);
+    const ProfileView v = { c.freq.data(), c.gaps.data(), NULL, c.length, c.rows, stride };
+    return v;
+}
+
+//Distance of slots i != j in the condensed triangle
+static inline float& distance_at(std::vector<float>& D, int i, int j)
+{
+    if (i > j) std::swap(i, j);
+    return D[(std::size_t)j*(j-1)/2 + i];
+}
+
+//Useful tools
+static void upgma(std::vector<float>& D, int N, std::vector<GuideNode>& nodes);
+static void neighbor_joining(std::vector<float>& D, int N, std::vector<GuideNode>& nodes);
+static void merge_clusters(MsaCluster& a, MsaCluster& b, int stride, const Scoring& sc, MsaCluster& out);
+
+
+MsaConfig default_msa_config()
+{
+    MsaConfig config;
+    config.scoring = default_scoring();
+    config.tree = TREE_UPGMA;
+    config.threads = 0;
+    return config;
+}
+
+
+std::vector<float> msa_distances(const std::vector<std::string>& sequences, const Scoring& sc, ThreadPool& pool)
+{
+    const int N = sequences.size();
+    std::vector<float> distances(N > 1 ? (std::size_t)N*(N-1)/2 : 0);
+    all_pairs(sequences, sc, pool, [&sequences, &distances, &sc](const AllPairsTile& tile)
+    {
+        const int* s = tile.scores;
+        for (int j=tile.j0; j<tile.j1; j++)
+        {
+            for (int i=tile.i0; i<tile.i1 && i<=j; i++, s++)
+            {
+                if (i < j) distance_at(distances, i, j) = pair_distance(*s, sequences[i].length(), sequences[j].length(), sc);
+            }
+        }
+    });
+    return distances;
+}
+
+
+std::vector<GuideNode> guide_tree(std::vector<float>& distances, int N, GuideTreeMethod method)
+{
+    std::vector<GuideNode> nodes;
+    nodes.reserve(N > 0 ? 2*N-1 : 0);
+    for (int k=0; k<N; k++)
+    {
+        const GuideNode leaf = { -1, -1, 0 };
+        nodes.push_back(leaf);
+    }
+    if (N < 2) return nodes;
+
+    if (method == TREE_NEIGHBOR_JOINING) neighbor_joining(distances, N, nodes);
+    else upgma(distances, N, nodes);
+    return nodes;
+}
+
+
+std::vector<std::string> progressive_align(const std::vector<std::string>& sequences, const MsaConfig& config)
+{
+    const int N = sequences.size();
+    if (N == 0) return std::vector<std::string>();
+    ThreadPool pool(config.threads);
+
+    //STEP 1: distances and guide tree
+    std::vector<float> distances = msa_distances(sequences, config.scoring, pool);
+    const std::vector<GuideNode> nodes = guide_tree(distances, N, config.tree);
+    std::vector<float>().swap(distances);
+
+    //STEP 2: the leaves are the coded sequences
+    Alphabet alphabet;
+    for (int k=0; k<N; k++)
+    {
+        alphabet.add(sequences[k].data(), sequences[k].length());
+    }
+    const int stride = alphabet.stride();
+    std::vector<MsaCluster> clusters(nodes.size());
+    for (int k=0; k<N; k++)
+    {
+        MsaCluster& c = clusters[k];
+        c.rows = 1;
+        c.length = sequences[k].length();
+        c.residues.resize(c.length);
+        alphabet.encode(sequences[k].data(), c.length, c.residues.data());
+    }
+
+    //STEP 3: internal nodes by height; the children of a node are all lower, so a
+    //whole height is aligned in parallel
+    int top = 0;
+    for (std::size_t u=0; u<nodes.size(); u++)
+    {
+        top = std::max(top, nodes[u].height);
+    }
+    for (int h=1; h<=top; h++)
+    {
+        for (std::size_t u=N; u<nodes.size(); u++)
+        {
+            if (nodes[u].height != h) continue;
+            MsaCluster* a = &clusters[nodes[u].left];
+            MsaCluster* b = &clusters[nodes[u].right];
+            MsaCluster* out = &clusters[u];
+            const Scoring sc = config.scoring;
+            pool.submit([a, b, out, stride, sc]
+            {
+                merge_clusters(*a, *b, stride, sc, *out);
+            });
+        }
+        pool.wait();
+    }
+
+    //STEP 4: the rows, written once by replaying the merges from the root down: each node
+    //gets the root columns of its own columns, and a leaf puts its residues there. Depth
+    //first, so only the nodes on the stack hold their columns
+    const int L = clusters.back().length;
+    std::vector<std::string> rows(N);
+    std::vector< std::pair< int, std::vector<int> > > stack(1);
+    stack[0].first = nodes.size() - 1;
+    stack[0].second.resize(L);
+    for (int t=0; t<L; t++)
+    {
+        stack[0].second[t] = t;
+    }
+    while (!stack.empty())
+    {
+        const int u = stack.back().first;
+        std::vector<int> columns;
+        columns.swap(stack.back().second);
+        stack.pop_back();
+        if (u < N)
+        {
+            rows[u].assign(L, '-');
+            for (std::size_t p=0; p<columns.size(); p++)
+            {
+                rows[u][columns[p]] = sequences[u][p];
+            }
+            continue;
+        }
+
+        //a's columns are those without 'D', b's those without 'I'
+        const std::string& ops = clusters[u].ops;
+        stack.resize(stack.size() + 2);
+        std::pair< int, std::vector<int> >& left = stack[stack.size() - 1];
+        std::pair< int, std::vector<int> >& right = stack[stack.size() - 2];
+        left.first = nodes[u].left;
+        right.first = nodes[u].right;
+        left.second.reserve(clusters[left.first].length);
+        right.second.reserve(clusters[right.first].length);
+        for (std::size_t t=0; t<ops.size(); t++)
+        {
+            if (ops[t] != 'D') left.second.push_back(columns[t]);
+            if (ops[t] != 'I') right.second.push_back(columns[t]);
+        }
+        std::string().swap(clusters[u].ops);
+    }
+    return rows;
+}
+
+
+long long sum_of_pairs(const std::vector<std::string>& rows, const Scoring& sc)
+{
+    //per column: pairs of equal residues, pairs of residues, residue-gap pairs
+    const std::size_t length = rows.empty() ? 0 : rows[0].length();
+    long long score = 0;
+    long long counts[256];
+    for (std::size_t i=0; i<length; i++)
+    {
+        std::fill(counts, counts + 256, 0);
+        for (std::size_t r=0; r<rows.size(); r++)
+        {
+            counts[(unsigned char)rows[r][i]]++;
+        }
+        const long long gaps = counts[(unsigned char)'-'];
+        const long long residues = rows.size() - gaps;
+        long long same = 0;
+        for (int c=0; c<256; c++)
+        {
+            if (c != '-') same += counts[c] * (counts[c] - 1) / 2;
+        }
+        score += sc.match * same + sc.mismatch * (residues * (residues - 1) / 2 - same) + sc.gap * residues * gaps;
+    }
+    return score;
+}
+
+
+//Functions
+//join: new node above the nodes of two clusters
+static int join(std::vector<GuideNode>& nodes, int left, int right)
+{
+    const GuideNode node = { left, right, std::max(nodes[left].height, nodes[right].height) + 1 };
+    nodes.push_back(node);
+    return nodes.size() - 1;
+}
+
+//upgma: average linkage; every live slot caches its nearest neighbour, rescanned only
+//when that neighbour was merged (merging never brings a cluster closer than both parts)
+static void upgma(std::vector<float>& D, int N, std::vector<GuideNode>& nodes)
+{
+    std::vector<int> live(N), node(N), size(N, 1), nearest(N);
+    std::vector<float> nearest_distance(N);
+    for (int s=0; s<N; s++)
+    {
+        live[s] = s;
+        node[s] = s;
+    }
+    const auto rescan = [&](int s)
+    {
+        nearest[s] = -1;
+        nearest_distance[s] = FLT_MAX;
+        for (std::size_t k=0; k<live.size(); k++)
+        {
+            const int t = live[k];
+            if (t != s && distance_at(D, s, t) < nearest_distance[s])
+            {
+                nearest[s] = t;
+                nearest_distance[s] = distance_at(D, s, t);
+            }
+        }
+    };
+    for (int s=0; s<N; s++)
+    {
+        rescan(s);
+    }
+
+    while (live.size() > 1)
+    {
+        //closest pair, merged into slot s
+        int s = live[0];
+        for (std::size_t k=1; k<live.size(); k++)
+        {
+            if (nearest_distance[live[k]] < nearest_distance[s]) s = live[k];
+        }
+        const int t = nearest[s];
+        live.erase(std::find(live.begin(), live.end(), t));
+        for (std::size_t k=0; k<live.size(); k++)
+        {
+            const int u = live[k];
+            if (u == s) continue;
+            float& d = distance_at(D, s, u);
+            d = (size[s] * d + size[t] * distance_at(D, t, u)) / (size[s] + size[t]);
+        }
+        size[s] += size[t];
+        node[s] = join(nodes, node[s], node[t]);
+
+        for (std::size_t k=0; k<live.size(); k++)
+        {
+            const int u = live[k];
+            if (u == s || nearest[u] == s || nearest[u] == t) rescan(u);
+            else if (distance_at(D, s, u) < nearest_distance[u])
+            {
+                nearest[u] = s;
+                nearest_distance[u] = distance_at(D, s, u);
+            }
+        }
+    }
+}
+
+//neighbor_joining: Saitou and Nei; the pair minimising (r-2) d(i,j) - R(i) - R(j) is joined
+//into slot i, until one cluster is left
+static void neighbor_joining(std::vector<float>& D, int N, std::vector<GuideNode>& nodes)
+{
+    std::vector<int> live(N), node(N);
+    std::vector<double> total(N, 0.0);          //R(i): sum of the distances to the live slots
+    for (int s=0; s<N; s++)
+    {
+        live[s] = s;
+        node[s] = s;
+        for (int t=0; t<N; t++)
+        {
+            if (t != s) total[s] += distance_at(D, s, t);
+        }
+    }
+
+    while (live.size() > 1)
+    {
+        const int r = live.size();
+        int bi = live[0], bj = live[1];
+        if (r > 2)
+        {
+            double best = DBL_MAX;
+            for (int a=0; a<r; a++)
+            {
+                for (int b=a+1; b<r; b++)
+                {
+                    const int i = live[a], j = live[b];
+                    const double q = (double)(r - 2) * distance_at(D, i, j) - total[i] - total[j];
+                    if (q < best)
+                    {
+                        best = q;
+                        bi = i;
+                        bj = j;
+                    }
+                }
+            }
+        }
+
+        const float dij = distance_at(D, bi, bj);
+        live.erase(std::find(live.begin(), live.end(), bj));
+        total[bi] = 0.0;
+        for (std::size_t k=0; k<live.size(); k++)
+        {
+            const int u = live[k];
+            if (u == bi) continue;
+            float& d = distance_at(D, bi, u);
+            const float joined = (d + distance_at(D, bj, u) - dij) / 2;
+            total[u] += joined - d - distance_at(D, bj, u);
+            d = joined;
+            total[bi] += joined;
+        }
+        node[bi] = join(nodes, node[bi], node[bj]);
+    }
+}
+
+//merge_clusters: profile alignment of a and b into out, whose ops record the merge; a and b
+//give up their profiles
+static void merge_clusters(MsaCluster& a, MsaCluster& b, int stride, const Scoring& sc, MsaCluster& out)
+{
+    Arena& arena = thread_arena();
+    arena.reset();
+    const ProfileView A = cluster_view(a, stride);
+    const ProfileView B = cluster_view(b, stride);
+    char* ops = arena.alloc<char>(a.length + b.length);
+    int len = 0;
+    profile_align_into(A, B, sc, arena, ops, len);
+    stats_record_arena(arena);
+
+    //STEP 1: columns of the merged profile, a gap column where a side has none
+    out.length = len;
+    out.freq.assign((std::size_t)len * stride, 0);
+    out.gaps.assign(len, 0);
+    int ia = 0, ib = 0;
+    for (int t=0; t<len; t++)
+    {
+        int16_t* column = &out.freq[(std::size_t)t * stride];
+        for (int side=0; side<2; side++)
+        {
+            const ProfileView& v = side == 0 ? A : B;
+            const bool present = ops[t] == 'M' || ops[t] == (side == 0 ? 'I' : 'D');
+            if (!present)
+            {
+                out.gaps[t] += v.rows;
+                continue;
+            }
+            const int k = side == 0 ? ia++ : ib++;
+            if (v.residues)
+            {
+                column[v.residues[k]]++;
+                continue;
+            }
+            const int16_t* from = v.freq + (std::size_t)k * stride;
+            for (int c=0; c<stride; c++) column[c] += from[c];
+            out.gaps[t] += v.gaps[k];
+        }
+    }
+
+    //STEP 2: the operations, replayed into rows once the root is aligned
+    out.rows = a.rows + b.rows;
+    out.ops.assign(ops, len);
+    for (int side=0; side<2; side++)
+    {
+        MsaCluster& c = side == 0 ? a : b;
+        std::vector<unsigned char>().swap(c.residues);
+        std::vector<int16_t>().swap(c.freq);
+        std::vector<int16_t>().swap(c.gaps);
+    }
+}
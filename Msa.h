@@ -0,0 +1,71 @@
+/*
+ * Msa: progressive multiple sequence alignment built on the pairwise engines
+ *
+ * Three steps:
+ * 1. Distances. Every pair is scored in cache-sized tiles spread over a ThreadPool
+ *    (AllPairs.h). The distance is the gap between the best score the two lengths
+ *    allow and the actual score, per residue of the pair (pair_distance).
+ * 2. Guide tree. It is built from the distances by UPGMA, with a cached nearest
+ *    neighbour per cluster (about O(N^2)), or by neighbour-joining (O(N^3)).
+ * 3. Profiles. They are aligned from the leaves up (Profile.h). A leaf is aligned as a
+ *    sequence, so the lowest merges run the profile-sequence kernels. Nodes of the same
+ *    height are independent and are aligned in parallel. A merge keeps only its column
+ *    operations; the rows are written once, at the end, by replaying them from the root
+ *    down, in O(N L) for N sequences of alignment length L whatever the tree's depth.
+ *
+ * Usage:
+ *   MsaConfig config = default_msa_config();
+ *   config.tree = TREE_NEIGHBOR_JOINING;
+ *   std::vector<std::string> rows = progressive_align(sequences, config);
+ *   //rows[k]: sequences[k] with gaps, all of the same length
+ *
+ */
+
+#ifndef MSA_H
+#define MSA_H
+
+#include <string>
+#include <vector>
+
+#include "Scoring.h"
+#include "ThreadPool.h"
+
+enum GuideTreeMethod
+{
+    TREE_UPGMA = 0,
+    TREE_NEIGHBOR_JOINING = 1
+};
+
+struct MsaConfig
+{
+    Scoring scoring;
+    GuideTreeMethod tree;
+    int threads;                //<= 0: one per hardware thread
+};
+
+//GuideNode: nodes [0...N) are the sequences (left = right = -1), the following ones
+//join two earlier nodes; the root is the last node
+struct GuideNode
+{
+    int left;
+    int right;
+    int height;                 //longest path down to a sequence, 0 for a sequence
+};
+
+//default_msa_config: default scoring, UPGMA, one thread per core
+MsaConfig default_msa_config();
+
+//msa_distances: condensed triangle, distance of i < j at (size_t)j*(j-1)/2 + i
+std::vector<float> msa_distances(const std::vector<std::string>& sequences, const Scoring& sc, ThreadPool& pool);
+
+//guide_tree: 2N-1 nodes (N nodes for a single sequence, none for N = 0); distances are consumed
+std::vector<GuideNode> guide_tree(std::vector<float>& distances, int N, GuideTreeMethod method);
+
+//progressive_align: aligned rows, in the order of sequences; at most PROFILE_MAX_ROWS
+//sequences (Profile.h), none holding '-'
+std::vector<std::string> progressive_align(const std::vector<std::string>& sequences, const MsaConfig& config);
+
+//sum_of_pairs: score of an alignment, summed over every pair of its rows
+long long sum_of_pairs(const std::vector<std::string>& rows, const Scoring& sc);
+
+#endif //MSA_H
@@ -7,6 +7,7 @@
  * This C++ code implements the Needleman-Wunsch algorithm for global sequence alignment.
  * The algorithm is used to find the optimal alignment between two sequences of symbols as defined in [1]. It employs dynamic programming to compute
  * the optimal alignment score and traceback to determine the aligned sequences.
+ * The engine itself lives in the alignment library (Alignment.h).
  *
  * References:
  * - [1] Needleman, S. B., & Wunsch, C. D. (1970). A general method applicable to the search for similarities
@@ -14,28 +15,58 @@
  *
  * Usage:
  * - Compile and run the code, providing input sequences as argv[1] and argv[2].
- * - Adjust parameter scores as desired.
+ * - Adjust parameter scores as desired (Scoring.h).
  * - The output will include the optimal alignment score and the aligned sequences.
+ * - --stats prints cells and fill/traceback timings as JSON on stderr.
+ * - --cache FILE returns the alignment from a result cache (ResultCache.h) kept in FILE when
+ *   the pair was aligned before, and stores it there otherwise.
+ * - --ties left|right picks the optimal alignment with its gaps left-aligned (the default)
+ *   or right-aligned; --count also prints the number of co-optimal alignments, and
+ *   --all N prints up to N of them.
  *
  */
 
 #include <iostream>
-#include <vector>
+#include <cstdlib>
 #include <cstring>
-#include <cmath>
+#include <chrono>
 
-#define GAP_PENALTY -1
-#define MISMATCH_SCORE -1
-#define MATCH_SCORE 1
-
-//Useful tools
-int max3(int a, int b, int c);
-int match_or_mismatch(char c1, char c2);
-void printmatrix(int n, int m, int* M);
-int score(char c1, char c2);
+#include "Alignment.h"
+#include "ResultCache.h"
+#include "Stats.h"
 
 int main(int argc, char* argv[])
 {
+    AlignerConfig config = default_config();
+    config.engine = ENGINE_NEEDLEMAN_WUNSCH;
+
+    //--stats, --cache, --ties, --count and --all may appear anywhere on the command line
+    const char* cache_file = NULL;
+    int all = 0;
+    int kept = 1;
+    for (int a=1; a<argc; a++)
+    {
+        if (std::strcmp(argv[a], "--stats") == 0) stats_enabled = true;
+        else if (std::strcmp(argv[a], "--cache") == 0 && a+1 < argc) cache_file = argv[++a];
+        else if (std::strcmp(argv[a], "--count") == 0) config.count_optimal = true;
+        else if (std::strcmp(argv[a], "--all") == 0 && a+1 < argc) all = std::atoi(argv[++a]);
+        else if (std::strcmp(argv[a], "--ties") == 0 && a+1 < argc)
+        {
+            a++;
+            if (std::strcmp(argv[a], "left") == 0) config.ties = TIES_LEFT;
+            else if (std::strcmp(argv[a], "right") == 0) config.ties = TIES_RIGHT;
+            else
+            {
+                std::cerr << "--ties takes left or right, not " << argv[a] << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+        }
+        else argv[kept++] = argv[a];
+    }
+    argc = kept;
+    argv[argc] = NULL;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
     if(!argv[1] || !argv[2])
     {
         std::cerr << "Please, insert sequences to confront:" << std::endl
@@ -43,118 +74,50 @@ int main(int argc, char* argv[])
                 <<"• Sequence2 as argv[2]" << std::endl;
         std::exit(EXIT_FAILURE);
     }
-    
-    const std::string s1 = argv[1], s2 = argv[2];
-    const int n = s1.length(), m = s2.length();
-    
-    int M[n+1][m+1];
-    //STEP 1: assign first row and column
-    M[0][0] = 0;
-    for (int i=1;i<n+1;i++)
-    {
-        M[i][0] = M[i-1][0] + GAP_PENALTY;
-    }
-    for (int i=1;i<m+1;i++)
-    {
-        M[0][i] = M[0][i-1] + GAP_PENALTY;
-    }
-    
-    //STEP 2: Needelman-Wunsch matrix
-    for (int i=1;i<n+1;i++)
-    {
-        for (int j=1;j<m+1;j++)
-        {
-            M[i][j] = max3(M[i-1][j-1] + match_or_mismatch(s1[i-1], s2[j-1]),
-                          M[i][j-1] + GAP_PENALTY,
-                          M[i-1][j] + GAP_PENALTY);
-        }
-    }
-    
-    //DEBUG
-    #ifdef DEBUG
-        printmatrix(n+1, m+1, &M[0][0]);
-    #endif //DEBUG
 
-    //STEP 3: Rebuild alignments 
-    std::string A_1 = "";
-    std::string A_2 = "";
-    int i = n, j = m;
-    while (i>0 || j>0)
+    ResultCache results(RC_MEMORY_BYTES);
+    std::string error;
+    if (cache_file && !results.open(cache_file, error))
     {
-        if (i>0 
-            && j>0 
-            && (M[i][j] == M[i-1][j-1] + match_or_mismatch(s1[i-1], s2[j-1])))
-        {
-            A_1 = s1[i-1] + A_1;
-            A_2 = s2[j-1] + A_2;
-            i--;
-            j--;
-        }
-
-        else if (i>0 
-            && (M[i][j] == M[i-1][j] + GAP_PENALTY))
-        {
-            A_1 = s1[i-1] + A_1;
-            A_2 = '-' + A_2;
-            i--;
-        }
-
-        else 
-        {
-            A_1 = '-' + A_1;
-            A_2 = s2[j-1] + A_2;
-            j--;
-        }
+        std::cerr << error << std::endl;
+        std::exit(EXIT_FAILURE);
     }
-    
-    std::cout << "Optimal score alignment = " << M[n][m] << std::endl;
-    std::cout << "A_1 : "  << A_1 << std::endl;
-    std::cout << "A_2 : "  << A_2 << std::endl;
-
-    return 0;
-}
 
+    //--all traces the listed alignments out of the matrix of the returned one, past the cache
+    const Aligner aligner(config);
+    CoOptimalList listed;
+    listed.limit = all;
+    const AlignResult r = all > 0
+        ? aligner.co_optimal(argv[1], std::strlen(argv[1]), argv[2], std::strlen(argv[2]), listed, thread_arena())
+        : align_cached(aligner, cache_file ? &results : NULL, argv[1], std::strlen(argv[1]), argv[2],
+                       std::strlen(argv[2]), thread_arena());
 
-//Functions
-//Return maximum of three integers
-int max3(int a, int b, int c)
-{
-    if (a >= b && a >= c) return a;
-    else if (b >= a && b >= c) return b;
-    else return c;
-}
-
-//Evaluate if diagonal outcome of Needleman-Wunsch
-int match_or_mismatch(char c1, char c2)
-{
-    return (c1 == c2) ? MATCH_SCORE : MISMATCH_SCORE;
-}
-
-
-//Print the matrix
-void printmatrix(int n, int m, int* M)
-{
-    int count =0;
-    for (int i=0;i<(n*m);i++)
     {
-        //style
-        if (M[i]>= 0)
-        {
-            std::cout << " " << M[i] << "  ";
-        }
-        else
+        StatsTimer io(&AlignStats::io_seconds);
+        std::cout << "Optimal score alignment = " << r.score << std::endl;
+        std::cout << "A_1 : ";
+        std::cout.write(r.A_1, r.length) << std::endl;
+        std::cout << "A_2 : ";
+        std::cout.write(r.A_2, r.length) << std::endl;
+        if (config.count_optimal)
         {
-            std::cout << M[i] << "  ";
+            std::cout << "Co-optimal alignments = ";
+            if (r.optimal < 9007199254740992.0) std::cout << (unsigned long long)r.optimal << std::endl;
+            else std::cout << r.optimal << std::endl;
         }
-        
-        //endline
-        count++;
-        if (count == m)
+        for (std::size_t k=0; k<listed.alignments.size(); k++)
         {
-            std::cout << std::endl;
-            count = 0;
+            std::cout << std::endl << "A_1 : " << listed.alignments[k].first << std::endl;
+            std::cout << "A_2 : " << listed.alignments[k].second << std::endl;
         }
     }
-}
 
+    if (stats_enabled)
+    {
+        thread_stats().pairs++;
+        stats_record_arena(thread_arena());
+        stats_write_json(std::cerr, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
 
+    return 0;
+}
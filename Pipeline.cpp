@@ -0,0 +1,407 @@
+/*
+ * Pipeline: read, align and write stages joined by rings, see Pipeline.h
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "Pipeline.h"
+#include "Fasta.h"
+#include "Rings.h"
+#include "Schedule.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+
+//PipeBatch: pooled buffers of consecutive pairs, reused from one batch to the next
+struct PipeBatch
+{
+    long index;                         //position in the input, in batches
+    std::string residues;               //distinct sequences of the pairs, back to back
+    std::vector<long> starts;           //offsets of X and Y of each pair in residues
+    std::vector<int> interned;          //open-addressing table of sequence indices + 1 (2k: X of pair k)
+    std::vector<BatchPair> pairs;
+    std::vector<long> earlier;          //run-wide dedup: distinct pair of an earlier first copy, or -1
+    std::vector<char> known;            //earlier[k] >= 0, for plan_batch
+    BatchPlan plan;
+    BatchOutput output;
+    std::atomic<int> remaining;         //jobs not finished yet
+    std::string text;                   //the formatted output
+};
+
+//RunDedup: the distinct pairs of the run, numbered in input order. The reader marks the
+//later copies of a pair and keeps them out of the plan; the writer, which sees the first
+//copy before any other, keeps its result and writes the copies from it
+struct RunDedup
+{
+    std::unordered_map<CacheKey, long, CacheKeyHash> first;    //reader: key to distinct pair
+    std::vector<int> scores;                                    //writer: by distinct pair
+    std::vector<std::string> cigars;                            //writer, MODE_ALIGN only
+};
+
+//WindowJob: a job of one of the batches handed to the pool together
+struct WindowJob
+{
+    double cost;
+    PipeBatch* batch;
+    int job;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+//Useful tools
+static void read_stage(std::istream& in, PipeInput input, const Aligner& aligner, ResultCache* cache,
+                       RunDedup* dedup, ThreadPool& pool, std::vector<StageStats>& align_stats,
+                       SpscRing<PipeBatch*>& free_batches, MpmcRing<PipeBatch*>& aligned, StageStats& stats,
+                       std::string& error);
+static void align_job(const Aligner& aligner, PipeBatch* batch, int job, MpmcRing<PipeBatch*>& aligned,
+                      StageStats& stats);
+static void write_stage(std::ostream& out, bool score_only, RunDedup* dedup, int batches,
+                        MpmcRing<PipeBatch*>& aligned, SpscRing<PipeBatch*>& free_batches, StageStats& stats);
+static void add_pair(PipeBatch& batch, const char* X, long n, const char* Y, long m);
+static void intern(PipeBatch& batch, const char* S, long length);
+static double seconds_since(Clock::time_point start);
+
+//take: pops from ring, adding the time spent waiting for an item to waited
+template <typename Ring>
+static PipeBatch* take(Ring& ring, double& waited)
+{
+    PipeBatch* batch;
+    if (ring.try_pop(batch)) return batch;
+    const Clock::time_point start = Clock::now();
+    ring.pop(batch);
+    waited += seconds_since(start);
+    return batch;
+}
+
+//give: pushes to ring, adding the time spent waiting for room to waited
+template <typename Ring>
+static void give(Ring& ring, PipeBatch* batch, double& waited)
+{
+    if (ring.try_push(batch)) return;
+    const Clock::time_point start = Clock::now();
+    ring.push(batch);
+    waited += seconds_since(start);
+}
+
+
+bool run_pipeline(std::istream& in, PipeInput input, const Aligner& aligner, ResultCache* cache, bool dedup,
+                  int threads, std::ostream& out, PipelineStats& stats, std::string& error)
+{
+    const Clock::time_point start = Clock::now();
+    ThreadPool pool(threads);
+    const int workers = pool.size();
+    const int count = PIPE_BATCHES_PER_THREAD * workers;
+
+    //every batch starts free; the ring to the writer also carries the end marker (NULL)
+    std::vector<PipeBatch> batches(count);
+    SpscRing<PipeBatch*> free_batches(count);
+    MpmcRing<PipeBatch*> aligned(count + 1);
+    for (int k=0; k<count; k++)
+    {
+        free_batches.push(&batches[k]);
+    }
+
+    StageStats empty = { 1, 0, 0, 0, 0, 0 };
+    stats.read = stats.align = stats.write = empty;
+    std::vector<StageStats> align_stats(workers, empty);
+    error.clear();
+
+    RunDedup distinct;
+    RunDedup* run_dedup = dedup ? &distinct : NULL;
+    std::thread reader(read_stage, std::ref(in), input, std::cref(aligner), cache, run_dedup, std::ref(pool),
+                       std::ref(align_stats), std::ref(free_batches), std::ref(aligned), std::ref(stats.read),
+                       std::ref(error));
+    write_stage(out, aligner.config().mode == MODE_SCORE, run_dedup, count, aligned, free_batches, stats.write);
+    reader.join();
+    stats.seconds = seconds_since(start);
+
+    //an align thread is starved whenever it is not running a batch
+    stats.align.threads = workers;
+    for (int t=0; t<workers; t++)
+    {
+        stats.align.batches += align_stats[t].batches;
+        stats.align.pairs += align_stats[t].pairs;
+        stats.align.busy_seconds += align_stats[t].busy_seconds;
+        stats.align.blocked_seconds += align_stats[t].blocked_seconds;
+    }
+    const double idle = workers * stats.seconds - stats.align.busy_seconds - stats.align.blocked_seconds;
+    stats.align.starved_seconds = idle > 0 ? idle : 0;
+    return error.empty();
+}
+
+
+double stage_utilization(const StageStats& stage, double seconds)
+{
+    return seconds > 0 ? stage.busy_seconds / (stage.threads * seconds) : 0;
+}
+
+void pipeline_write_json(std::ostream& out, const PipelineStats& stats)
+{
+    const StageStats* stages[3] = { &stats.read, &stats.align, &stats.write };
+    const char* names[3] = { "read", "align", "write" };
+    out << "{\"pipeline\": {\"seconds\": " << stats.seconds;
+    for (int s=0; s<3; s++)
+    {
+        const StageStats& st = *stages[s];
+        out << ", \"" << names[s] << "\": {"
+            << "\"threads\": " << st.threads
+            << ", \"batches\": " << st.batches
+            << ", \"pairs\": " << st.pairs
+            << ", \"busy\": " << st.busy_seconds
+            << ", \"starved\": " << st.starved_seconds
+            << ", \"blocked\": " << st.blocked_seconds
+            << ", \"utilization\": " << stage_utilization(st, stats.seconds)
+            << "}";
+    }
+    out << "}}" << std::endl;
+}
+
+
+//Functions
+//read_stage: fills free batches from the input, plans them and submits the jobs of every
+//window of pool.size() batches to the pool, most expensive first; the end marker
+//follows the last aligned batch
+static void read_stage(std::istream& in, PipeInput input, const Aligner& aligner, ResultCache* cache,
+                       RunDedup* dedup, ThreadPool& pool, std::vector<StageStats>& align_stats,
+                       SpscRing<PipeBatch*>& free_batches, MpmcRing<PipeBatch*>& aligned, StageStats& stats,
+                       std::string& error)
+{
+    const Clock::time_point start = Clock::now();
+    FastaReader fasta(in);
+    FastaRecord first, second;
+    std::string line;
+    std::vector<WindowJob> window;
+    int window_batches = 0;
+    long index = 0;
+    bool more = true;
+    while (more)
+    {
+        PipeBatch* batch = take(free_batches, stats.blocked_seconds);
+        batch->index = index++;
+        batch->residues.clear();
+        batch->starts.clear();
+        batch->pairs.clear();
+        batch->interned.assign(PIPE_INTERN_SLOTS, 0);
+        while (batch->pairs.size() < PIPE_BATCH_PAIRS && batch->residues.size() < PIPE_BATCH_RESIDUES)
+        {
+            StatsTimer io(&AlignStats::io_seconds);
+            if (input == PIPE_FASTA)
+            {
+                if (!(more = fasta.next(first))) break;
+                if (!fasta.next(second))
+                {
+                    error = "odd number of records: " + first.name + " has no partner";
+                    more = false;
+                    break;
+                }
+                io.stop();
+                add_pair(*batch, first.sequence.data(), first.sequence.size(),
+                         second.sequence.data(), second.sequence.size());
+                continue;
+            }
+
+            //"seq1 seq2", blank lines skipped
+            if (!(more = static_cast<bool>(std::getline(in, line)))) break;
+            io.stop();
+            const char* c = line.data();
+            const char* end = c + line.size();
+            while (c < end && std::isspace((unsigned char)*c)) c++;
+            const char* X = c;
+            while (c < end && !std::isspace((unsigned char)*c)) c++;
+            const long n = c - X;
+            while (c < end && std::isspace((unsigned char)*c)) c++;
+            const char* Y = c;
+            while (c < end && !std::isspace((unsigned char)*c)) c++;
+            if (n > 0 || c > Y) add_pair(*batch, X, n, Y, c - Y);
+        }
+
+        //residues no longer moves: the pairs can point into it
+        for (std::size_t k=0; k<batch->pairs.size(); k++)
+        {
+            batch->pairs[k].X = batch->residues.data() + batch->starts[2*k];
+            batch->pairs[k].Y = batch->residues.data() + batch->starts[2*k+1];
+        }
+        stats.batches++;
+        stats.pairs += batch->pairs.size();
+
+        //run-wide copies of an earlier pair, in this batch or before, are left to the writer
+        batch->earlier.assign(batch->pairs.size(), -1);
+        batch->known.assign(batch->pairs.size(), 0);
+        for (std::size_t k=0; dedup && k<batch->pairs.size(); k++)
+        {
+            const BatchPair& p = batch->pairs[k];
+            const CacheKey key = ResultCache::key(aligner.config(), p.X, p.n, p.Y, p.m);
+            const long next = dedup->first.size();
+            const long id = dedup->first.emplace(key, next).first->second;
+            if (id == next) continue;
+            batch->earlier[k] = id;
+            batch->known[k] = 1;
+            if (stats_enabled) thread_stats().duplicates++;
+        }
+
+        plan_batch(batch->pairs.data(), batch->pairs.size(), aligner, cache, batch->plan, batch->output,
+                   batch->known.data());
+        const int jobs = batch->plan.jobs.size();
+        batch->remaining.store(jobs);
+        if (jobs == 0) give(aligned, batch, stats.blocked_seconds);
+        for (int j=0; j<jobs; j++)
+        {
+            const WindowJob w = { batch->plan.jobs[j].cost, batch, j };
+            window.push_back(w);
+        }
+        if (++window_batches < pool.size() && more) continue;
+
+        std::stable_sort(window.begin(), window.end(), [](const WindowJob& a, const WindowJob& b)
+        {
+            return a.cost > b.cost;
+        });
+        for (std::size_t w=0; w<window.size(); w++)
+        {
+            const WindowJob job = window[w];
+            pool.submit([&aligner, &aligned, &align_stats, job]
+            {
+                align_job(aligner, job.batch, job.job, aligned, align_stats[ThreadPool::worker_index()]);
+            });
+        }
+        window.clear();
+        window_batches = 0;
+    }
+    stats.busy_seconds = seconds_since(start) - stats.blocked_seconds;
+    pool.wait();
+    aligned.push(NULL);
+}
+
+//align_job: runs one job of a batch on a pool worker, stats being the worker's; the last
+//job of the batch hands it to the writer
+static void align_job(const Aligner& aligner, PipeBatch* batch, int job, MpmcRing<PipeBatch*>& aligned,
+                      StageStats& stats)
+{
+    const Clock::time_point start = Clock::now();
+    const double blocked = stats.blocked_seconds;
+    run_job(aligner, batch->plan, batch->plan.jobs[job], thread_arena(), batch->output);
+    stats_record_arena(thread_arena());
+    stats.pairs += batch->plan.jobs[job].count;
+    if (batch->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        stats.batches++;
+        give(aligned, batch, stats.blocked_seconds);
+    }
+    stats.busy_seconds += seconds_since(start) - (stats.blocked_seconds - blocked);
+}
+
+//write_stage: writes the batches in input order and returns them to the reader; batch
+//k waits in slot k % batches, which no other batch in flight can hold. With dedup, the
+//result of every first copy is kept for the later ones
+static void write_stage(std::ostream& out, bool score_only, RunDedup* dedup, int batches,
+                        MpmcRing<PipeBatch*>& aligned, SpscRing<PipeBatch*>& free_batches, StageStats& stats)
+{
+    const Clock::time_point start = Clock::now();
+    std::vector<PipeBatch*> pending(batches, NULL);
+    std::string copy;
+    long next = 0;
+    for (;;)
+    {
+        PipeBatch* batch = take(aligned, stats.starved_seconds);
+        if (batch == NULL) break;
+        pending[batch->index % batches] = batch;
+
+        while ((batch = pending[next % batches]) != NULL)
+        {
+            StatsTimer io(&AlignStats::io_seconds);
+            std::string& text = batch->text;
+            text.clear();
+            const BatchOutput& output = batch->output;
+            for (std::size_t k=0; k<batch->pairs.size(); k++)
+            {
+                const long id = batch->earlier[k];
+                const BatchPair& p = batch->pairs[k];
+                const int score = id >= 0 ? dedup->scores[id] : output.score(k);
+                const char* A_1 = output.row_1(k);
+                const char* A_2 = output.row_2(k);
+                int length = output.length(k);
+                if (id >= 0 && !score_only)
+                {
+                    const std::string& cigar = dedup->cigars[id];
+                    copy.resize(2 * ((std::size_t)p.n + p.m));
+                    length = rows_from_cigar(cigar.data(), cigar.size(), p.X, p.n, p.Y, p.m,
+                                             &copy[0], &copy[p.n + p.m]);
+                    A_1 = copy.data();
+                    A_2 = copy.data() + p.n + p.m;
+                }
+                else if (dedup && id < 0)
+                {
+                    dedup->scores.push_back(score);
+                    if (!score_only)
+                    {
+                        dedup->cigars.push_back(std::string());
+                        cigar_from_rows(A_1, A_2, length, dedup->cigars.back());
+                    }
+                }
+
+                if (score_only)
+                {
+                    text += std::to_string(score);
+                    text += '\n';
+                    continue;
+                }
+                text.append(A_1, length);
+                text += '\n';
+                text.append(A_2, length);
+                text += '\n';
+            }
+            out.write(text.data(), text.size());
+
+            pending[next % batches] = NULL;
+            next++;
+            stats.batches++;
+            stats.pairs += batch->pairs.size();
+            give(free_batches, batch, stats.blocked_seconds);
+        }
+    }
+    out.flush();
+    stats.busy_seconds = seconds_since(start) - stats.starved_seconds - stats.blocked_seconds;
+}
+
+//add_pair: adds X and Y to the batch; the pointers are set once the batch is full
+static void add_pair(PipeBatch& batch, const char* X, long n, const char* Y, long m)
+{
+    const BatchPair p = { NULL, (int)n, NULL, (int)m };
+    batch.pairs.push_back(p);
+    intern(batch, X, n);
+    intern(batch, Y, m);
+}
+
+//intern: offset of the batch's next sequence, the one of an equal sequence already in
+//residues, else appended there
+static void intern(PipeBatch& batch, const char* S, long length)
+{
+    const std::size_t mask = batch.interned.size() - 1;
+    std::size_t s = std::hash<std::string_view>()(std::string_view(S, length)) & mask;
+    for (; batch.interned[s] != 0; s = (s + 1) & mask)
+    {
+        const int other = batch.interned[s] - 1;
+        const BatchPair& q = batch.pairs[other / 2];
+        if ((other % 2 ? q.m : q.n) == length
+            && std::memcmp(batch.residues.data() + batch.starts[other], S, length) == 0)
+        {
+            batch.starts.push_back(batch.starts[other]);
+            return;
+        }
+    }
+    batch.interned[s] = batch.starts.size() + 1;
+    batch.starts.push_back(batch.residues.size());
+    batch.residues.append(S, length);
+}
+
+static double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
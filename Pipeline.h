@@ -0,0 +1,92 @@
+/*
+ * Pipeline: batch alignment as three stages on their own threads
+ *
+ * - read: one thread parses the input into pooled batches of up to PIPE_BATCH_PAIRS pairs
+ *   (or PIPE_BATCH_RESIDUES residues). A sequence equal to one already in the batch is
+ *   stored once, and identical pairs are aligned once (Schedule.h), so a batch of
+ *   duplicate reads takes as much memory and time as its distinct reads. Each batch keeps
+ *   its buffers between uses, so once the pool is warm, parsing makes no heap calls.
+ *   With dedup, a pair equal to any earlier pair of the run is not aligned at all: the
+ *   reader numbers the distinct pairs by key (ResultCache::key) and the writer, which
+ *   meets every first copy before its copies, writes them from its result. Each distinct
+ *   pair keeps its key, score and CIGAR in memory until the end of the run.
+ * - align: a ThreadPool (ThreadPool.h). The reader cuts each batch into jobs with
+ *   plan_batch (Schedule.h): length buckets of BATCH_LANES short pairs and one job per
+ *   long pair. It submits the jobs of pool.size() batches at a time to the pool's
+ *   injection queue, most expensive first, and a worker runs each with its own
+ *   thread_arena(). The results are copied back into the batch, and the worker that
+ *   finishes its last job hands it on. On a long pair, the Hirschberg splits become
+ *   subtasks that idle workers steal, so one 1 Mb pair does not hold the batch up on a
+ *   single core.
+ * - write: one thread puts the batches back in input order, formats them as
+ *   Hirschberg --batch does and writes them out.
+ * Aligned batches go to the writer over an MpmcRing (Rings.h) and back to the reader
+ * over an SpscRing. There are PIPE_BATCHES_PER_THREAD batches per align thread, so a
+ * stage that runs ahead waits for a free batch instead of buffering the whole input.
+ *
+ * Each stage reports its wall time split into busy, starved (waiting for input) and
+ * blocked (waiting for room downstream). Utilization is its busy share: the stage
+ * close to 1 is the bottleneck. Align threads count as busy while they run a job;
+ * subtasks they steal from another batch count as starved time.
+ *
+ * Usage:
+ *   PipelineStats stats;
+ *   std::string error;
+ *   if (!run_pipeline(std::cin, PIPE_LINES, aligner, cache, false, threads, std::cout, stats, error)) ...
+ *
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <istream>
+#include <ostream>
+#include <string>
+
+#include "Alignment.h"
+#include "ResultCache.h"
+
+#define PIPE_BATCH_PAIRS (8 * BATCH_LANES)
+#define PIPE_BATCH_RESIDUES (1 << 20)
+#define PIPE_BATCHES_PER_THREAD 4
+#define PIPE_INTERN_SLOTS (4 * PIPE_BATCH_PAIRS)       //sequence table of a batch, at most half full
+
+//PipeInput: how the reader finds pairs
+enum PipeInput
+{
+    PIPE_LINES,             //"seq1 seq2" per line, as Hirschberg --batch
+    PIPE_FASTA              //FASTA records 2k and 2k+1 form pair k
+};
+
+struct StageStats
+{
+    int threads;
+    long long batches;
+    long long pairs;
+    double busy_seconds;            //summed over the stage's threads
+    double starved_seconds;
+    double blocked_seconds;
+};
+
+struct PipelineStats
+{
+    StageStats read;
+    StageStats align;
+    StageStats write;
+    double seconds;                 //wall time of the whole pipeline
+};
+
+//run_pipeline: aligns (or scores, per the aligner's mode) every pair of in and writes
+//the results to out in input order, through cache unless it is NULL; with dedup, each
+//distinct pair of the run once. threads <= 0 runs one align thread per hardware thread.
+//False with a message in error on malformed input; the pairs before it are written
+bool run_pipeline(std::istream& in, PipeInput input, const Aligner& aligner, ResultCache* cache, bool dedup,
+                  int threads, std::ostream& out, PipelineStats& stats, std::string& error);
+
+//stage_utilization: busy share of the stage's threads over the pipeline's wall time
+double stage_utilization(const StageStats& stage, double seconds);
+
+//pipeline_write_json: the stage metrics as one JSON object
+void pipeline_write_json(std::ostream& out, const PipelineStats& stats);
+
+#endif //PIPELINE_H
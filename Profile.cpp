@@ -0,0 +1,291 @@
+/*
+ * Profile: profile engines, see Profile.h
+ */
+
+#include "Alignment.h"
+#include "Profile.h"
+#include "Stats.h"
+
+static inline long long max3ll(long long a, long long b, long long c)
+{
+    if (a >= b && a >= c) return a;
+    else if (b >= a && b >= c) return b;
+    else return c;
+}
+
+//dot: equal residue pairs of two profile columns; the padded stride lets the loop vectorise
+static inline int dot(const int16_t* __restrict__ a, const int16_t* __restrict__ b, int stride)
+{
+    int same = 0;
+    for (int c=0; c<stride; c++)
+    {
+        same += a[c] * b[c];
+    }
+    return same;
+}
+
+//same_cell: equal residue pairs of column i of A and column j of B
+static inline int same_cell(const ProfileView& A, int i, const ProfileView& B, int j)
+{
+    if (A.residues && B.residues) return A.residues[i] == B.residues[j];
+    if (A.residues) return B.freq[(std::size_t)j * B.stride + A.residues[i]];
+    if (B.residues) return A.freq[(std::size_t)i * A.stride + B.residues[j]];
+    return dot(A.freq + (std::size_t)i * A.stride, B.freq + (std::size_t)j * B.stride, A.stride);
+}
+
+static inline int gaps_of(const ProfileView& v, int k)
+{
+    return v.residues ? 0 : v.gaps[k];
+}
+
+//RowFill: the columns of B in the order a fill reads them (backwards when reversed), and
+//the substitution scores of one row of A against all of them
+class RowFill
+{
+public:
+    RowFill(const ProfileView& A, const ProfileView& B, bool reversed, const Scoring& sc, Arena& arena)
+        : A(A), B(B), reversed(reversed), sc(sc)
+    {
+        const int m = B.length;
+        same = arena.alloc<int>(m+1);
+        b_residues = arena.alloc<int>(m+1);
+        b_gaps = arena.alloc<int>(m+1);
+        left = arena.alloc<long long>(m+1);
+        sub = arena.alloc<long long>(m+1);
+        for (int j=1; j<=m; j++)
+        {
+            const int k = column(j, m);
+            b_gaps[j] = gaps_of(B, k);
+            b_residues[j] = B.rows - b_gaps[j];
+            left[j] = (long long)sc.gap * b_residues[j] * A.rows;
+        }
+    }
+
+    //column: position in the view of the j-th column read (j from 1) out of length
+    int column(int j, int length) const
+    {
+        return reversed ? length-j : j-1;
+    }
+
+    //row: sub[1...m] for the i-th column of A read (i from 1); returns its cost against gaps
+    long long row(int i)
+    {
+        const int m = B.length;
+        const int a = column(i, A.length);
+        const int ga = gaps_of(A, a);
+        const long long ra = A.rows - ga;
+
+        //PASS 1: equal pairs, one loop per kind of operand so that each is a plain gather or dot product
+        if (A.residues && B.residues)
+        {
+            const unsigned char x = A.residues[a];
+            for (int j=1; j<=m; j++) same[j] = B.residues[column(j, m)] == x;
+        }
+        else if (A.residues)
+        {
+            const int16_t* f = B.freq + A.residues[a];
+            for (int j=1; j<=m; j++) same[j] = f[(std::size_t)column(j, m) * B.stride];
+        }
+        else if (B.residues)
+        {
+            const int16_t* f = A.freq + (std::size_t)a * A.stride;
+            for (int j=1; j<=m; j++) same[j] = f[B.residues[column(j, m)]];
+        }
+        else
+        {
+            const int16_t* f = A.freq + (std::size_t)a * A.stride;
+            for (int j=1; j<=m; j++) same[j] = dot(f, B.freq + (std::size_t)column(j, m) * B.stride, A.stride);
+        }
+
+        //PASS 2: sum-of-pairs scores, no dependency between cells
+        const long long diff = sc.match - sc.mismatch;
+        for (int j=1; j<=m; j++)
+        {
+            sub[j] = diff * same[j] + sc.mismatch * ra * b_residues[j] + sc.gap * (ra * b_gaps[j] + ga * b_residues[j]);
+        }
+        return (long long)sc.gap * ra * B.rows;
+    }
+
+    long long* left;            //left[j]: the j-th column of B against gaps
+    long long* sub;             //sub[j]: after row(), the i-th column of A against the j-th of B
+
+private:
+    const ProfileView& A;
+    const ProfileView& B;
+    bool reversed;
+    const Scoring& sc;
+    int* same;
+    int* b_residues;
+    int* b_gaps;
+};
+
+
+void profile_score_row(const ProfileView& A, const ProfileView& B, bool reversed, const Scoring& sc,
+                       Arena& arena, long long* Lastline)
+{
+    StatsTimer fill(&AlignStats::fill_seconds);
+    const int n = A.length, m = B.length;
+    if (stats_enabled) thread_stats().cells += (unsigned long long)n * m;
+    const ArenaMark start = arena.mark();
+    RowFill rows(A, B, reversed, sc, arena);
+
+    //Step 1: first row, B's columns against gaps; the row is then updated in place
+    Lastline[0] = 0;
+    for (int j=1; j<=m; j++)
+    {
+        Lastline[j] = Lastline[j-1] + rows.left[j];
+    }
+
+    for (int i=1; i<=n; i++)
+    {
+        const long long up_gap = rows.row(i);
+        const long long* left = rows.left;
+        const long long* sub = rows.sub;
+        long long diag = Lastline[0];
+        Lastline[0] += up_gap;
+        for (int j=1; j<=m; j++)
+        {
+            const long long up = Lastline[j];
+            Lastline[j] = max3ll(Lastline[j-1] + left[j], up + up_gap, diag + sub[j]);
+            diag = up;
+        }
+    }
+    arena.rewind(start);
+}
+
+long long profile_nw_into(const ProfileView& A, const ProfileView& B, const Scoring& sc, Arena& arena,
+                          char* ops, int& len)
+{
+    const ArenaMark start = arena.mark();
+    const int n = A.length, m = B.length;
+    const int w = m+1;
+    long long* M = arena.alloc<long long>((std::size_t)(n+1)*w);
+    long long* up_gaps = arena.alloc<long long>(n+1);
+    RowFill rows(A, B, false, sc, arena);
+    {
+        StatsTimer fill(&AlignStats::fill_seconds);
+        if (stats_enabled) thread_stats().cells += (unsigned long long)n * m;
+
+        //STEP 1: first row and column, whole columns against gaps
+        M[0] = 0;
+        for (int j=1; j<=m; j++)
+        {
+            M[j] = M[j-1] + rows.left[j];
+        }
+
+        //STEP 2: Needleman-Wunsch over columns
+        for (int i=1; i<=n; i++)
+        {
+            const long long up_gap = rows.row(i);
+            up_gaps[i] = up_gap;
+            const long long* left = rows.left;
+            const long long* sub = rows.sub;
+            long long* row = M + (std::size_t)i*w;
+            const long long* above = row - w;
+            row[0] = above[0] + up_gap;
+            for (int j=1; j<=m; j++)
+            {
+                row[j] = max3ll(above[j-1] + sub[j], row[j-1] + left[j], above[j] + up_gap);
+            }
+        }
+    }
+
+    //STEP 3: operations backwards, then copied after position len
+    StatsTimer traceback(&AlignStats::traceback_seconds);
+    const long long diff = sc.match - sc.mismatch;
+    char* R = arena.alloc<char>(n+m);
+    int k = 0;
+    int i = n, j = m;
+    while (i>0 || j>0)
+    {
+        const long long here = M[(std::size_t)i*w+j];
+        long long diagonal = 0;
+        if (i>0 && j>0)
+        {
+            const long long ra = A.rows - gaps_of(A, i-1), ga = gaps_of(A, i-1);
+            const long long rb = B.rows - gaps_of(B, j-1), gb = gaps_of(B, j-1);
+            diagonal = diff * same_cell(A, i-1, B, j-1) + sc.mismatch * ra * rb + sc.gap * (ra * gb + ga * rb);
+        }
+        if (i>0 && j>0 && here == M[(std::size_t)(i-1)*w+j-1] + diagonal)
+        {
+            R[k] = 'M';
+            i--;
+            j--;
+        }
+        else if (i>0 && here == M[(std::size_t)(i-1)*w+j] + up_gaps[i])
+        {
+            R[k] = 'I';
+            i--;
+        }
+        else
+        {
+            R[k] = 'D';
+            j--;
+        }
+        k++;
+    }
+
+    for (int t=0; t<k; t++)
+    {
+        ops[len+t] = R[k-1-t];
+    }
+    len += k;
+    const long long score = M[(std::size_t)n*w + m];
+    arena.rewind(start);
+    return score;
+}
+
+void profile_hirschberg_into(const ProfileView& A, const ProfileView& B, const Scoring& sc, Arena& arena,
+                             char* ops, int& len)
+{
+    const int n = A.length, m = B.length;
+    if (stats_enabled)
+    {
+        AlignStats& stats = thread_stats();
+        stats.nodes++;
+        if (++stats.depth > stats.max_depth) stats.max_depth = stats.depth;
+    }
+
+    if (n==0)
+    {
+        for (int j=0; j<m; j++) ops[len++] = 'D';
+    }
+    else if (m==0)
+    {
+        for (int i=0; i<n; i++) ops[len++] = 'I';
+    }
+    else if (n==1 || m==1)
+    {
+        profile_nw_into(A, B, sc, arena, ops, len);
+    }
+    else
+    {
+        const int xmid = n/2;
+        const ArenaMark start = arena.mark();
+
+        //same split as Hirschberg_into(): forward row on the first half, backward row on the second
+        long long* scoreL = arena.alloc<long long>(m+1);
+        long long* scoreR = arena.alloc<long long>(m+1);
+        profile_score_row(profile_columns(A, 0, xmid), B, false, sc, arena, scoreL);
+        profile_score_row(profile_columns(A, xmid, n - xmid), B, true, sc, arena, scoreR);
+
+        int ymid = 0;
+        for (int j=1; j<=m; j++)
+        {
+            if (scoreL[ymid] + scoreR[m-ymid] < scoreL[j] + scoreR[m-j]) ymid = j;
+        }
+        arena.rewind(start);
+
+        profile_hirschberg_into(profile_columns(A, 0, xmid), profile_columns(B, 0, ymid), sc, arena, ops, len);
+        profile_hirschberg_into(profile_columns(A, xmid, n - xmid), profile_columns(B, ymid, m - ymid), sc, arena, ops, len);
+    }
+
+    if (stats_enabled) thread_stats().depth--;
+}
+
+void profile_align_into(const ProfileView& A, const ProfileView& B, const Scoring& sc, Arena& arena,
+                        char* ops, int& len)
+{
+    if ((double)(A.length+1)*(B.length+1) <= AUTO_NW_MAX_CELLS) profile_nw_into(A, B, sc, arena, ops, len);
+    else profile_hirschberg_into(A, B, sc, arena, ops, len);
+}
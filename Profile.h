@@ -0,0 +1,139 @@
+/*
+ * Profile: columns of a multiple alignment, and the profile engines
+ *
+ * A profile stores, for each column, how many of its rows hold each residue code and
+ * how many hold a gap. The residue counts are a dense int16 vector of stride entries
+ * per column, indexed by code. Entry 0 (the gap code) and the padding up to a multiple
+ * of PROFILE_PAD stay zero. The number of equal pairs between two columns is then a
+ * plain dot product, which vectorises (multiply-add of int16 into int32 lanes). A
+ * single sequence needs no counts: it is a profile of one row given by its residue
+ * codes, and its side of the dot product becomes a lookup.
+ *
+ * Two profiles are aligned column by column with sum-of-pairs scoring:
+ * - The score of two columns sums the Scoring of every pair of characters, one taken
+ *   from each column.
+ * - A residue against a gap costs gap; a gap against a gap costs nothing.
+ * The engines mirror the pairwise ones (Alignment.h): a full-matrix fill with traceback,
+ * a linear-space score row, and the Hirschberg split built on the two. Each row is
+ * filled in two passes. First the substitution scores of the whole row are computed,
+ * with no dependency between cells. Then the recurrence runs over them. Scores are
+ * 64-bit, since a column pair of two large profiles counts up to a billion
+ * character pairs.
+ *
+ * Usage:
+ *   Alphabet alphabet;  alphabet.add(S, n);  ...      //every residue of the family
+ *   ProfileView a = { freq_a, gaps_a, NULL, length_a, rows_a, alphabet.stride() };
+ *   ProfileView y = sequence_view(codes_y, m, alphabet.stride());   //alphabet.encode(Y, m, codes_y)
+ *   char* ops = arena.alloc<char>(a.length + y.length);
+ *   int len = 0;
+ *   profile_align_into(a, y, sc, arena, ops, len);
+ *   //ops[0...len): 'M' column pair, 'I' column of a against gaps, 'D' column of y against gaps
+ *
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstdint>
+
+#include "Arena.h"
+#include "Scoring.h"
+
+//Residue counts of a column are padded to a multiple of this many codes (one 256-bit vector)
+#define PROFILE_PAD 16
+
+//Rows a profile can hold, so that counts fit int16 and equal pairs fit int32
+#define PROFILE_MAX_ROWS 32767
+
+//Alphabet: dense residue codes from 1 on, in order of appearance; '-' is code 0
+struct Alphabet
+{
+    unsigned char code[256];
+    int codes;
+
+    Alphabet() : codes(1)
+    {
+        for (int c=0; c<256; c++) code[c] = 0;
+    }
+
+    //add: gives a code to every residue of S[0...n) not seen yet (at most 255 exist besides '-')
+    void add(const char* S, int n)
+    {
+        for (int i=0; i<n; i++)
+        {
+            unsigned char& c = code[(unsigned char)S[i]];
+            if (c == 0 && S[i] != '-') c = codes++;
+        }
+    }
+
+    //encode: codes of S[0...n) into out
+    void encode(const char* S, int n, unsigned char* out) const
+    {
+        for (int i=0; i<n; i++)
+        {
+            out[i] = code[(unsigned char)S[i]];
+        }
+    }
+
+    //stride: int16 counts per profile column, residue code c at index c
+    int stride() const
+    {
+        return (codes + PROFILE_PAD - 1) / PROFILE_PAD * PROFILE_PAD;
+    }
+};
+
+//ProfileView: columns [0...length) of a profile of rows sequences, or of one sequence
+//when residues is set (a sequence holds no '-')
+struct ProfileView
+{
+    const int16_t* freq;                //length * stride residue counts, column by column
+    const int16_t* gaps;                //gaps of each column
+    const unsigned char* residues;      //codes of a single sequence (freq and gaps unused), else NULL
+    int length;
+    int rows;
+    int stride;
+};
+
+//sequence_view: profile of the single sequence of codes residues[0...length)
+inline ProfileView sequence_view(const unsigned char* residues, int length, int stride)
+{
+    const ProfileView v = { NULL, NULL, residues, length, 1, stride };
+    return v;
+}
+
+//profile_columns: columns [first...first+count) of v
+inline ProfileView profile_columns(const ProfileView& v, int first, int count)
+{
+    ProfileView sub = v;
+    sub.length = count;
+    if (v.residues) sub.residues = v.residues + first;
+    else
+    {
+        sub.freq = v.freq + (std::size_t)first * v.stride;
+        sub.gaps = v.gaps + first;
+    }
+    return sub;
+}
+
+
+//Engines: A[0...n) against B[0...m), scratch from arena, released before returning
+
+//profile_score_row: last line of the score matrix into Lastline[0...m];
+//with reversed=true both profiles are read backwards
+void profile_score_row(const ProfileView& A, const ProfileView& B, bool reversed, const Scoring& sc,
+                       Arena& arena, long long* Lastline);
+
+//profile_nw_into: appends the operations to ops from position len, returns the score
+long long profile_nw_into(const ProfileView& A, const ProfileView& B, const Scoring& sc, Arena& arena,
+                          char* ops, int& len);
+
+//profile_hirschberg_into: appends the operations to ops from position len, in linear space
+void profile_hirschberg_into(const ProfileView& A, const ProfileView& B, const Scoring& sc, Arena& arena,
+                             char* ops, int& len);
+
+//profile_align_into: profile_nw_into up to AUTO_NW_MAX_CELLS, profile_hirschberg_into above;
+//ops must hold A.length + B.length characters
+void profile_align_into(const ProfileView& A, const ProfileView& B, const Scoring& sc, Arena& arena,
+                        char* ops, int& len);
+
+#endif //PROFILE_H
@@ -0,0 +1,244 @@
+/*
+ * Realign: checkpointed forward and backward rows, edits and path stitching, see Realign.h
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "Realign.h"
+#include "Stats.h"
+#include "Steps.h"
+
+
+Realigner::Realigner(const char* X, int n, const char* Y, int m, const Scoring& sc, Arena& workspace)
+    : sc(sc), m(m), stride(REALIGN_STRIDE), best(0)
+{
+    //checkpoints of both sides within REALIGN_MAX_BYTES
+    const double per_row = 2.0 * (m + 1) * sizeof(int);
+    while ((n / stride + 1) * per_row > REALIGN_MAX_BYTES && stride < n) stride *= 2;
+
+    forward.S.assign(X, n);
+    forward.T.assign(Y, m);
+    forward.reversed = false;
+    backward.S.assign(forward.S.rbegin(), forward.S.rend());
+    backward.T.assign(forward.T.rbegin(), forward.T.rend());
+    backward.reversed = true;
+    Side* sides[2] = { &forward, &backward };
+    for (int s=0; s<2; s++)
+    {
+        Side& side = *sides[s];
+        side.rows.resize((std::size_t)(n / stride + 1) * (m + 1));
+        for (int j=0; j<=m; j++)
+        {
+            side.rows[j] = j * sc.gap;
+        }
+        side.valid = 1;
+        ensure(side, n);
+    }
+
+    //the first path: a full traceback, nothing to meet
+    const ArenaMark start = workspace.mark();
+    int* row = workspace.alloc<int>(m+1);
+    row_at(forward, n, row);
+    best = row[m];
+    workspace.rewind(start);
+    int i, j;
+    trace(forward, n, m, -1, workspace, ops, i, j);
+    std::reverse(ops.begin(), ops.end());
+    index_path();
+}
+
+int Realigner::edit(int pos, int erase, const char* insert, int count, Arena& workspace)
+{
+    const int n = forward.S.size();
+    if (pos < 0 || erase < 0 || count < 0 || pos + erase > n) return best;
+    const int a = pos, b = pos + erase;
+    const int ar = n - b;                   //backward row of the unchanged suffix
+
+    //STEP 1: checkpoints up to the edit on both sides, those beyond it dropped
+    ensure(forward, a);
+    ensure(backward, ar);
+    forward.valid = std::min(forward.valid, a / stride + 1);
+    backward.valid = std::min(backward.valid, ar / stride + 1);
+
+    //STEP 2: the edit, in both orientations
+    const ArenaMark start = workspace.mark();
+    const int n2 = n - erase + count, b2 = a + count;
+    char* flipped = workspace.alloc<char>(count);
+    std::reverse_copy(insert, insert + count, flipped);
+    forward.S.replace(a, erase, insert, count);
+    backward.S.replace(ar, erase, flipped, count);
+    forward.rows.resize((std::size_t)(n2 / stride + 1) * (m + 1));
+    backward.rows.resize((std::size_t)(n2 / stride + 1) * (m + 1));
+
+    //STEP 3: forward row a through the new residues to row b2, checkpoints on the way
+    int* row = workspace.alloc<int>(m+1);
+    int* back = workspace.alloc<int>(m+1);
+    row_at(forward, a, row);
+    for (int r=a; r<b2; r++)
+    {
+        fill_rows<false>(forward.S.data(), r, r+1, forward.T.data(), m, sc, row, NULL, 0);
+        if ((r + 1) % stride == 0) std::memcpy(&forward.rows[(std::size_t)(r + 1) / stride * (m + 1)], row,
+                                               (m + 1) * sizeof(int));
+    }
+    if (stats_enabled) thread_stats().cells += (unsigned long long)count * m;
+    forward.valid = b2 / stride + 1;
+    row_at(backward, ar, back);
+
+    //STEP 4: the split column, preferably one where the old path crosses old row b
+    int split = -1;
+    best = row[0] + back[m];
+    for (int j=0; j<=m; j++)
+    {
+        best = std::max(best, row[j] + back[m-j]);
+    }
+    for (int j=first[b]; j<=last[b] && split < 0; j++)
+    {
+        if (row[j] + back[m-j] == best) split = j;
+    }
+    for (int j=0; split < 0; j++)
+    {
+        if (row[j] + back[m-j] == best) split = j;
+    }
+    workspace.rewind(start);
+
+    //STEP 5: the new path out of the edit until it meets the old one on either side;
+    //prefix rows up to a and suffix rows up to ar are unchanged, so are their paths
+    int i1, j1, i2, j2;
+    trace(forward, b2, split, a, workspace, before, i1, j1);
+    trace(backward, ar, m - split, ar, workspace, after, i2, j2);
+    i2 = n - i2;
+    j2 = m - j2;
+
+    //STEP 6: old prefix up to (i1, j1), new part, old suffix from (i2, j2)
+    std::size_t k1 = std::string::npos, k2 = std::string::npos;
+    for (std::size_t k=0, i=0, j=0; ; k++)
+    {
+        if (k1 == std::string::npos && (int)i == i1 && (int)j == j1) k1 = k;
+        if ((int)i == i2 && (int)j == j2)
+        {
+            k2 = k;
+            break;
+        }
+        if (ops[k] != 'D') i++;
+        if (ops[k] != 'I') j++;
+    }
+    stitched.assign(ops, 0, k1);
+    stitched.append(before.rbegin(), before.rend());
+    stitched += after;
+    stitched.append(ops, k2, std::string::npos);
+    ops.swap(stitched);
+    index_path();
+    return best;
+}
+
+AlignResult Realigner::alignment(Arena& workspace) const
+{
+    workspace.reset();
+    const int len = ops.size();
+    char* A_1 = workspace.alloc<char>(len);
+    char* A_2 = workspace.alloc<char>(len);
+    for (int k=0, i=0, j=0; k<len; k++)
+    {
+        A_1[k] = ops[k] == 'D' ? '-' : forward.S[i++];
+        A_2[k] = ops[k] == 'I' ? '-' : forward.T[j++];
+    }
+    const AlignResult r = { best, len, A_1, A_2 };
+    return r;
+}
+
+
+//ensure: checkpoints of the side up to row r brought up to date
+void Realigner::ensure(Side& side, int r)
+{
+    const int target = r / stride;
+    const int n = side.S.size();
+    const std::size_t w = m + 1;
+    for (; side.valid <= target; side.valid++)
+    {
+        const int r0 = (side.valid - 1) * stride;
+        int* row = &side.rows[side.valid * w];
+        std::memcpy(row, &side.rows[(side.valid - 1) * w], w * sizeof(int));
+        fill_rows<false>(side.S.data(), r0, std::min(r0 + stride, n), side.T.data(), m, sc, row, NULL, 0);
+        if (stats_enabled) thread_stats().cells += (unsigned long long)stride * m;
+    }
+}
+
+//row_at: row r of the side from its checkpoint, which must be valid
+void Realigner::row_at(const Side& side, int r, int* row) const
+{
+    const int c = r / stride * stride;
+    std::memcpy(row, &side.rows[(std::size_t)(c / stride) * (m + 1)], (m + 1) * sizeof(int));
+    fill_rows<false>(side.S.data(), c, r, side.T.data(), m, sc, row, NULL, 0);
+    if (stats_enabled) thread_stats().cells += (unsigned long long)(r - c) * m;
+}
+
+//on_path: whether cell (i, j) of the side is on the current path
+bool Realigner::on_path(const Side& side, int i, int j) const
+{
+    if (side.reversed)
+    {
+        i = (int)first.size() - 1 - i;
+        j = m - j;
+    }
+    return first[i] <= j && j <= last[i];
+}
+
+//trace: operations of the side's optimal path back from (i, j), last first, until a cell
+//of the current path in a row up to limit or (0, 0), which ends in (end_i, end_j). Strip by
+//strip from the checkpoints, which must be valid up to row i
+void Realigner::trace(const Side& side, int i, int j, int limit, Arena& workspace, std::string& out, int& end_i,
+                      int& end_j) const
+{
+    StatsTimer traceback(&AlignStats::traceback_seconds);
+    const ArenaMark start = workspace.mark();
+    int* row = workspace.alloc<int>(m+1);
+    uint8_t* steps = workspace.alloc<uint8_t>((std::size_t)stride * (m+1));
+    out.clear();
+    while (!(i <= limit && on_path(side, i, j)) && (i > 0 || j > 0))
+    {
+        if (i == 0)
+        {
+            out += 'D';
+            j--;
+            continue;
+        }
+
+        //the strip above row i, columns up to j, with the step of every cell
+        const int c = (i - 1) / stride * stride;
+        const int w = j + 1;
+        std::memcpy(row, &side.rows[(std::size_t)(c / stride) * (m + 1)], w * sizeof(int));
+        fill_rows<true>(side.S.data(), c, i, side.T.data(), j, sc, row, steps, w);
+        if (stats_enabled) thread_stats().cells += (unsigned long long)(i - c) * j;
+        while (i > c && !(i <= limit && on_path(side, i, j)))
+        {
+            const uint8_t step = steps[(std::size_t)(i - c - 1) * w + j];
+            out += step == STEP_DIAG ? 'M' : step == STEP_UP ? 'I' : 'D';
+            if (step != STEP_LEFT) i--;
+            if (step != STEP_UP) j--;
+        }
+    }
+    end_i = i;
+    end_j = j;
+    workspace.rewind(start);
+}
+
+//index_path: first and last column of the path in every row of X
+void Realigner::index_path()
+{
+    const int n = forward.S.size();
+    first.assign(n + 1, 0);
+    last.assign(n + 1, 0);
+    int i = 0, j = 0;
+    for (std::size_t k=0; k<ops.size(); k++)
+    {
+        if (ops[k] != 'D')
+        {
+            i++;
+            first[i] = j + (ops[k] == 'M');
+        }
+        if (ops[k] != 'I') j++;
+        last[i] = j;
+    }
+}
@@ -0,0 +1,101 @@
+/*
+ * Realign: incremental global alignment of a sequence under small edits
+ *
+ * Polishing a consensus realigns it after every few-base edit, and a fresh alignment
+ * recomputes all (n+1)(m+1) cells each time. An edit of X[a...b) changes only the DP
+ * rows below row a: the forward rows of the prefix X[0...a) and the backward rows of the
+ * suffix X[b...n) (the rows NWScore computes for Hirschberg's split) stay as they are.
+ * A Realigner keeps both as checkpoints, every REALIGN_STRIDE-th row of each. An edit:
+ * - rebuilds forward row a and backward row b from their nearest checkpoints;
+ * - runs the forward rows through the new residues to row b' = a + inserted count;
+ * - splits there, as Hirschberg does: the best column j of forward + backward row b' gives
+ *   the new score;
+ * - traces the new path from (b', j) out of the edit, backwards over the forward
+ *   checkpoints and forwards over the backward ones, one strip at a time, until it meets
+ *   the old path. A subpath of an optimal path is optimal, so the old path's prefix and
+ *   suffix beyond the meeting points are reused as they are.
+ * On similar sequences the new path meets the old one within a strip or two, and an edit
+ * costs O(m (span + REALIGN_STRIDE)) instead of O(nm).
+ *
+ * After an edit, the forward checkpoints are valid down to row b' and the backward ones
+ * down to the same row from the other end. An edit elsewhere first brings them up to its
+ * position: O(m d) for a distance d from the previous edit. A left-to-right polishing
+ * pass therefore costs about one full alignment in all, not one per edit.
+ *
+ * The score equals NWScore's. The path is an optimal alignment, but of the co-optimal
+ * ones not necessarily the one NeedlemanWunsch picks.
+ *
+ * Usage:
+ *   Realigner r(X, n, Y, m, default_scoring(), workspace);
+ *   r.edit(pos, erase, insert, count, workspace);       //X[pos...pos+erase) becomes insert
+ *   r.score(); r.sequence(); r.path();                  //score, current X, M/I/D per column
+ *   AlignResult a = r.alignment(workspace);             //aligned rows, in the workspace
+ *
+ */
+
+#ifndef REALIGN_H
+#define REALIGN_H
+
+#include <string>
+#include <vector>
+
+#include "Alignment.h"
+
+#define REALIGN_STRIDE 32                                   //rows between two checkpoints
+#define REALIGN_MAX_BYTES ((std::size_t)256 << 20)          //checkpoints of both sides; the stride grows beyond
+
+class Realigner
+{
+public:
+    //Realigner: aligns X[0...n) against Y[0...m) and keeps the checkpoints; scratch from workspace
+    Realigner(const char* X, int n, const char* Y, int m, const Scoring& sc, Arena& workspace);
+
+    //edit: replaces X[pos...pos+erase) with insert[0...count) and realigns; returns the new
+    //score, or the unchanged one when the range is not inside X
+    int edit(int pos, int erase, const char* insert, int count, Arena& workspace);
+
+    int score() const { return best; }
+
+    //sequence: X with every edit applied
+    const std::string& sequence() const { return forward.S; }
+
+    //path: one operation per column: M (aligned), I (residue of X only), D (residue of Y only)
+    const std::string& path() const { return ops; }
+
+    //alignment: the aligned rows in workspace, which is reset first
+    AlignResult alignment(Arena& workspace) const;
+
+private:
+    //Side: DP over S against T, forward (X, Y) or backward (both reversed); checkpoint k
+    //is row k*stride, the first valid ones are up to date
+    struct Side
+    {
+        std::string S;
+        std::string T;
+        std::vector<int> rows;
+        int valid;
+        bool reversed;
+    };
+
+    void ensure(Side& side, int r);
+    void row_at(const Side& side, int r, int* row) const;
+    bool on_path(const Side& side, int i, int j) const;
+    void trace(const Side& side, int i, int j, int limit, Arena& workspace, std::string& out, int& end_i,
+               int& end_j) const;
+    void index_path();
+
+    Scoring sc;
+    int m;
+    int stride;
+    int best;
+    Side forward;
+    Side backward;
+    std::string ops;
+    std::vector<int> first;         //columns of the path in row i of X: first[i]...last[i]
+    std::vector<int> last;
+    std::string before;             //scratch of edit(), kept so that edits reuse their buffers
+    std::string after;
+    std::string stitched;
+};
+
+#endif //REALIGN_H
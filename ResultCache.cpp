@@ -0,0 +1,390 @@
+/*
+ * ResultCache: memory and disk tiers of alignment results, see ResultCache.h
+ */
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ResultCache.h"
+#include "AlignFrames.h"
+#include "Stats.h"
+
+//Record header in a cache file, followed by cigar_len characters
+struct CacheRecord
+{
+    uint64_t hi;
+    uint64_t lo;
+    int32_t score;
+    uint32_t cigar_len;
+    uint64_t check;
+};
+
+//Bookkeeping of a memory tier entry besides its CIGAR: list node and hash table slot
+#define RC_ENTRY_BYTES (sizeof(CacheKey) + 4 * sizeof(void*) + 64)
+
+//Useful tools
+static uint64_t record_check(const CacheRecord& record, const char* cigar);
+
+//mix64: finalizer of MurmurHash3
+static inline uint64_t mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+//KeyHasher: two independent 64-bit lanes over the same bytes, one word at a time
+struct KeyHasher
+{
+    uint64_t a = 0x9e3779b97f4a7c15ULL;
+    uint64_t b = 0xc2b2ae3d27d4eb4fULL;
+    uint64_t bytes = 0;
+
+    void word(uint64_t w)
+    {
+        a = (a ^ w) * 0x87c37b91114253d5ULL;
+        a = (a << 31) | (a >> 33);
+        b = (b ^ w) * 0x4cf5ad432745937fULL;
+        b = (b << 27) | (b >> 37);
+    }
+
+    void add(const void* data, std::size_t count)
+    {
+        const char* c = static_cast<const char*>(data);
+        bytes += count;
+        for (; count >= 8; count -= 8, c += 8)
+        {
+            uint64_t w;
+            std::memcpy(&w, c, 8);
+            word(w);
+        }
+        uint64_t w = 0;
+        std::memcpy(&w, c, count);
+        word(w ^ count << 56);
+    }
+
+    CacheKey finish() const
+    {
+        const uint64_t hi = mix64(a ^ bytes);
+        const CacheKey key = { hi, mix64(b ^ hi) };
+        return key;
+    }
+};
+
+
+ResultCache::ResultCache(std::size_t memory_bytes)
+    : budget(memory_bytes), used(0), fd(-1), base(NULL), mapped(0), memory_hits(0), disk_hits(0), missed(0)
+{
+}
+
+ResultCache::~ResultCache()
+{
+    flush();
+    if (base) munmap(const_cast<char*>(base), mapped);
+    if (fd >= 0) close(fd);
+}
+
+bool ResultCache::open(const char* path, std::string& error)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (fd >= 0)
+    {
+        error = "the disk tier is already open";
+        return false;
+    }
+    fd = ::open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+    {
+        error = std::string("cannot open ") + path + ": " + std::strerror(errno);
+        return false;
+    }
+
+    //STEP 1: header of a new file, or check an existing one; under the lock of the writers
+    flock(fd, LOCK_EX);
+    struct stat st;
+    fstat(fd, &st);
+    std::size_t size = st.st_size;
+    uint32_t header[2] = { RC_MAGIC, RC_VERSION };
+    if (size == 0)
+    {
+        if (!write_full(fd, header, sizeof(header)))
+        {
+            flock(fd, LOCK_UN);
+            error = std::string("cannot write ") + path + ": " + std::strerror(errno);
+            close(fd);
+            fd = -1;
+            return false;
+        }
+        size = sizeof(header);
+    }
+    else if (size < sizeof(header) || pread(fd, header, sizeof(header), 0) != (ssize_t)sizeof(header)
+             || header[0] != RC_MAGIC || header[1] != RC_VERSION)
+    {
+        flock(fd, LOCK_UN);
+        error = std::string(path) + ": not a result cache of this version";
+        close(fd);
+        fd = -1;
+        return false;
+    }
+
+    //STEP 2: map the records and index them, up to the first torn or corrupt one
+    std::size_t end = sizeof(header);
+    if (size > sizeof(header))
+    {
+        void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            flock(fd, LOCK_UN);
+            error = std::string("cannot map ") + path + ": " + std::strerror(errno);
+            close(fd);
+            fd = -1;
+            return false;
+        }
+        base = static_cast<const char*>(map);
+        mapped = size;
+        CacheRecord record;
+        while (end + sizeof(record) <= size)
+        {
+            std::memcpy(&record, base + end, sizeof(record));
+            if (record.cigar_len > size - end - sizeof(record)) break;
+            if (record.check != record_check(record, base + end + sizeof(record))) break;
+            const CacheKey key = { record.hi, record.lo };
+            offsets.emplace(key, end);
+            end += sizeof(record) + record.cigar_len;
+        }
+    }
+
+    //STEP 3: drop a torn tail, so that the next appends are found by the next open; the
+    //mapping shrinks with the file
+    if (end < size && ftruncate(fd, end) == 0)
+    {
+        munmap(const_cast<char*>(base), mapped);
+        void* map = mmap(NULL, end, PROT_READ, MAP_SHARED, fd, 0);
+        base = map == MAP_FAILED ? NULL : static_cast<const char*>(map);
+        mapped = base ? end : 0;
+    }
+    flock(fd, LOCK_UN);
+    return true;
+}
+
+CacheKey ResultCache::key(const AlignerConfig& config, const char* X, int n, const char* Y, int m)
+{
+    const int32_t fields[8] = { config.scoring.match, config.scoring.mismatch, config.scoring.gap,
+                                config.mode, config.engine, config.ties, n, m };
+    KeyHasher h;
+    h.add(fields, sizeof(fields));
+    h.add(X, n);
+    h.add(Y, m);
+    return h.finish();
+}
+
+bool ResultCache::lookup(const CacheKey& key, int& score, std::string& cigar)
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    //STEP 1: memory tier, the entry moving to the front
+    const auto found = entries.find(key);
+    if (found != entries.end())
+    {
+        recent.splice(recent.begin(), recent, found->second);
+        score = found->second->score;
+        cigar = found->second->cigar;
+        memory_hits++;
+        if (stats_enabled) thread_stats().cache_hits++;
+        return true;
+    }
+
+    //STEP 2: disk tier, the entry copied to the memory tier
+    const auto stored = offsets.find(key);
+    if (stored != offsets.end() && read_record(stored->second, key, score, cigar))
+    {
+        remember(key, score, cigar.data(), cigar.size());
+        disk_hits++;
+        if (stats_enabled) thread_stats().cache_hits++;
+        return true;
+    }
+    missed++;
+    if (stats_enabled) thread_stats().cache_misses++;
+    return false;
+}
+
+void ResultCache::store(const CacheKey& key, int score, const char* cigar, int cigar_len)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (entries.count(key)) return;
+    remember(key, score, cigar, cigar_len);
+    if (fd < 0 || offsets.count(key)) return;
+
+    CacheRecord record = { key.hi, key.lo, score, (uint32_t)cigar_len, 0 };
+    record.check = record_check(record, cigar);
+    pending.append(reinterpret_cast<const char*>(&record), sizeof(record));
+    pending.append(cigar, cigar_len);
+    if (pending.size() >= RC_FLUSH_BYTES) flush_locked();
+}
+
+void ResultCache::flush()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    flush_locked();
+}
+
+long long ResultCache::hits()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return memory_hits + disk_hits;
+}
+
+long long ResultCache::misses()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return missed;
+}
+
+
+//remember: puts a result at the front of the memory tier, evicting from the back
+void ResultCache::remember(const CacheKey& key, int score, const char* cigar, int cigar_len)
+{
+    const std::size_t bytes = RC_ENTRY_BYTES + cigar_len;
+    if (bytes > budget) return;
+    while (used + bytes > budget)
+    {
+        const Entry& last = recent.back();
+        used -= RC_ENTRY_BYTES + last.cigar.size();
+        entries.erase(last.key);
+        recent.pop_back();
+    }
+    recent.push_front(Entry{ key, score, std::string(cigar, cigar_len) });
+    entries[key] = recent.begin();
+    used += bytes;
+}
+
+//read_record: the record at offset, from the mapping or (appended since) from the file
+bool ResultCache::read_record(uint64_t offset, const CacheKey& key, int& score, std::string& cigar) const
+{
+    CacheRecord record;
+    if (offset + sizeof(record) <= mapped)
+    {
+        std::memcpy(&record, base + offset, sizeof(record));
+        if (offset + sizeof(record) + record.cigar_len > mapped) return false;
+        cigar.assign(base + offset + sizeof(record), record.cigar_len);
+    }
+    else
+    {
+        if (pread(fd, &record, sizeof(record), offset) != (ssize_t)sizeof(record)) return false;
+        cigar.resize(record.cigar_len);
+        if (pread(fd, &cigar[0], record.cigar_len, offset + sizeof(record)) != (ssize_t)record.cigar_len) return false;
+    }
+    if (record.hi != key.hi || record.lo != key.lo) return false;
+    score = record.score;
+    return true;
+}
+
+//flush_locked: appends the queued records in one write, indexing them at their offsets
+void ResultCache::flush_locked()
+{
+    if (fd < 0 || pending.empty()) return;
+    flock(fd, LOCK_EX);
+    const off_t start = lseek(fd, 0, SEEK_END);
+    const bool written = start >= 0 && write_full(fd, pending.data(), pending.size());
+    flock(fd, LOCK_UN);
+
+    //an unwritten batch is only lost for later runs
+    if (written)
+    {
+        CacheRecord record;
+        for (std::size_t at=0; at<pending.size(); at+=sizeof(record)+record.cigar_len)
+        {
+            std::memcpy(&record, pending.data() + at, sizeof(record));
+            const CacheKey key = { record.hi, record.lo };
+            offsets.emplace(key, start + at);
+        }
+    }
+    pending.clear();
+}
+
+
+void cigar_from_rows(const char* A_1, const char* A_2, int len, std::string& cigar)
+{
+    for (int k=0; k<len; )
+    {
+        const char op = A_1[k] == '-' ? 'D' : A_2[k] == '-' ? 'I' : 'M';
+        int run = k + 1;
+        while (run < len && (A_1[run] == '-' ? 'D' : A_2[run] == '-' ? 'I' : 'M') == op) run++;
+        cigar += std::to_string(run - k);
+        cigar += op;
+        k = run;
+    }
+}
+
+int rows_from_cigar(const char* cigar, int cigar_len, const char* X, int n, const char* Y, int m,
+                    char* A_1, char* A_2)
+{
+    int i = 0, j = 0, len = 0;
+    for (int c=0; c<cigar_len; c++)
+    {
+        long run = 0;
+        while (c < cigar_len && cigar[c] >= '0' && cigar[c] <= '9' && run <= n + m) run = 10 * run + (cigar[c++] - '0');
+        if (c == cigar_len || run == 0) return -1;
+        const char op = cigar[c];
+        if (op != 'M' && op != 'I' && op != 'D') return -1;
+        if ((op != 'D' && i + run > n) || (op != 'I' && j + run > m)) return -1;
+        for (long r=0; r<run; r++, len++)
+        {
+            A_1[len] = op == 'D' ? '-' : X[i++];
+            A_2[len] = op == 'I' ? '-' : Y[j++];
+        }
+    }
+    return i == n && j == m ? len : -1;
+}
+
+AlignResult align_cached(const Aligner& aligner, ResultCache* cache, const char* X, int n, const char* Y, int m,
+                         Arena& workspace)
+{
+    const AlignerConfig& config = aligner.config();
+    if (cache == NULL || config.count_optimal) return aligner.align(X, n, Y, m, workspace);
+    const CacheKey key = ResultCache::key(config, X, n, Y, m);
+
+    //STEP 1: a hit, its rows rebuilt in the workspace
+    int score;
+    std::string cigar;
+    if (cache->lookup(key, score, cigar))
+    {
+        workspace.reset();
+        AlignResult r = { score, 0, NULL, NULL };
+        if (config.mode == MODE_SCORE) return r;
+        char* A_1 = workspace.alloc<char>(n + m);
+        char* A_2 = workspace.alloc<char>(n + m);
+        r.length = rows_from_cigar(cigar.data(), cigar.size(), X, n, Y, m, A_1, A_2);
+        r.A_1 = A_1;
+        r.A_2 = A_2;
+        if (r.length >= 0) return r;
+    }
+
+    //STEP 2: a miss (or a CIGAR that does not fit the pair), aligned and stored
+    const AlignResult r = aligner.align(X, n, Y, m, workspace);
+    cigar.clear();
+    if (r.A_1) cigar_from_rows(r.A_1, r.A_2, r.length, cigar);
+    cache->store(key, r.score, cigar.data(), cigar.size());
+    return r;
+}
+
+
+//Functions
+//record_check: checksum of a record's fields and CIGAR, its own field excluded
+static uint64_t record_check(const CacheRecord& record, const char* cigar)
+{
+    KeyHasher h;
+    h.add(&record, offsetof(CacheRecord, check));
+    h.add(cigar, record.cigar_len);
+    return h.finish().lo;
+}
@@ -0,0 +1,142 @@
+/*
+ * ResultCache: content-addressed cache of alignment results across runs
+ *
+ * Pipelines realign the same pairs over and over: reruns after a failed step, the same
+ * queries against every sample group. A result is keyed by a 128-bit hash of both
+ * sequences, the scoring, the mode, the engine and the tie policy, and stored as its score and CIGAR
+ * (M: aligned columns, I: residues of X only, D: residues of Y only, as Extend.h), so
+ * its size follows the number of gap runs, not the length of the pair. A hit in
+ * MODE_ALIGN rebuilds the aligned rows from the CIGAR and both sequences.
+ *
+ * Two tiers:
+ * - memory: least recently used results, up to a byte budget (RC_MEMORY_BYTES);
+ * - disk (optional): an append-only file of records, mapped read-only when opened and
+ *   indexed by key. New results are buffered and appended RC_FLUSH_BYTES at a time,
+ *   under an exclusive flock(), so several processes can share one file. Each record
+ *   carries a checksum; the torn tail of a crashed writer is cut off at the next open.
+ *   The file only grows: delete it to start over.
+ * A rerun over a mostly unchanged dataset hashes each pair and copies its result out of
+ * the mapping; only the new pairs are aligned.
+ *
+ * The sequences are not stored, so two pairs whose keys collide would share a result.
+ * With 128-bit keys that takes about 2^64 distinct pairs. Keys are computed with the
+ * machine's byte order: a cache file does not move between architectures.
+ *
+ * Every member function is thread safe.
+ *
+ * Usage:
+ *   ResultCache cache(RC_MEMORY_BYTES);
+ *   if (!cache.open("results.alnc", error)) ...              //optional disk tier
+ *   AlignResult r = align_cached(aligner, &cache, X, n, Y, m, workspace);
+ *   //or: cache.lookup(key, score, cigar) before and cache.store(...) after aligning
+ *
+ */
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "Alignment.h"
+
+#define RC_MEMORY_BYTES ((std::size_t)64 << 20)
+#define RC_FLUSH_BYTES (1 << 16)
+
+//Cache files: "ALNC" and version as uint32, then records: key (2 x uint64), score (int32),
+//CIGAR length (uint32) and checksum (uint64), then the CIGAR
+#define RC_MAGIC 0x434e4c41u
+#define RC_VERSION 1
+
+struct CacheKey
+{
+    uint64_t hi;
+    uint64_t lo;
+
+    bool operator==(const CacheKey& other) const { return hi == other.hi && lo == other.lo; }
+};
+
+struct CacheKeyHash
+{
+    std::size_t operator()(const CacheKey& key) const { return key.lo; }
+};
+
+class ResultCache
+{
+public:
+    //memory_bytes: budget of the memory tier, results and bookkeeping included
+    explicit ResultCache(std::size_t memory_bytes);
+    ~ResultCache();
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    //open: adds the disk tier at path, created if missing; false with a message in error
+    bool open(const char* path, std::string& error);
+
+    //key: the key of X[0...n) against Y[0...m) under config
+    static CacheKey key(const AlignerConfig& config, const char* X, int n, const char* Y, int m);
+
+    //lookup: score and CIGAR of key from either tier; false on a miss
+    bool lookup(const CacheKey& key, int& score, std::string& cigar);
+
+    //store: records a result in the memory tier and queues it for the disk tier
+    void store(const CacheKey& key, int score, const char* cigar, int cigar_len);
+
+    //flush: appends the queued results to the disk file
+    void flush();
+
+    //hits / misses: lookups answered and not answered so far
+    long long hits();
+    long long misses();
+
+private:
+    struct Entry
+    {
+        CacheKey key;
+        int score;
+        std::string cigar;
+    };
+
+    void remember(const CacheKey& key, int score, const char* cigar, int cigar_len);
+    bool read_record(uint64_t offset, const CacheKey& key, int& score, std::string& cigar) const;
+    void flush_locked();
+
+    std::mutex lock;
+
+    //memory tier: most recent first
+    std::size_t budget;
+    std::size_t used;
+    std::list<Entry> recent;
+    std::unordered_map<CacheKey, std::list<Entry>::iterator, CacheKeyHash> entries;
+
+    //disk tier: record offsets in the file, the part mapped at open, and the queue
+    int fd;
+    const char* base;
+    std::size_t mapped;
+    std::unordered_map<CacheKey, uint64_t, CacheKeyHash> offsets;
+    std::string pending;
+
+    long long memory_hits;
+    long long disk_hits;
+    long long missed;
+};
+
+//cigar_from_rows: run-length CIGAR of an alignment of length len, appended to cigar
+void cigar_from_rows(const char* A_1, const char* A_2, int len, std::string& cigar);
+
+//rows_from_cigar: aligned rows of X[0...n) against Y[0...m) into A_1/A_2 (n+m characters
+//each); returns their length, -1 when the CIGAR does not consume exactly both sequences
+int rows_from_cigar(const char* cigar, int cigar_len, const char* X, int n, const char* Y, int m,
+                    char* A_1, char* A_2);
+
+//align_cached: aligner.align through cache (NULL, or count_optimal, which is not cached:
+//straight to the aligner); resets the workspace first, the rows of a hit are rebuilt in it
+AlignResult align_cached(const Aligner& aligner, ResultCache* cache, const char* X, int n, const char* Y, int m,
+                         Arena& workspace);
+
+#endif //RESULT_CACHE_H
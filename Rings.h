@@ -0,0 +1,231 @@
+/*
+ * Rings: bounded lock-free queues between the threads of a pipeline
+ *
+ * Both rings have a fixed, power-of-two number of slots allocated once; a push into a
+ * full ring or a pop from an empty one fails instead of allocating or blocking, which
+ * is what gives a pipeline its backpressure. push() and pop() wait for room or for an
+ * item: a few spins, then yields, then sleeps growing up to a millisecond, so an idle
+ * stage costs next to no CPU.
+ * - SpscRing: one producer thread, one consumer thread. Each side owns one index and
+ *   keeps a cached copy of the other, so a transfer touches a shared line only when
+ *   the ring looks full or empty [1].
+ * - MpmcRing: any number of producers and consumers. Every slot carries a sequence
+ *   number that tells whose turn it is; a claim is one compare-and-swap on the shared
+ *   index [2].
+ * Values are copied in and out, so T should be small: a pointer or an index.
+ *
+ * References:
+ * - [1] Lamport, L. (1983). Specifying concurrent program modules. ACM Transactions on
+ *   Programming Languages and Systems, 5(2), 190–222.
+ * - [2] Vyukov, D. Bounded MPMC queue. 1024cores.net.
+ *
+ * Usage:
+ *   MpmcRing<Batch*> ring(64);
+ *   ring.push(batch);              //waits while the ring is full
+ *   if (ring.try_pop(batch)) ...   //false when empty
+ *
+ */
+
+#ifndef RINGS_H
+#define RINGS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <thread>
+
+#define RING_CACHE_LINE 64
+#define RING_SPINS 64                   //failed attempts before yielding
+#define RING_YIELDS 64                  //yields before sleeping
+#define RING_SLEEP_MICROSECONDS 50      //first sleep, doubled up to RING_MAX_SLEEP_MICROSECONDS
+#define RING_MAX_SLEEP_MICROSECONDS 1000
+
+//ring_slots: capacity rounded up to a power of two
+inline std::size_t ring_slots(std::size_t capacity)
+{
+    std::size_t slots = 2;
+    while (slots < capacity) slots <<= 1;
+    return slots;
+}
+
+//ring_backoff: the wait after the attempt-th failed push or pop
+inline void ring_backoff(int& attempt)
+{
+    attempt++;
+    if (attempt <= RING_SPINS) return;
+    if (attempt <= RING_SPINS + RING_YIELDS)
+    {
+        std::this_thread::yield();
+        return;
+    }
+    const int doublings = attempt - RING_SPINS - RING_YIELDS - 1;
+    int sleep = RING_SLEEP_MICROSECONDS << (doublings < 5 ? doublings : 5);
+    if (sleep > RING_MAX_SLEEP_MICROSECONDS) sleep = RING_MAX_SLEEP_MICROSECONDS;
+    std::this_thread::sleep_for(std::chrono::microseconds(sleep));
+}
+
+template <typename T>
+class SpscRing
+{
+public:
+    explicit SpscRing(std::size_t capacity)
+        : mask(ring_slots(capacity) - 1), slots(new T[mask + 1]), head(0), tail_seen(0), tail(0), head_seen(0)
+    {
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    //try_push: producer side, false when full
+    bool try_push(const T& value)
+    {
+        const std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head_seen > mask)
+        {
+            head_seen = head.load(std::memory_order_acquire);
+            if (t - head_seen > mask) return false;
+        }
+        slots[t & mask] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    //try_pop: consumer side, false when empty
+    bool try_pop(T& value)
+    {
+        const std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail_seen)
+        {
+            tail_seen = tail.load(std::memory_order_acquire);
+            if (h == tail_seen) return false;
+        }
+        value = slots[h & mask];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    void push(const T& value)
+    {
+        for (int attempt=0; !try_push(value); ) ring_backoff(attempt);
+    }
+
+    void pop(T& value)
+    {
+        for (int attempt=0; !try_pop(value); ) ring_backoff(attempt);
+    }
+
+    std::size_t capacity() const { return mask + 1; }
+
+private:
+    const std::size_t mask;
+    const std::unique_ptr<T[]> slots;
+
+    //consumer's line, then producer's line
+    alignas(RING_CACHE_LINE) std::atomic<std::size_t> head;
+    std::size_t tail_seen;
+    alignas(RING_CACHE_LINE) std::atomic<std::size_t> tail;
+    std::size_t head_seen;
+};
+
+template <typename T>
+class MpmcRing
+{
+public:
+    explicit MpmcRing(std::size_t capacity)
+        : mask(ring_slots(capacity) - 1), cells(new Cell[mask + 1]), enqueue(0), dequeue(0)
+    {
+        for (std::size_t k=0; k<=mask; k++)
+        {
+            cells[k].sequence.store(k, std::memory_order_relaxed);
+        }
+    }
+
+    MpmcRing(const MpmcRing&) = delete;
+    MpmcRing& operator=(const MpmcRing&) = delete;
+
+    //try_push: false when full
+    bool try_push(const T& value)
+    {
+        std::size_t pos = enqueue.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = cells[pos & mask];
+            const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t turn = (std::ptrdiff_t)(sequence - pos);
+            if (turn == 0)
+            {
+                //the slot is free for lap pos: claim it
+                if (enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (turn < 0)
+            {
+                return false;           //still holds the item of the previous lap
+            }
+            else
+            {
+                pos = enqueue.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    //try_pop: false when empty
+    bool try_pop(T& value)
+    {
+        std::size_t pos = dequeue.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell& cell = cells[pos & mask];
+            const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t turn = (std::ptrdiff_t)(sequence - (pos + 1));
+            if (turn == 0)
+            {
+                if (dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    value = cell.value;
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (turn < 0)
+            {
+                return false;           //not written yet
+            }
+            else
+            {
+                pos = dequeue.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void push(const T& value)
+    {
+        for (int attempt=0; !try_push(value); ) ring_backoff(attempt);
+    }
+
+    void pop(T& value)
+    {
+        for (int attempt=0; !try_pop(value); ) ring_backoff(attempt);
+    }
+
+    std::size_t capacity() const { return mask + 1; }
+
+private:
+    struct alignas(RING_CACHE_LINE) Cell
+    {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    const std::size_t mask;
+    const std::unique_ptr<Cell[]> cells;
+    alignas(RING_CACHE_LINE) std::atomic<std::size_t> enqueue;
+    alignas(RING_CACHE_LINE) std::atomic<std::size_t> dequeue;
+};
+
+#endif //RINGS_H
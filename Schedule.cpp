@@ -0,0 +1,176 @@
+/*
+ * Schedule: cost model and job plan of a batch, see Schedule.h
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <string_view>
+
+#include "Schedule.h"
+#include "Stats.h"
+
+//Useful tools
+static bool same_pair(const BatchPair& a, const BatchPair& b);
+static std::size_t pair_hash(const BatchPair& p);
+
+void plan_batch(const BatchPair* pairs, int count, const Aligner& aligner, ResultCache* cache, BatchPlan& plan,
+                BatchOutput& output, const char* known)
+{
+    //STEP 1: the first copy of every pair, in an open-addressing table of pair indices + 1;
+    //known pairs are settled and stay out of the table
+    std::size_t slots = 16;
+    while (slots < 2 * (std::size_t)count) slots *= 2;
+    plan.slots.assign(slots, 0);
+    output.source.resize(count);
+    plan.settled.assign(count, 0);
+    int duplicates = 0;
+    for (int k=0; k<count; k++)
+    {
+        if (known && known[k])
+        {
+            output.source[k] = k;
+            plan.settled[k] = 1;
+            continue;
+        }
+        std::size_t s = pair_hash(pairs[k]) & (slots - 1);
+        while (plan.slots[s] != 0 && !same_pair(pairs[plan.slots[s] - 1], pairs[k])) s = (s + 1) & (slots - 1);
+        if (plan.slots[s] == 0) plan.slots[s] = k + 1;
+        output.source[k] = plan.slots[s] - 1;
+        if (output.source[k] == k) continue;
+        plan.settled[k] = 1;
+        duplicates++;
+    }
+    if (stats_enabled) thread_stats().duplicates += duplicates;
+
+    //STEP 2: room for the result of every first copy
+    const bool rows = aligner.config().mode == MODE_ALIGN;
+    output.scores.resize(count);
+    output.lengths.resize(count);
+    output.counts.assign(count, 0);
+    output.offsets.resize(count + 1);
+    output.offsets[0] = 0;
+    for (int k=0; k<count; k++)
+    {
+        const std::size_t room = rows && !plan.settled[k] ? 2 * ((std::size_t)pairs[k].n + pairs[k].m) : 0;
+        output.offsets[k+1] = output.offsets[k] + room;
+    }
+    output.rows.resize(output.offsets[count]);
+
+    //STEP 3: the cached results straight into output, only the others are planned; counts
+    //are not cached, so the cache is left out under count_optimal
+    if (aligner.config().count_optimal) cache = NULL;
+    plan.cache = cache;
+    plan.keys.resize(cache ? count : 0);
+    for (int k=0; cache && k<count; k++)
+    {
+        if (plan.settled[k]) continue;
+        const BatchPair& p = pairs[k];
+        plan.keys[k] = ResultCache::key(aligner.config(), p.X, p.n, p.Y, p.m);
+        int score;
+        if (!cache->lookup(plan.keys[k], score, plan.cigar)) continue;
+        int length = 0;
+        if (rows)
+        {
+            char* A_1 = &output.rows[output.offsets[k]];
+            length = rows_from_cigar(plan.cigar.data(), plan.cigar.size(), p.X, p.n, p.Y, p.m,
+                                     A_1, A_1 + p.n + p.m);
+            if (length < 0) continue;
+        }
+        output.scores[k] = score;
+        output.lengths[k] = length;
+        plan.settled[k] = 1;
+    }
+
+    //STEP 4: the short pairs by length (longer sequence, then X), then the others
+    plan.order.clear();
+    for (int k=0; k<count; k++)
+    {
+        if (!plan.settled[k] && pairs[k].n <= BATCH_MAX_LEN && pairs[k].m <= BATCH_MAX_LEN) plan.order.push_back(k);
+    }
+    const int shorts = plan.order.size();
+    std::sort(plan.order.begin(), plan.order.end(), [pairs](int a, int b)
+    {
+        const int la = std::max(pairs[a].n, pairs[a].m), lb = std::max(pairs[b].n, pairs[b].m);
+        if (la != lb) return la < lb;
+        if (pairs[a].n != pairs[b].n) return pairs[a].n < pairs[b].n;
+        return a < b;
+    });
+    for (int k=0; k<count; k++)
+    {
+        if (!plan.settled[k] && (pairs[k].n > BATCH_MAX_LEN || pairs[k].m > BATCH_MAX_LEN)) plan.order.push_back(k);
+    }
+    const int planned = plan.order.size();
+    plan.sorted.resize(planned);
+    for (int j=0; j<planned; j++)
+    {
+        plan.sorted[j] = pairs[plan.order[j]];
+    }
+
+    //STEP 5: a job per window of BATCH_LANES short pairs, which costs as much as its
+    //largest pair on every lane, and per long pair; then most expensive first
+    plan.jobs.clear();
+    for (int first=0; first<shorts; first+=BATCH_LANES)
+    {
+        const int size = std::min(shorts - first, BATCH_LANES);
+        int n = 0, m = 0;
+        for (int j=first; j<first+size; j++)
+        {
+            n = std::max(n, plan.sorted[j].n);
+            m = std::max(m, plan.sorted[j].m);
+        }
+        const BatchJob job = { first, size, BATCH_LANES * aligner.cost(n, m) };
+        plan.jobs.push_back(job);
+    }
+    for (int j=shorts; j<planned; j++)
+    {
+        const BatchJob job = { j, 1, aligner.cost(plan.sorted[j].n, plan.sorted[j].m) };
+        plan.jobs.push_back(job);
+    }
+    std::stable_sort(plan.jobs.begin(), plan.jobs.end(), [](const BatchJob& a, const BatchJob& b)
+    {
+        return a.cost > b.cost;
+    });
+}
+
+void run_job(const Aligner& aligner, const BatchPlan& plan, const BatchJob& job, Arena& workspace,
+             BatchOutput& output)
+{
+    AlignResult results[BATCH_LANES];
+    aligner.align_batch(plan.sorted.data() + job.first, job.count, workspace, results);
+    std::string cigar;
+    for (int j=0; j<job.count; j++)
+    {
+        const AlignResult& r = results[j];
+        const int k = plan.order[job.first + j];
+        output.scores[k] = r.score;
+        output.lengths[k] = r.length;
+        output.counts[k] = r.optimal;
+        if (r.A_1)
+        {
+            std::memcpy(&output.rows[output.offsets[k]], r.A_1, r.length);
+            std::memcpy(&output.rows[(output.offsets[k] + output.offsets[k+1]) / 2], r.A_2, r.length);
+        }
+        if (plan.cache == NULL) continue;
+        cigar.clear();
+        if (r.A_1) cigar_from_rows(r.A_1, r.A_2, r.length, cigar);
+        plan.cache->store(plan.keys[k], r.score, cigar.data(), cigar.size());
+    }
+}
+
+
+//Functions
+//same_pair: both sequences equal, residue by residue
+static bool same_pair(const BatchPair& a, const BatchPair& b)
+{
+    return a.n == b.n && a.m == b.m && (a.X == b.X || std::memcmp(a.X, b.X, a.n) == 0)
+        && (a.Y == b.Y || std::memcmp(a.Y, b.Y, a.m) == 0);
+}
+
+static std::size_t pair_hash(const BatchPair& p)
+{
+    const std::hash<std::string_view> hash;
+    const std::size_t x = hash(std::string_view(p.X, p.n));
+    const std::size_t y = hash(std::string_view(p.Y, p.m));
+    return (x ^ (y + 0x9e3779b97f4a7c15ULL + (x << 6) + (x >> 2))) * 0xff51afd7ed558ccdULL;
+}
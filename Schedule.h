@@ -0,0 +1,101 @@
+/*
+ * Schedule: cost model and job plan of a batch of pairs
+ *
+ * Aligning a pair costs about n*m cells, so a batch mixing 100 bp and 1 Mb pairs is
+ * dominated by a few pairs. Cut into fixed slices, such a batch leaves most threads idle
+ * behind the slice that drew the long pair. plan_batch() cuts a batch into jobs instead:
+ * - short pairs (both sequences up to BATCH_MAX_LEN) are sorted by length and cut into
+ *   windows of BATCH_LANES, so the pairs sharing a lockstep SIMD kernel are of similar
+ *   length. A window runs as long as its longest pair, and all its lanes stay busy
+ *   until the end;
+ * - every other pair is a job of its own.
+ * Each job gets a cost estimate from Aligner::cost (Alignment.h), and the jobs are listed
+ * most expensive first. Handing them out in that order is the longest processing time
+ * rule [1]: the long pairs start first, and the short ones fill in around them, so no
+ * long pair is left to start on its own at the end of the batch.
+ *
+ * Jobs write into a BatchOutput, each pair at its own offset, so they can run on any
+ * thread in any order.
+ *
+ * Identical pairs are aligned once: plan_batch finds the first copy of every pair by
+ * hash, and the others read its result through BatchOutput::source, with no room of
+ * their own. With a ResultCache (ResultCache.h), plan_batch also copies the cached
+ * results into the output first and plans only the other pairs; run_job stores what it
+ * aligns. The cache holds no counts: under count_optimal it is neither read nor written.
+ *
+ * References:
+ * - [1] Graham, R. L. (1969). Bounds on multiprocessing timing anomalies. SIAM Journal on
+ *   Applied Mathematics, 17(2), 416–429.
+ *
+ * Usage:
+ *   BatchPlan plan;
+ *   BatchOutput output;
+ *   plan_batch(pairs, count, aligner, cache, plan, output);        //cache may be NULL
+ *   for (job : plan.jobs) pool.submit([&, job]{ run_job(aligner, plan, job, thread_arena(), output); });
+ *   pool.wait();
+ *   //output.score(k), output.length(k) and output.row_1(k) / output.row_2(k) for pairs[k],
+ *   //output.optimal(k) with count_optimal
+ *
+ */
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <string>
+#include <vector>
+
+#include "Alignment.h"
+#include "ResultCache.h"
+
+//BatchJob: pairs plan.sorted[first...first+count), one align_batch call
+struct BatchJob
+{
+    int first;
+    int count;
+    double cost;                    //estimated cell updates
+};
+
+struct BatchPlan
+{
+    std::vector<int> order;         //sorted[j] is pairs[order[j]]
+    std::vector<BatchPair> sorted;  //the length buckets of the short pairs, then the long pairs
+    std::vector<BatchJob> jobs;     //most expensive first
+    ResultCache* cache;             //NULL without one
+    std::vector<CacheKey> keys;     //by pair index, with a cache
+    std::vector<char> settled;      //by pair index, set for copies and cached results: no job
+    std::vector<int> slots;         //scratch of the duplicate search
+    std::string cigar;              //scratch of the lookups
+};
+
+//BatchOutput: results of a batch by pair index. Pair k holds the result of pair
+//source[k], its first copy; the rows of a first copy are n_k+m_k characters each, from
+//offsets[k], of which lengths[k] are used
+struct BatchOutput
+{
+    std::vector<int> source;
+    std::vector<int> scores;
+    std::vector<int> lengths;
+    std::vector<double> counts;     //AlignResult::optimal
+    std::vector<std::size_t> offsets;
+    std::string rows;
+
+    int score(int k) const { return scores[source[k]]; }
+    int length(int k) const { return lengths[source[k]]; }
+    double optimal(int k) const { return counts[source[k]]; }
+    const char* row_1(int k) const { return rows.data() + offsets[source[k]]; }
+    const char* row_2(int k) const { k = source[k]; return rows.data() + (offsets[k] + offsets[k+1]) / 2; }
+};
+
+//plan_batch: jobs of the distinct pairs among count, most expensive first, and room for
+//their results; the results found in cache (may be NULL, ignored under count_optimal) are
+//already in output. Pairs flagged in known (may be NULL) get neither a job nor room: the
+//caller has their results elsewhere
+void plan_batch(const BatchPair* pairs, int count, const Aligner& aligner, ResultCache* cache, BatchPlan& plan,
+                BatchOutput& output, const char* known = NULL);
+
+//run_job: aligns (or scores) the job's pairs in workspace, which is reset, and copies the
+//results to output and to the plan's cache
+void run_job(const Aligner& aligner, const BatchPlan& plan, const BatchJob& job, Arena& workspace,
+             BatchOutput& output);
+
+#endif //SCHEDULE_H
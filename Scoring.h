@@ -0,0 +1,56 @@
+/*
+ * Scoring: linear-gap scoring scheme shared by every engine
+ *
+ * The default parameters are the ones the programs have always used; library
+ * callers pass their own Scoring to the Aligner.
+ *
+ */
+
+#ifndef SCORING_H
+#define SCORING_H
+
+#define GAP_PENALTY -1
+#define MISMATCH_SCORE -1
+#define MATCH_SCORE 1
+
+//Scoring: linear-gap scoring parameters
+struct Scoring
+{
+    int match;
+    int mismatch;
+    int gap;
+};
+
+//default_scoring: MATCH_SCORE / MISMATCH_SCORE / GAP_PENALTY
+inline Scoring default_scoring()
+{
+    const Scoring sc = { MATCH_SCORE, MISMATCH_SCORE, GAP_PENALTY };
+    return sc;
+}
+
+//Return maximum of three integers
+inline int max3(int a, int b, int c)
+{
+    if (a >= b && a >= c) return a;
+    else if (b >= a && b >= c) return b;
+    else return c;
+}
+
+//Evaluate if diagonal outcome of Needleman-Wunsch
+inline int match_or_mismatch(char c1, char c2, const Scoring& sc)
+{
+    return (c1 == c2) ? sc.match : sc.mismatch;
+}
+
+//completion_bound: highest score any alignment of a residues against b residues can reach
+//(every aligned column at its best, the length difference as gaps); used to stop hopeless pairs
+inline int completion_bound(int a, int b, const Scoring& sc)
+{
+    const int d = a < b ? a : b;
+    const int e = a < b ? b - a : a - b;
+    const int aligned = d * max3(sc.match, sc.mismatch, 2*sc.gap) + e * sc.gap;
+    const int gapped = (a + b) * sc.gap;
+    return aligned > gapped ? aligned : gapped;
+}
+
+#endif //SCORING_H
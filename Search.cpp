@@ -0,0 +1,366 @@
+/*
+ * Search: one query against a database, see Search.h
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+
+#include "Alignment.h"
+#include "Search.h"
+#include "Stats.h"
+#include "ThreadPool.h"
+
+//SearchChunk: records read together and scored by one worker; recycled with their strings
+struct SearchChunk
+{
+    std::vector<FastaRecord> records;
+    int count;
+    long first;                 //database position of records[0]
+};
+
+//SearchChunkPool: chunks not in flight; bounds how far the reader runs ahead of the workers
+class SearchChunkPool
+{
+public:
+    explicit SearchChunkPool(int chunks) : storage(chunks)
+    {
+        for (int c=0; c<chunks; c++) free.push_back(&storage[c]);
+    }
+
+    SearchChunk* take()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        returned.wait(guard, [this]{ return !free.empty(); });
+        SearchChunk* chunk = free.back();
+        free.pop_back();
+        return chunk;
+    }
+
+    void give(SearchChunk* chunk)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            free.push_back(chunk);
+        }
+        returned.notify_one();
+    }
+
+private:
+    std::vector<SearchChunk> storage;
+    std::vector<SearchChunk*> free;
+    std::mutex lock;
+    std::condition_variable returned;
+};
+
+//Order of the hits: higher score first, then earlier record
+static bool better(const SearchHit& a, const SearchHit& b)
+{
+    return a.score > b.score || (a.score == b.score && a.record < b.record);
+}
+
+//HitHeap: best top_k hits so far; the worst one is on top
+class HitHeap
+{
+public:
+    explicit HitHeap(int top_k) : top_k(top_k), threshold(INT_MIN)
+    {
+    }
+
+    //offer: keeps the record if it is among the best; lock-free rejection below the threshold
+    void offer(long record, int score, const FastaRecord& r)
+    {
+        if (top_k <= 0 || score < threshold.load(std::memory_order_relaxed)) return;
+
+        SearchHit hit;
+        hit.record = record;
+        hit.score = score;
+        std::lock_guard<std::mutex> guard(lock);
+        if ((int)hits.size() == top_k)
+        {
+            if (!better(hit, hits.front())) return;
+            std::pop_heap(hits.begin(), hits.end(), better);
+            hits.pop_back();
+        }
+        hit.name = r.name;
+        hit.sequence = r.sequence;
+        hits.push_back(std::move(hit));
+        std::push_heap(hits.begin(), hits.end(), better);
+        if ((int)hits.size() == top_k) threshold.store(hits.front().score, std::memory_order_relaxed);
+    }
+
+    //cutoff: lowest score that can still enter, INT_MIN until the heap is full
+    int cutoff() const
+    {
+        return threshold.load(std::memory_order_relaxed);
+    }
+
+    //sorted: the hits, best first
+    std::vector<SearchHit> sorted()
+    {
+        std::sort(hits.begin(), hits.end(), better);
+        return std::move(hits);
+    }
+
+private:
+    int top_k;
+    std::atomic<int> threshold;
+    std::mutex lock;
+    std::vector<SearchHit> hits;
+};
+
+//Useful tools
+static void score_chunk(const QueryProfile& profile, SearchChunk& chunk, HitHeap& heap);
+
+
+SearchConfig default_search_config()
+{
+    SearchConfig config;
+    config.scoring = default_scoring();
+    config.top_k = 10;
+    config.threads = 0;
+    config.traceback = true;
+    return config;
+}
+
+
+QueryProfile::QueryProfile(const char* Q, int m, const Scoring& sc) : Q(Q), m(m), sc(sc), lanes(Q, m)
+{
+    //one row per residue of the query, plus one shared by every other residue
+    std::memset(code, 0, sizeof(code));
+    codes = 1;
+    for (int j=0; j<m; j++)
+    {
+        unsigned char& c = code[(unsigned char)Q[j]];
+        if (c == 0) c = codes++;
+    }
+    composition.assign(codes, 0);
+    for (int j=0; j<m; j++)
+    {
+        composition[code[(unsigned char)Q[j]]]++;
+    }
+
+    profile.assign((std::size_t)codes * m, sc.mismatch);
+    for (int j=0; j<m; j++)
+    {
+        profile[(std::size_t)code[(unsigned char)Q[j]] * m + j] = sc.match;
+    }
+}
+
+int QueryProfile::score(const char* X, int n, Arena& arena, int cutoff) const
+{
+    StatsTimer fill(&AlignStats::fill_seconds);
+
+    const ArenaMark start = arena.mark();
+    int* Lastline = arena.alloc<int>(m+1);
+
+    //NWScore recurrence, the substitution score read from the residue's profile row
+    Lastline[0] = 0;
+    for (int j=1;j<=m;j++)
+    {
+        Lastline[j] = Lastline[j-1] + sc.gap;
+    }
+    for (int i=1; i<=n; i++)
+    {
+        const int* row = profile.data() + (std::size_t)code[(unsigned char)X[i-1]] * m;
+        int diag = Lastline[0];
+        Lastline[0] += sc.gap;
+        for (int j=1; j<=m; j++)
+        {
+            const int up = Lastline[j];
+            Lastline[j] = max3(Lastline[j-1] + sc.gap, up + sc.gap, diag + row[j-1]);
+            diag = up;
+        }
+
+        //the optimal path crosses row i in some cell j, then aligns X[i...n) with Q[j...m)
+        if (cutoff != INT_MIN && i % SEARCH_BOUND_ROWS == 0 && i < n)
+        {
+            int best = INT_MIN;
+            for (int j=0; j<=m; j++)
+            {
+                const int reach = Lastline[j] + completion_bound(n-i, m-j, sc);
+                if (reach > best) best = reach;
+            }
+            if (best < cutoff)
+            {
+                if (stats_enabled) thread_stats().cells += (unsigned long long)i * m;
+                arena.rewind(start);
+                return best;
+            }
+        }
+    }
+
+    if (stats_enabled) thread_stats().cells += (unsigned long long)n * m;
+    const int score = Lastline[m];
+    arena.rewind(start);
+    return score;
+}
+
+int QueryProfile::bound(const char* X, int n) const
+{
+    //at most shared residues can match, code 0 never matches
+    int counts[256];
+    std::memset(counts, 0, sizeof(int) * codes);
+    for (int i=0; i<n; i++)
+    {
+        counts[code[(unsigned char)X[i]]]++;
+    }
+    int shared = 0;
+    for (int c=1; c<codes; c++)
+    {
+        shared += counts[c] < composition[c] ? counts[c] : composition[c];
+    }
+
+    //d aligned columns of which at most min(shared, d) match, n+m-2d gap columns;
+    //linear in d between the kinks, so the maximum is at one of them
+    const int longest = n < m ? n : m;
+    const int kinks[3] = { 0, shared < longest ? shared : longest, longest };
+    const int diag = sc.match > sc.mismatch ? sc.match : sc.mismatch;
+    int best = INT_MIN;
+    for (int c=0; c<3; c++)
+    {
+        const int d = kinks[c];
+        const int matches = shared < d ? shared : d;
+        const int reach = matches * diag + (d - matches) * sc.mismatch + (n + m - 2*d) * sc.gap;
+        if (reach > best) best = reach;
+    }
+    return best;
+}
+
+void QueryProfile::score_records(const char* const* X, const int* n, int count, Arena& arena, int* scores,
+                                 int cutoff) const
+{
+    const ArenaMark start = arena.mark();
+    int* order = arena.alloc<int>(count);
+    BatchPair* pairs = arena.alloc<BatchPair>(count);
+    int* pair_scores = arena.alloc<int>(count);
+    int npairs = 0;
+
+    for (int k=0; k<count; k++)
+    {
+        if (cutoff != INT_MIN)
+        {
+            scores[k] = bound(X[k], n[k]);
+            if (scores[k] < cutoff) continue;
+        }
+        if (n[k] <= BATCH_MAX_LEN && m <= BATCH_MAX_LEN) order[npairs++] = k;
+        else scores[k] = score(X[k], n[k], arena, cutoff);
+    }
+
+    //records of similar length share a lockstep group, so few lanes idle on padding
+    std::sort(order, order + npairs, [n](int a, int b){ return n[a] < n[b]; });
+    for (int p=0; p<npairs; p++)
+    {
+        const BatchPair pair = { X[order[p]], n[order[p]], Q, m };
+        pairs[p] = pair;
+    }
+    batch_score(pairs, npairs, sc, arena, pair_scores, &lanes, cutoff);
+    for (int p=0; p<npairs; p++)
+    {
+        scores[order[p]] = pair_scores[p];
+    }
+
+    arena.rewind(start);
+}
+
+
+std::vector<SearchHit> search_database(const std::string& query, FastaReader& db, const SearchConfig& config)
+{
+    const QueryProfile profile(query.data(), query.length(), config.scoring);
+    HitHeap heap(config.top_k);
+    ThreadPool pool(config.threads);
+    SearchChunkPool chunks(2 * pool.size());
+
+    //STEP 1: score every record, the reader stays at most two chunks per worker ahead
+    long position = 0;
+    bool more = true;
+    while (more)
+    {
+        SearchChunk* chunk = chunks.take();
+        chunk->first = position;
+        chunk->count = 0;
+        std::size_t residues = 0;
+        {
+            StatsTimer io(&AlignStats::io_seconds);
+            while (chunk->count < SEARCH_CHUNK_RECORDS && residues < SEARCH_CHUNK_RESIDUES)
+            {
+                if ((int)chunk->records.size() == chunk->count) chunk->records.resize(chunk->count + 1);
+                more = db.next(chunk->records[chunk->count]);
+                if (!more) break;
+                residues += chunk->records[chunk->count].sequence.size();
+                chunk->count++;
+            }
+        }
+        position += chunk->count;
+
+        if (chunk->count == 0)
+        {
+            chunks.give(chunk);
+            continue;
+        }
+        pool.submit([&profile, &heap, &chunks, chunk]
+        {
+            score_chunk(profile, *chunk, heap);
+            chunks.give(chunk);
+        });
+    }
+    pool.wait();
+
+    //STEP 2: traceback of the survivors only
+    std::vector<SearchHit> hits = heap.sorted();
+    if (config.traceback)
+    {
+        AlignerConfig align_config = default_config();
+        align_config.scoring = config.scoring;
+        const Aligner aligner(align_config);
+        for (std::size_t h=0; h<hits.size(); h++)
+        {
+            SearchHit* hit = &hits[h];
+            pool.submit([&aligner, &query, hit]
+            {
+                const AlignResult r = aligner.align(query.data(), query.length(),
+                                                    hit->sequence.data(), hit->sequence.length(), thread_arena());
+                hit->A_1.assign(r.A_1, r.length);
+                hit->A_2.assign(r.A_2, r.length);
+            });
+        }
+        pool.wait();
+    }
+
+    return hits;
+}
+
+
+//Functions
+static void score_chunk(const QueryProfile& profile, SearchChunk& chunk, HitHeap& heap)
+{
+    Arena& arena = thread_arena();
+    arena.reset();
+    const char** X = arena.alloc<const char*>(chunk.count);
+    int* n = arena.alloc<int>(chunk.count);
+    int* scores = arena.alloc<int>(chunk.count);
+    for (int k=0; k<chunk.count; k++)
+    {
+        X[k] = chunk.records[k].sequence.data();
+        n[k] = chunk.records[k].sequence.length();
+    }
+
+    //scores below the cutoff are bounds, rejected by the heap like low scores
+    const int cutoff = heap.cutoff();
+    profile.score_records(X, n, chunk.count, arena, scores, cutoff);
+    if (stats_enabled) thread_stats().pairs += chunk.count;
+    stats_record_arena(arena);
+
+    for (int k=0; k<chunk.count; k++)
+    {
+        if (scores[k] < cutoff)
+        {
+            if (stats_enabled) thread_stats().pruned++;
+            continue;
+        }
+        heap.offer(chunk.first + k, scores[k], chunk.records[k]);
+    }
+}
@@ -0,0 +1,101 @@
+/*
+ * Search: one query against a database of sequences
+ *
+ * The query is prepared once: a query profile (score of every residue against every
+ * query position) for the scalar kernel, and its broadcast SIMD lanes (BatchQuery)
+ * for the lockstep kernels. Database records are streamed in chunks to a ThreadPool;
+ * each worker scores its chunk with the NWScore recurrence only and offers the
+ * scores to a shared top-k heap. Full traceback is run for the survivors only.
+ *
+ * Once the heap is full its k-th score is a cutoff, and hopeless records stop early:
+ * before any DP, the bound from their length and composition (residues shared with the
+ * query) is checked, and while their rows are computed, the best cell of the row plus the
+ * best completion of the remaining rows (every SEARCH_BOUND_ROWS rows).
+ *
+ * Hits are ordered by decreasing score, then by position in the database, so the
+ * result does not depend on the number of threads.
+ *
+ * Usage:
+ *   SearchConfig config = default_search_config();
+ *   config.top_k = 50;
+ *   FastaReader db(in);
+ *   std::vector<SearchHit> hits = search_database(query, db, config);
+ *
+ */
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <climits>
+#include <string>
+#include <vector>
+
+#include "Arena.h"
+#include "BatchAlign.h"
+#include "Fasta.h"
+#include "Scoring.h"
+
+//Records handed to a worker at a time, and residues after which a chunk is closed early
+#define SEARCH_CHUNK_RECORDS 1024
+#define SEARCH_CHUNK_RESIDUES (1 << 20)
+
+//Rows between two score-bound checks of the scalar kernel
+#define SEARCH_BOUND_ROWS 32
+
+struct SearchConfig
+{
+    Scoring scoring;
+    int top_k;
+    int threads;                //<= 0: one per hardware thread
+    bool traceback;             //align the survivors
+};
+
+struct SearchHit
+{
+    long record;                //position in the database, from 0
+    int score;
+    std::string name;
+    std::string sequence;
+    std::string A_1;            //aligned query, empty without traceback
+    std::string A_2;            //aligned record
+};
+
+//default_search_config: default scoring, 10 hits, all cores, with traceback
+SearchConfig default_search_config();
+
+//QueryProfile: the query prepared once for every record it is scored against
+class QueryProfile
+{
+public:
+    QueryProfile(const char* Q, int m, const Scoring& sc);
+
+    QueryProfile(const QueryProfile&) = delete;
+    QueryProfile& operator=(const QueryProfile&) = delete;
+
+    //score: global alignment score of the query against X[0...n) (scalar profile kernel);
+    //a score below cutoff is only an upper bound
+    int score(const char* X, int n, Arena& arena, int cutoff = INT_MIN) const;
+
+    //bound: upper bound of score() from the length and composition of X, without DP
+    int bound(const char* X, int n) const;
+
+    //score_records: scores[k] of the query against X[k][0...n[k]), scores below cutoff are
+    //only upper bounds; records up to BATCH_MAX_LEN go to the lockstep kernels
+    void score_records(const char* const* X, const int* n, int count, Arena& arena, int* scores,
+                       int cutoff = INT_MIN) const;
+
+private:
+    const char* Q;
+    int m;
+    Scoring sc;
+    unsigned char code[256];    //residue -> row of profile
+    int codes;
+    std::vector<int> composition;   //composition[c]: residues of the query with code c
+    std::vector<int> profile;   //profile[code*m + j]: score of the residue against Q[j]
+    BatchQuery lanes;
+};
+
+//search_database: the config.top_k best records of db against query
+std::vector<SearchHit> search_database(const std::string& query, FastaReader& db, const SearchConfig& config);
+
+#endif //SEARCH_H
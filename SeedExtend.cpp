@@ -0,0 +1,247 @@
+/*
+ * SeedExtend: minimizer anchors, chaining and gap filling, see SeedExtend.h
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "Alignment.h"
+#include "SeedExtend.h"
+#include "Stats.h"
+
+struct Minimizer
+{
+    uint64_t hash;
+    int pos;
+};
+
+//Anchor: exact match of length len at X[x] and Y[y]
+struct Anchor
+{
+    int x;
+    int y;
+    int len;
+};
+
+//Useful tools
+static int minimizers(const char* S, int len, Arena& arena, Minimizer*& out);
+static int find_anchors(const char* X, int n, const char* Y, int m, Arena& arena, Anchor*& out);
+static int chain_anchors(Anchor* anchors, int count, Arena& arena);
+static void align_gap(const char* X, int n, const char* Y, int m, const Scoring& sc, Arena& arena,
+                      char* A_1, char* A_2, int& len);
+
+
+void seed_extend_into(const char* X, int n, const char* Y, int m, const Scoring& sc, Arena& arena,
+                      char* A_1, char* A_2, int& len)
+{
+    const ArenaMark start = arena.mark();
+
+    Anchor* anchors;
+    const int found = find_anchors(X, n, Y, m, arena, anchors);
+    const int count = chain_anchors(anchors, found, arena);
+
+    //exact matches between the stretches aligned by the engines
+    int px = 0, py = 0;
+    for (int a=0; a<count; a++)
+    {
+        align_gap(X + px, anchors[a].x - px, Y + py, anchors[a].y - py, sc, arena, A_1, A_2, len);
+        std::memcpy(A_1 + len, X + anchors[a].x, anchors[a].len);
+        std::memcpy(A_2 + len, Y + anchors[a].y, anchors[a].len);
+        len += anchors[a].len;
+        px = anchors[a].x + anchors[a].len;
+        py = anchors[a].y + anchors[a].len;
+    }
+    align_gap(X + px, n - px, Y + py, m - py, sc, arena, A_1, A_2, len);
+
+    arena.rewind(start);
+}
+
+
+//Functions
+//Invertible mix of a 64-bit value, so that the minimizer order looks random
+static inline uint64_t mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+//minimizers: smallest k-mer hash of every window of SEED_W k-mers (leftmost on ties), each position once
+static int minimizers(const char* S, int len, Arena& arena, Minimizer*& out)
+{
+    const int kmers = len - SEED_K + 1;
+    out = arena.alloc<Minimizer>(kmers > 0 ? kmers : 0);
+    if (kmers <= 0) return 0;
+
+    //rolling polynomial hash of every k-mer
+    const uint64_t base = 0x100000001b3ULL;
+    uint64_t top = 1;
+    for (int c=1; c<SEED_K; c++) top *= base;
+    uint64_t* hashes = arena.alloc<uint64_t>(kmers);
+    uint64_t h = 0;
+    for (int c=0; c<len; c++)
+    {
+        if (c >= SEED_K) h -= top * (unsigned char)S[c - SEED_K];
+        h = h * base + (unsigned char)S[c];
+        if (c >= SEED_K - 1) hashes[c - SEED_K + 1] = mix64(h);
+    }
+
+    int count = 0;
+    int best = -1;
+    for (int end=0; end<kmers; end++)
+    {
+        const int first = end - SEED_W + 1;
+        if (best < 0 || best < first)
+        {
+            //the minimum left the window: rescan it
+            best = first > 0 ? first : 0;
+            for (int p=best+1; p<=end; p++)
+            {
+                if (hashes[p] < hashes[best]) best = p;
+            }
+        }
+        else if (hashes[end] < hashes[best])
+        {
+            best = end;
+        }
+
+        if (first >= 0 || end == kmers - 1)
+        {
+            if (count == 0 || out[count-1].pos != best)
+            {
+                out[count].hash = hashes[best];
+                out[count].pos = best;
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+//find_anchors: minimizers of X found in the index of Y's minimizers, verified as exact k-mer matches
+static int find_anchors(const char* X, int n, const char* Y, int m, Arena& arena, Anchor*& out)
+{
+    Minimizer* mx;
+    Minimizer* my;
+    const int cx = minimizers(X, n, arena, mx);
+    const int cy = minimizers(Y, m, arena, my);
+    std::sort(my, my + cy, [](const Minimizer& a, const Minimizer& b)
+    {
+        return a.hash < b.hash || (a.hash == b.hash && a.pos < b.pos);
+    });
+
+    //two passes: count, then fill
+    int count = 0;
+    out = NULL;
+    for (int pass=0; pass<2; pass++)
+    {
+        if (pass == 1) out = arena.alloc<Anchor>(count);
+        count = 0;
+        for (int i=0; i<cx; i++)
+        {
+            const Minimizer key = { mx[i].hash, -1 };
+            const Minimizer* first = std::lower_bound(my, my + cy, key, [](const Minimizer& a, const Minimizer& b)
+            {
+                return a.hash < b.hash || (a.hash == b.hash && a.pos < b.pos);
+            });
+            const Minimizer* last = first;
+            while (last < my + cy && last->hash == key.hash) last++;
+            if (last - first > SEED_MAX_OCC) continue;
+
+            for (const Minimizer* hit = first; hit < last; hit++)
+            {
+                if (std::memcmp(X + mx[i].pos, Y + hit->pos, SEED_K) != 0) continue;
+                if (pass == 1)
+                {
+                    const Anchor a = { mx[i].pos, hit->pos, SEED_K };
+                    out[count] = a;
+                }
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+//chain_anchors: best co-linear chain, cut into non-overlapping exact matches (in place); returns their number
+static int chain_anchors(Anchor* anchors, int count, Arena& arena)
+{
+    if (count == 0) return 0;
+    std::sort(anchors, anchors + count, [](const Anchor& a, const Anchor& b)
+    {
+        return a.x < b.x || (a.x == b.x && a.y < b.y);
+    });
+
+    //score[i]: bases covered by the best chain ending in anchor i, minus its diagonal changes
+    int* score = arena.alloc<int>(count);
+    int* from = arena.alloc<int>(count);
+    int best = 0;
+    for (int i=0; i<count; i++)
+    {
+        score[i] = SEED_K;
+        from[i] = -1;
+        const int stop = i - SEED_LOOKBACK > 0 ? i - SEED_LOOKBACK : 0;
+        for (int j=i-1; j>=stop; j--)
+        {
+            const int dx = anchors[i].x - anchors[j].x;
+            const int dy = anchors[i].y - anchors[j].y;
+            if (dx <= 0 || dy <= 0 || dx > SEED_MAX_GAP || dy > SEED_MAX_GAP) continue;
+            const int gain = std::min(std::min(dx, dy), SEED_K);
+            const int shift = dx > dy ? dx - dy : dy - dx;
+            if (score[j] + gain - shift > score[i])
+            {
+                score[i] = score[j] + gain - shift;
+                from[i] = j;
+            }
+        }
+        if (score[i] > score[best]) best = i;
+    }
+
+    //backtrack, then keep the chain in order of X
+    int length = 0;
+    for (int i=best; i>=0; i=from[i]) length++;
+    Anchor* chain = arena.alloc<Anchor>(length);
+    int c = length;
+    for (int i=best; i>=0; i=from[i]) chain[--c] = anchors[i];
+
+    //overlaps on the same diagonal extend the match, others are trimmed off
+    int kept = 0;
+    for (int a=0; a<length; a++)
+    {
+        Anchor next = chain[a];
+        if (kept > 0)
+        {
+            Anchor& prev = anchors[kept-1];
+            const int x_end = prev.x + prev.len, y_end = prev.y + prev.len;
+            if (next.x - next.y == prev.x - prev.y && next.x <= x_end)
+            {
+                prev.len = std::max(prev.len, next.x + next.len - prev.x);
+                continue;
+            }
+            const int overlap = std::max(x_end - next.x, y_end - next.y);
+            if (overlap >= next.len) continue;
+            if (overlap > 0)
+            {
+                next.x += overlap;
+                next.y += overlap;
+                next.len -= overlap;
+            }
+        }
+        anchors[kept++] = next;
+    }
+    return kept;
+}
+
+//align_gap: exact alignment of a stretch between two anchors, engine chosen as ENGINE_AUTO does
+static void align_gap(const char* X, int n, const char* Y, int m, const Scoring& sc, Arena& arena,
+                      char* A_1, char* A_2, int& len)
+{
+    if (n == 0 && m == 0) return;
+    if ((double)(n+1)*(m+1) <= AUTO_NW_MAX_CELLS) NeedlemanWunsch_into(X, n, Y, m, sc, arena, A_1, A_2, len);
+    else if (checkpoint_bytes(n, m) <= AUTO_CHECKPOINT_MAX_BYTES) Checkpoint_into(X, n, Y, m, sc, arena, A_1, A_2, len);
+    else Hirschberg_into(X, n, Y, m, sc, arena, A_1, A_2, len);
+}
@@ -0,0 +1,39 @@
+/*
+ * SeedExtend: approximate global alignment of long, similar sequences
+ *
+ * Y is indexed by its (SEED_K, SEED_W) minimizers; the minimizers of X are looked up
+ * in the index and every exact k-mer match is an anchor. Anchors are chained by
+ * dynamic programming (co-linear, bounded gaps, diagonal changes penalised), the
+ * chain is cut into non-overlapping exact matches, and only the stretches between
+ * them are aligned, with Needleman-Wunsch or Hirschberg as ENGINE_AUTO would.
+ *
+ * On similar sequences the result stays close to the optimal alignment, in time
+ * roughly proportional to the length plus the cells of the gaps. Without any
+ * anchor the whole pair is aligned exactly.
+ *
+ * References:
+ * - Roberts, M., et al. (2004). Reducing storage requirements for biological sequence
+ *   comparison. Bioinformatics, 20(18), 3363–3369.
+ * - Li, H. (2018). Minimap2: pairwise alignment for nucleotide sequences.
+ *   Bioinformatics, 34(18), 3094–3100.
+ *
+ */
+
+#ifndef SEED_EXTEND_H
+#define SEED_EXTEND_H
+
+#include "Arena.h"
+#include "Scoring.h"
+
+#define SEED_K 15                   //k-mer length
+#define SEED_W 10                   //k-mers per minimizer window
+#define SEED_MAX_OCC 32             //minimizers more frequent than this in Y are repeats, skipped
+#define SEED_LOOKBACK 64            //anchors tried as predecessor in the chaining DP
+#define SEED_MAX_GAP 5000           //largest distance between two chained anchors
+
+//seed_extend_into: appends an alignment of X[0...n) against Y[0...m) to A_1/A_2 from
+//position len; A_1 and A_2 must hold n+m characters
+void seed_extend_into(const char* X, int n, const char* Y, int m, const Scoring& sc, Arena& arena,
+                      char* A_1, char* A_2, int& len);
+
+#endif //SEED_EXTEND_H
@@ -0,0 +1,88 @@
+/*
+ * Stats: per-run telemetry, see Stats.h
+ */
+
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "Stats.h"
+
+bool stats_enabled = false;
+
+//Every thread's counters, registered on first use and summed by stats_write_json
+static std::mutex registry_lock;
+static std::vector<AlignStats*> registry;
+
+AlignStats& thread_stats()
+{
+    thread_local AlignStats* stats = NULL;
+    if (!stats)
+    {
+        stats = new AlignStats;
+        std::memset(stats, 0, sizeof(AlignStats));
+        std::lock_guard<std::mutex> guard(registry_lock);
+        registry.push_back(stats);
+    }
+    return *stats;
+}
+
+void stats_record_arena(const Arena& arena)
+{
+    if (!stats_enabled) return;
+    AlignStats& s = thread_stats();
+    s.arena_heap_allocations = arena.heap_allocations();
+    s.arena_heap_bytes = arena.heap_bytes();
+    s.arena_peak_bytes = arena.high_water();
+}
+
+void stats_write_json(std::ostream& out, double total_seconds)
+{
+    AlignStats sum;
+    std::memset(&sum, 0, sizeof(AlignStats));
+    {
+        std::lock_guard<std::mutex> guard(registry_lock);
+        for (std::size_t t=0; t<registry.size(); t++)
+        {
+            const AlignStats& s = *registry[t];
+            sum.pairs += s.pairs;
+            sum.cells += s.cells;
+            sum.pruned += s.pruned;
+            sum.cache_hits += s.cache_hits;
+            sum.cache_misses += s.cache_misses;
+            sum.duplicates += s.duplicates;
+            sum.fill_seconds += s.fill_seconds;
+            sum.traceback_seconds += s.traceback_seconds;
+            sum.io_seconds += s.io_seconds;
+            if (s.max_depth > sum.max_depth) sum.max_depth = s.max_depth;
+            sum.nodes += s.nodes;
+            sum.arena_heap_allocations += s.arena_heap_allocations;
+            sum.arena_heap_bytes += s.arena_heap_bytes;
+            sum.arena_peak_bytes += s.arena_peak_bytes;
+        }
+    }
+
+    //Throughput of the run: fill_seconds add up over the threads, so divide by the wall time
+    const double gcups = total_seconds > 0 ? sum.cells / total_seconds / 1e9 : 0;
+    out << "{"
+        << "\"threads\": " << registry.size()
+        << ", \"pairs\": " << sum.pairs
+        << ", \"cells\": " << sum.cells
+        << ", \"pruned\": " << sum.pruned
+        << ", \"duplicates\": " << sum.duplicates
+        << ", \"cache\": {\"hits\": " << sum.cache_hits << ", \"misses\": " << sum.cache_misses << "}"
+        << ", \"gcups\": " << gcups
+        << ", \"seconds\": {"
+        << "\"total\": " << total_seconds
+        << ", \"fill\": " << sum.fill_seconds
+        << ", \"traceback\": " << sum.traceback_seconds
+        << ", \"io\": " << sum.io_seconds
+        << "}, \"hirschberg\": {"
+        << "\"max_depth\": " << sum.max_depth
+        << ", \"nodes\": " << sum.nodes
+        << "}, \"arena\": {"
+        << "\"heap_allocations\": " << sum.arena_heap_allocations
+        << ", \"heap_bytes\": " << sum.arena_heap_bytes
+        << ", \"peak_bytes\": " << sum.arena_peak_bytes
+        << "}}" << std::endl;
+}
@@ -0,0 +1,88 @@
+/*
+ * Stats: per-run telemetry of the alignment engines
+ *
+ * Counters live in a per-thread AlignStats and are only touched when stats_enabled
+ * is set (--stats on the command line), so a disabled run pays one predictable
+ * branch per engine call. stats_write_json() sums the counters of every thread.
+ *
+ * - cells: DP cells computed (a pair rerun on wider SIMD lanes counts again)
+ * - pruned: database records given up by the score bound of a search
+ * - cache hits and misses: lookups of the result cache (ResultCache.h)
+ * - duplicates: pairs of a batch identical to an earlier one, aligned only once
+ * - fill / traceback / io seconds: time spent in each phase, summed over the threads
+ * - gcups: cells over the wall time of the run
+ * - hirschberg depth and nodes: deepest recursion level and number of calls
+ * - arena bytes: heap taken by the scratch arenas and their peak use
+ *
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <chrono>
+#include <ostream>
+
+#include "Arena.h"
+
+struct AlignStats
+{
+    unsigned long long pairs;
+    unsigned long long cells;
+    unsigned long long pruned;
+    unsigned long long cache_hits;
+    unsigned long long cache_misses;
+    unsigned long long duplicates;
+    double fill_seconds;
+    double traceback_seconds;
+    double io_seconds;
+    int depth;                          //current Hirschberg recursion level
+    int max_depth;
+    unsigned long long nodes;
+    unsigned long long arena_heap_allocations;
+    unsigned long long arena_heap_bytes;
+    unsigned long long arena_peak_bytes;
+};
+
+//stats_enabled: set once before the first alignment, read by every engine
+extern bool stats_enabled;
+
+//thread_stats: counters of the calling thread
+AlignStats& thread_stats();
+
+//stats_record_arena: copies the arena's heap and peak usage into the thread's counters
+void stats_record_arena(const Arena& arena);
+
+//stats_write_json: counters of all threads, summed, as one JSON object
+void stats_write_json(std::ostream& out, double total_seconds);
+
+//StatsTimer: adds the lifetime of the scope to the thread's slot (e.g. &AlignStats::fill_seconds)
+//when stats are enabled; a disabled timer does not touch the counters
+class StatsTimer
+{
+public:
+    explicit StatsTimer(double AlignStats::* slot) : target(stats_enabled ? &(thread_stats().*slot) : NULL)
+    {
+        if (target) start = std::chrono::steady_clock::now();
+    }
+
+    ~StatsTimer()
+    {
+        stop();
+    }
+
+    //stop: ends the measurement before the end of the scope
+    void stop()
+    {
+        if (target) *target += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        target = NULL;
+    }
+
+    StatsTimer(const StatsTimer&) = delete;
+    StatsTimer& operator=(const StatsTimer&) = delete;
+
+private:
+    double* target;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif //STATS_H
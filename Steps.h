@@ -0,0 +1,41 @@
+/*
+ * Steps: the tie rule of the tracebacks, shared by the engines that record steps
+ *
+ * Internal to the library. Needleman-Wunsch, the checkpoints and the streaming engine all
+ * return the same alignment because they break ties the same way, here: a cell's step is
+ * the diagonal when it reaches the maximum, then up, then left. fill_rows, the row kernel
+ * of the checkpoints (defined in Alignment.cpp), also serves the Realigner.
+ *
+ */
+
+#ifndef STEPS_H
+#define STEPS_H
+
+#include <cstdint>
+
+#include "Scoring.h"
+
+//Step: predecessor of a cell on the optimal path
+enum Step { STEP_DIAG, STEP_UP, STEP_LEFT };
+
+//best_step: max3 of the three moves into a cell, recording which one when STEPS
+template <bool STEPS>
+inline int best_step(int diag, int up, int left, uint8_t* step)
+{
+    const int h = max3(left, up, diag);
+    if (STEPS)
+    {
+        //STEP_DIAG, STEP_UP or STEP_LEFT without a branch
+        const int not_diag = h != diag, not_up = h != up;
+        *step = not_diag + (not_diag & not_up);
+    }
+    return h;
+}
+
+//fill_rows: advances row from D(r0, 0...m) to D(r1, 0...m) of X against Y; with STEPS the
+//step of cell (r, c) goes to steps[(r-r0-1)*w + c]. Two rows per sweep
+template <bool STEPS>
+void fill_rows(const char* X, int r0, int r1, const char* Y, int m, const Scoring& sc,
+               int* row, uint8_t* steps, int w);
+
+#endif //STEPS_H
@@ -0,0 +1,549 @@
+/*
+ * StreamAlign: disk-backed checkpointed alignment, see StreamAlign.h
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "StreamAlign.h"
+#include "AlignFrames.h"
+#include "Stats.h"
+#include "Steps.h"
+
+//Useful tools
+static void release_pages(const char* from, const char* to);
+static int spill_file(const std::string& dir, std::string& error);
+static bool write_at(int fd, const void* buffer, std::size_t len, off_t at);
+static bool read_at(int fd, void* buffer, std::size_t len, off_t at);
+
+//SpillFiles: the unlinked scratch files of one alignment, closed on every return
+struct SpillFiles
+{
+    int fd[4];
+    SpillFiles() { fd[0] = fd[1] = fd[2] = fd[3] = -1; }
+    ~SpillFiles()
+    {
+        for (int k=0; k<4; k++) if (fd[k] >= 0) close(fd[k]);
+    }
+};
+
+//PathWriter: runs of the path as the traceback finds them, last first; spilled to a file
+//and written out as a CIGAR in forward order by finish()
+class PathWriter
+{
+public:
+    PathWriter(int spill) : fd(spill), current(0), count(0), spilled(0), total(0)
+    {
+        runs.reserve(STREAM_IO_CHUNK / sizeof(Run));
+    }
+
+    bool add(char op)
+    {
+        total++;
+        if (op == current)
+        {
+            count++;
+            return true;
+        }
+        const bool ok = push();
+        current = op;
+        count = 1;
+        return ok;
+    }
+
+    long long length() const { return total; }
+
+    bool finish(int out_fd);
+
+private:
+    struct Run
+    {
+        long long count;
+        char op;
+    };
+
+    bool push();
+
+    int fd;
+    char current;
+    long long count;
+    std::vector<Run> runs;
+    long long spilled;          //runs already in the file
+    long long total;
+};
+
+
+MappedSequence::MappedSequence() : base(NULL), size(0), first(0), line(0), residues(0)
+{
+}
+
+MappedSequence::~MappedSequence()
+{
+    if (base) munmap(const_cast<char*>(base), size);
+}
+
+bool MappedSequence::open(const char* path, std::string& error)
+{
+    const int fd = ::open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        error = std::string("cannot open ") + path + ": " + std::strerror(errno);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    size = st.st_size;
+    if (size > 0)
+    {
+        void* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            error = std::string("cannot map ") + path + ": " + std::strerror(errno);
+            close(fd);
+            return false;
+        }
+        base = static_cast<const char*>(map);
+        madvise(map, size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    //one pass over the file, a chunk at a time: header, then lines of equal length
+    std::size_t at = 0;
+    if (size > 0 && base[0] == '>')
+    {
+        const void* end = std::memchr(base, '\n', size);
+        at = end ? static_cast<const char*>(end) - base + 1 : size;
+    }
+    first = at;
+    line = 0;
+    residues = 0;
+    long lines = 0;
+    long last = -1;             //length of the line before, -1 at the start
+    bool short_line = false;
+    std::size_t released = 0;
+    while (at < size)
+    {
+        const void* found = std::memchr(base + at, '\n', size - at);
+        const std::size_t end = found ? static_cast<const char*>(found) - base : size;
+        const long len = end - at;
+        if (len > 0 && base[at] == '>')
+        {
+            error = std::string(path) + ": more than one record";
+            return false;
+        }
+        if (len > 0)
+        {
+            if (short_line || (last >= 0 && len > last) || std::memchr(base + at, '\r', len))
+            {
+                error = std::string(path) + ": sequence lines must all have the same length";
+                return false;
+            }
+            if (last >= 0 && len < last) short_line = true;
+            if (lines == 0) line = len;
+            last = len;
+            residues += len;
+            lines++;
+        }
+        else if (found && last >= 0)
+        {
+            short_line = true;          //blank lines only at the end
+        }
+        at = end + 1;
+        if (at - released >= STREAM_IO_CHUNK)
+        {
+            release_pages(base + released, base + std::min(at, size));
+            released = at;
+        }
+    }
+    release_pages(base + released, base + size);
+    if (lines <= 1) line = 0;
+    return true;
+}
+
+void MappedSequence::copy(long pos, long count, char* out) const
+{
+    if (count <= 0) return;
+    const char* from = base + first + (line ? pos / line * (line+1) + pos % line : pos);
+    const char* to = from;
+    while (count > 0)
+    {
+        const char* p = base + first + (line ? pos / line * (line+1) + pos % line : pos);
+        const long run = line ? std::min(count, line - pos % line) : count;
+        std::memcpy(out, p, run);
+        out += run;
+        pos += run;
+        count -= run;
+        to = p + run;
+    }
+    release_pages(from, to);
+}
+
+
+StreamConfig default_stream_config()
+{
+    StreamConfig config;
+    config.scoring = default_scoring();
+    config.memory_limit = STREAM_DEFAULT_MEMORY;
+    const char* tmp = std::getenv("TMPDIR");
+    config.spill_dir = tmp ? tmp : "/tmp";
+    config.strip_rows = 0;
+    config.tile_columns = 0;
+    return config;
+}
+
+
+bool stream_align(const MappedSequence& X, const MappedSequence& Y, const StreamConfig& config, int cigar_fd,
+                  StreamResult& result, std::string& error)
+{
+    const Scoring& sc = config.scoring;
+    const long n = X.length(), m = Y.length();
+    result.score = 0;
+    result.length = 0;
+    result.cells = 0;
+
+    //row differences D(i,j) - D(i,j-1) - gap lie in [0...best - 2*gap] and are kept as bytes
+    const int best = sc.match > sc.mismatch ? sc.match : sc.mismatch;
+    if (best - 2*sc.gap > 255)
+    {
+        error = "scores too far apart for one-byte checkpoints";
+        return false;
+    }
+
+    //STEP 1: tile widths and strip height within the memory limit; the forward pass holds
+    //a tile of Y, its row and a checkpoint segment, the traceback a tile's steps and the
+    //edges of every tile of a strip
+    const std::size_t fixed = STREAM_RESERVE + 4 * (std::size_t)STREAM_IO_CHUNK;
+    if (config.memory_limit < fixed + ((std::size_t)1 << 20))
+    {
+        error = "memory limit below " + std::to_string((fixed >> 20) + 1) + " MB";
+        return false;
+    }
+    const double budget = config.memory_limit - fixed;
+    const long forward_tile = std::max(1L, std::min(m, (long)(budget / 6)));
+    const long tile = std::max(1L, std::min(m, config.tile_columns > 0 ? config.tile_columns : (long)STREAM_TILE_WIDTH));
+    const long tiles = (m + tile - 1) / tile;
+    long strip = config.strip_rows;
+    if (strip <= 0)
+    {
+        strip = (long)((budget - 6.0 * tile) / (tile + 1 + 4.0 * tiles + 8));
+        if (strip < 1 && n > 0)
+        {
+            error = "memory limit too small for a " + std::to_string(m) + " residue sequence";
+            return false;
+        }
+    }
+    strip = std::max(1L, std::min(strip, n));
+
+    SpillFiles files;
+    for (int k=0; k<4; k++)
+    {
+        files.fd[k] = spill_file(config.spill_dir, error);
+        if (files.fd[k] < 0) return false;
+    }
+    const int checkpoints = files.fd[0];
+    PathWriter path(files.fd[3]);
+    unsigned long long cells = 0;
+
+    //STEP 2: forward pass, tile by tile, each tile's right edge spilled for the next
+    if (n > 0 && m > 0)
+    {
+        StatsTimer fill(&AlignStats::fill_seconds);
+        std::vector<char> ytile(forward_tile), xchunk(STREAM_IO_CHUNK);
+        std::vector<uint8_t> segment(forward_tile), edge_in(STREAM_IO_CHUNK), edge_out(STREAM_IO_CHUNK);
+        std::vector<int> row(forward_tile + 1);
+        int w = 0;
+        for (long c0=0, t=0; c0<m; c0+=forward_tile, t++)
+        {
+            w = std::min(m - c0, forward_tile);
+            const bool has_left = c0 > 0, has_right = c0 + w < m;
+            const int in_fd = files.fd[1 + (t+1) % 2], out_fd = files.fd[1 + t % 2];
+            Y.copy(c0, w, ytile.data());
+            for (int k=0; k<=w; k++)
+            {
+                row[k] = (int)(c0 + k) * sc.gap;
+            }
+
+            for (long i0=0; i0<n; i0+=STREAM_IO_CHUNK)
+            {
+                const long count = std::min(n - i0, (long)STREAM_IO_CHUNK);
+                X.copy(i0, count, xchunk.data());
+                if (has_left && !read_at(in_fd, edge_in.data(), count, i0))
+                {
+                    error = std::string("cannot read spilled column: ") + std::strerror(errno);
+                    return false;
+                }
+                for (long r=0; r<count; r++)
+                {
+                    const long i = i0 + r;
+                    if (i % strip == 0)
+                    {
+                        for (int k=1; k<=w; k++)
+                        {
+                            segment[k-1] = row[k] - row[k-1] - sc.gap;
+                        }
+                        if (!write_at(checkpoints, segment.data(), w, (off_t)(i / strip) * m + c0))
+                        {
+                            error = std::string("cannot write checkpoint: ") + std::strerror(errno);
+                            return false;
+                        }
+                    }
+
+                    const char x = xchunk[r];
+                    const int last = row[w];
+                    int diag = row[0];
+                    row[0] += has_left ? edge_in[r] + sc.gap : sc.gap;
+                    for (int k=1; k<=w; k++)
+                    {
+                        const int up = row[k];
+                        row[k] = max3(row[k-1] + sc.gap, up + sc.gap, diag + match_or_mismatch(x, ytile[k-1], sc));
+                        diag = up;
+                    }
+                    edge_out[r] = row[w] - last - sc.gap;
+                }
+                if (has_right && !write_at(out_fd, edge_out.data(), count, i0))
+                {
+                    error = std::string("cannot spill column: ") + std::strerror(errno);
+                    return false;
+                }
+            }
+            cells += (unsigned long long)n * w;
+        }
+        result.score = row[w];
+    }
+    else
+    {
+        result.score = (int)(n + m) * sc.gap;
+    }
+
+    //STEP 3: traceback strip by strip: edges of the strip's tiles, then the tiles on the
+    //path with their steps, right to left, until the path leaves through the checkpoint row
+    {
+        StatsTimer traceback(&AlignStats::traceback_seconds);
+        const long edge_rows = (n > 0 && m > 0) ? strip + 1 : 0;
+        std::vector<int> edges((std::size_t)(m > 0 ? tiles : 0) * edge_rows);
+        std::vector<uint8_t> steps((std::size_t)(n > 0 && m > 0 ? strip : 0) * tile);
+        std::vector<uint8_t> segment(tile);
+        std::vector<int> row(tile + 1), col(edge_rows);
+        std::vector<char> ytile(tile), xstrip(n > 0 && m > 0 ? strip : 0);
+        bool ok = true;
+
+        //load_top: D(i0, c0...c0+w) into row from the checkpoint, with D(i0, c0) = corner
+        auto load_top = [&](long i0, long c0, int w, int corner)
+        {
+            row[0] = corner;
+            if (!read_at(checkpoints, segment.data(), w, (off_t)(i0 / strip) * m + c0)) return false;
+            for (int k=1; k<=w; k++)
+            {
+                row[k] = row[k-1] + segment[k-1] + sc.gap;
+            }
+            Y.copy(c0, w, ytile.data());
+            return true;
+        };
+
+        long i = n, j = m;
+        while (ok && i > 0 && j > 0)
+        {
+            const long i0 = (i-1) / strip * strip;
+            const int h = i - i0;
+            X.copy(i0, h, xstrip.data());
+
+            const long strip_tiles = (j + tile - 1) / tile;
+            for (int r=0; r<=h; r++)
+            {
+                col[r] = (int)(i0 + r) * sc.gap;
+            }
+            for (long t=0; t<strip_tiles; t++)
+            {
+                std::copy(col.begin(), col.begin() + h + 1, edges.begin() + t * edge_rows);
+                if (t == strip_tiles - 1) break;
+                const long c0 = t * tile;
+                const int w = tile;
+                if (!load_top(i0, c0, w, col[0]))
+                {
+                    ok = false;
+                    break;
+                }
+                col[0] = row[w];
+                for (int r=1; r<=h; r++)
+                {
+                    const char x = xstrip[r-1];
+                    int diag = row[0];
+                    row[0] = col[r];
+                    for (int k=1; k<=w; k++)
+                    {
+                        const int up = row[k];
+                        row[k] = max3(row[k-1] + sc.gap, up + sc.gap, diag + match_or_mismatch(x, ytile[k-1], sc));
+                        diag = up;
+                    }
+                    col[r] = row[w];
+                }
+                cells += (unsigned long long)h * w;
+            }
+
+            for (long t=strip_tiles-1; ok && i>i0; t--)
+            {
+                if (j == 0)
+                {
+                    for (; i>i0; i--) ok = path.add('I');
+                    break;
+                }
+                const long c0 = t * tile;
+                const int w = j - c0, rows = i - i0;
+                const int* left = edges.data() + t * edge_rows;
+                if (!load_top(i0, c0, w, left[0]))
+                {
+                    ok = false;
+                    break;
+                }
+                for (int r=1; r<=rows; r++)
+                {
+                    const char x = xstrip[r-1];
+                    uint8_t* s = steps.data() + (std::size_t)(r-1) * w;
+                    int diag = row[0];
+                    row[0] = left[r];
+                    for (int k=1; k<=w; k++)
+                    {
+                        const int up = row[k];
+                        row[k] = best_step<true>(diag + match_or_mismatch(x, ytile[k-1], sc), up + sc.gap,
+                                                 row[k-1] + sc.gap, &s[k-1]);
+                        diag = up;
+                    }
+                }
+                cells += (unsigned long long)rows * w;
+
+                while (ok && i > i0 && j > c0)
+                {
+                    const uint8_t step = steps[(std::size_t)(i-i0-1) * w + (j-c0-1)];
+                    ok = path.add(step == STEP_DIAG ? 'M' : (step == STEP_UP ? 'I' : 'D'));
+                    if (step != STEP_LEFT) i--;
+                    if (step != STEP_UP) j--;
+                }
+            }
+        }
+        for (; ok && i>0; i--) ok = path.add('I');
+        for (; ok && j>0; j--) ok = path.add('D');
+
+        if (!ok || !path.finish(cigar_fd))
+        {
+            error = std::string("cannot write the alignment: ") + std::strerror(errno);
+            return false;
+        }
+    }
+
+    result.length = path.length();
+    result.cells = cells;
+    if (stats_enabled)
+    {
+        thread_stats().cells += cells;
+        thread_stats().pairs++;
+    }
+    return true;
+}
+
+
+bool PathWriter::push()
+{
+    if (count == 0) return true;
+    const Run run = { count, current };
+    runs.push_back(run);
+    if (runs.size() < runs.capacity()) return true;
+    const bool ok = write_at(fd, runs.data(), runs.size() * sizeof(Run), spilled * sizeof(Run));
+    spilled += runs.size();
+    runs.clear();
+    return ok;
+}
+
+bool PathWriter::finish(int out_fd)
+{
+    if (!push()) return false;
+    count = 0;
+
+    //the runs in memory are the last ones found, so the first of the alignment; then the
+    //file, backwards a chunk at a time
+    std::string text;
+    text.reserve(STREAM_IO_CHUNK + 32);
+    long long next = spilled;
+    while (true)
+    {
+        for (std::size_t k=runs.size(); k-->0; )
+        {
+            text += std::to_string(runs[k].count);
+            text += runs[k].op;
+            if (text.size() >= STREAM_IO_CHUNK)
+            {
+                if (!write_full(out_fd, text.data(), text.size())) return false;
+                text.clear();
+            }
+        }
+        if (next == 0) break;
+        const long long chunk = std::min<long long>(next, runs.capacity());
+        next -= chunk;
+        runs.resize(chunk);
+        if (!read_at(fd, runs.data(), chunk * sizeof(Run), next * sizeof(Run))) return false;
+    }
+    return write_full(out_fd, text.data(), text.size());
+}
+
+
+//Functions
+//release_pages: drops the mapped pages of [from...to) from the resident set
+static void release_pages(const char* from, const char* to)
+{
+    const std::size_t page = sysconf(_SC_PAGESIZE);
+    const uintptr_t start = reinterpret_cast<uintptr_t>(from) / page * page;
+    const uintptr_t end = reinterpret_cast<uintptr_t>(to);
+    if (end > start) madvise(reinterpret_cast<void*>(start), end - start, MADV_DONTNEED);
+}
+
+//spill_file: an unlinked scratch file in dir
+static int spill_file(const std::string& dir, std::string& error)
+{
+    std::string name = dir + "/alignstream.XXXXXX";
+    const int fd = mkstemp(&name[0]);
+    if (fd < 0)
+    {
+        error = "cannot create a spill file in " + dir + ": " + std::strerror(errno);
+        return -1;
+    }
+    unlink(name.c_str());
+    return fd;
+}
+
+static bool write_at(int fd, const void* buffer, std::size_t len, off_t at)
+{
+    const char* p = static_cast<const char*>(buffer);
+    while (len > 0)
+    {
+        const ssize_t put = pwrite(fd, p, len, at);
+        if (put < 0 && errno == EINTR) continue;
+        if (put <= 0) return false;
+        p += put;
+        at += put;
+        len -= put;
+    }
+    return true;
+}
+
+static bool read_at(int fd, void* buffer, std::size_t len, off_t at)
+{
+    char* p = static_cast<char*>(buffer);
+    while (len > 0)
+    {
+        const ssize_t got = pread(fd, p, len, at);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        p += got;
+        at += got;
+        len -= got;
+    }
+    return true;
+}
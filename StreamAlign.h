@@ -0,0 +1,100 @@
+/*
+ * StreamAlign: global alignment of pairs larger than memory, from files to a CIGAR file
+ *
+ * Both sequences stay in their files, mapped with mmap. Residues are copied out a chunk
+ * at a time and their pages are released right after, so the mapping adds almost nothing
+ * to the resident set. The alignment is Checkpoint_into (Alignment.h) moved to disk:
+ * - forward pass: the NWScore recurrence over column tiles as wide as memory allows. The
+ *   right edge of each tile is spilled to a file and becomes the left edge of the next.
+ *   Every S-th row is written to a checkpoint file, one byte per cell
+ *   (D(i,j) - D(i,j-1) - gap).
+ * - traceback, strip by strip from the bottom: the S rows below a checkpoint are recomputed
+ *   once across the strip in tiles of STREAM_TILE_WIDTH columns, keeping the left edge of
+ *   every tile. Then the tile holding the path is recomputed with its steps, from right to
+ *   left, and the path is followed out of it.
+ * The path comes out backwards; its runs are spilled and written out as a CIGAR (M, I for
+ * a residue of X only, D for a residue of Y only) in forward order at the end.
+ *
+ * Memory is the tiles, the step matrix of one tile and the tile edges of one strip. S is
+ * the largest strip those fit in, within memory_limit. Peak RSS therefore stays under the
+ * limit whatever the lengths; disk takes n*m/S bytes of checkpoints plus two columns.
+ * Each cell is computed about twice. Ties are broken as in NeedlemanWunsch_into, so the
+ * alignment is the same.
+ *
+ * Sequence files hold one sequence: raw, or one FASTA record; lines other than the last
+ * must all have the same length (as for a samtools faidx index).
+ *
+ * Usage:
+ *   MappedSequence X, Y;
+ *   if (!X.open("x.fa", error) || !Y.open("y.fa", error)) ...
+ *   StreamConfig config = default_stream_config();
+ *   config.memory_limit = 512 << 20;
+ *   StreamResult r;
+ *   if (!stream_align(X, Y, config, cigar_fd, r, error)) ...
+ *
+ */
+
+#ifndef STREAM_ALIGN_H
+#define STREAM_ALIGN_H
+
+#include <cstddef>
+#include <string>
+
+#include "Scoring.h"
+
+#define STREAM_DEFAULT_MEMORY ((std::size_t)256 << 20)
+#define STREAM_RESERVE ((std::size_t)8 << 20)       //program, libraries and stack
+#define STREAM_IO_CHUNK (1 << 20)                   //bytes per read, write or copy buffer
+#define STREAM_TILE_WIDTH 65536                     //columns of a traceback tile
+
+//MappedSequence: read-only mapping of a sequence file
+class MappedSequence
+{
+public:
+    MappedSequence();
+    ~MappedSequence();
+
+    MappedSequence(const MappedSequence&) = delete;
+    MappedSequence& operator=(const MappedSequence&) = delete;
+
+    //open: maps path and checks its layout; false with a message in error
+    bool open(const char* path, std::string& error);
+
+    long length() const { return residues; }
+
+    //copy: residues [pos...pos+count) into out; their pages are released afterwards
+    void copy(long pos, long count, char* out) const;
+
+private:
+    const char* base;
+    std::size_t size;
+    std::size_t first;          //offset of the first residue
+    long line;                  //residues per full line, 0 when there is a single line
+    long residues;
+};
+
+struct StreamConfig
+{
+    Scoring scoring;
+    std::size_t memory_limit;   //bytes of resident memory, STREAM_RESERVE included
+    std::string spill_dir;      //checkpoint and spill files, deleted when done
+    long strip_rows;            //rows between checkpoints, 0: the largest memory_limit allows
+    long tile_columns;          //columns of a traceback tile, 0: STREAM_TILE_WIDTH
+};
+
+struct StreamResult
+{
+    int score;
+    long long length;           //alignment columns
+    long long cells;            //DP cells computed, recomputations included
+};
+
+//default_stream_config: default scoring, STREAM_DEFAULT_MEMORY, spill files in $TMPDIR or /tmp
+StreamConfig default_stream_config();
+
+//stream_align: optimal global alignment of X against Y, its CIGAR written to cigar_fd;
+//false with a message in error when memory_limit is too small or a file operation fails
+bool stream_align(const MappedSequence& X, const MappedSequence& Y, const StreamConfig& config, int cigar_fd,
+                  StreamResult& result, std::string& error);
+
+#endif //STREAM_ALIGN_H
@@ -0,0 +1,343 @@
+/*
+ * Equivalence checks of the engines that promise the reference result
+ *
+ * Random pairs of DNA, 0 ... BATCH_MAX_LEN residues at 60-100% identity, are aligned by
+ * every engine that claims to return what the reference does (NWScore_row for scores,
+ * NeedlemanWunsch_into for alignments), under scorings chosen so that the lockstep
+ * kernels run on each lane width:
+ * - batch_score / batch_align (BatchAlign.h): scores and aligned rows, the 8-bit lanes
+ *   promoted to 16 and 32 bits where the cells leave their range. A pair counts for the
+ *   widest range its cells reach, and every width must be reached at least once;
+ * - Checkpoint_into: score and aligned rows;
+ * - four_russians_score (FourRussians.h): score;
+ * - stream_align (StreamAlign.h): score and CIGAR, with small strips and tiles so that a
+ *   pair spans several of each;
+ * - Aligner::co_optimal under TIES_RIGHT: its first listed alignment and its count are those
+ *   that Aligner::align returns;
+ * - Realigner (Realign.h), under random substitutions, insertions and deletions, some at
+ *   either end of the sequence: the score of every edit against NWScore_row of the edited
+ *   sequence, and the aligned rows, which must score as much and spell both sequences.
+ *
+ * Usage:
+ * - make test             builds build/Test and runs it
+ * - build/Test [pairs]    pairs per scoring (default 200); exits non-zero on a mismatch
+ *
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "Alignment.h"
+#include "FourRussians.h"
+#include "Realign.h"
+#include "ResultCache.h"
+#include "StreamAlign.h"
+
+#define TEST_PAIRS 200
+#define TEST_STRIP_ROWS 7
+#define TEST_TILE_COLUMNS 37
+#define TEST_MEMORY ((std::size_t)32 << 20)
+#define TEST_EDITS 40                   //edits per realigned pair
+
+static const char DNA[] = "ACGT";
+
+//Useful tools
+static std::string random_sequence(int len, std::mt19937& rng);
+static std::string mutate(const std::string& X, int identity, std::mt19937& rng);
+static int cell_width(const std::string& X, const std::string& Y, const Scoring& sc);
+static bool stream_cigar(const std::string& X, const std::string& Y, const Scoring& sc, int& score,
+                         std::string& cigar);
+static void check_realigner(const std::string& X, const std::string& Y, const Scoring& sc, std::mt19937& rng,
+                            int s, int k, Arena& arena);
+
+static int failures = 0;
+
+//check: reports a mismatch of test on pair k under scoring s
+static void check(bool ok, const char* test, int s, int k)
+{
+    if (ok) return;
+    if (failures++ < 20) std::cerr << "mismatch: " << test << ", scoring " << s << ", pair " << k << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    const int pairs = argc > 1 ? std::atoi(argv[1]) : TEST_PAIRS;
+
+    //the default; int16 lanes; int32 lanes (best - 2*gap stays within the one-byte checkpoints)
+    const Scoring scorings[] = { default_scoring(), { 2, -1, -2 }, { 5, -4, -7 }, { 80, -40, -80 } };
+    const int nscorings = sizeof(scorings) / sizeof(scorings[0]);
+    int widths[3] = { 0, 0, 0 };
+    Arena arena;
+
+    for (int s=0; s<nscorings; s++)
+    {
+        const Scoring& sc = scorings[s];
+        std::mt19937 rng(s + 1);
+
+        //STEP 1: the pairs and their reference scores and alignments
+        std::vector<std::string> X(pairs), Y(pairs);
+        std::vector<BatchPair> batch(pairs);
+        std::vector<int> scores(pairs);
+        std::vector<std::string> rows(pairs);
+        for (int k=0; k<pairs; k++)
+        {
+            X[k] = random_sequence(rng() % (BATCH_MAX_LEN + 1), rng);
+            Y[k] = mutate(X[k], 60 + rng() % 41, rng);
+            if ((int)Y[k].size() > BATCH_MAX_LEN) Y[k].resize(BATCH_MAX_LEN);
+            const BatchPair p = { X[k].data(), (int)X[k].size(), Y[k].data(), (int)Y[k].size() };
+            batch[k] = p;
+            widths[cell_width(X[k], Y[k], sc)]++;
+
+            std::vector<int> Lastline(p.m + 1);
+            NWScore_row(p.X, p.n, p.Y, p.m, false, sc, Lastline.data());
+            scores[k] = Lastline[p.m];
+            std::vector<char> A(2 * (p.n + p.m));
+            int len = 0;
+            const int score = NeedlemanWunsch_into(p.X, p.n, p.Y, p.m, sc, arena, A.data(), A.data() + p.n + p.m, len);
+            check(score == scores[k], "NeedlemanWunsch_into score", s, k);
+            rows[k].assign(A.data(), len);
+            rows[k].append(A.data() + p.n + p.m, len);
+        }
+
+        //STEP 2: the lockstep kernels, BATCH_LANES pairs per call
+        for (int first=0; first<pairs; first+=BATCH_LANES)
+        {
+            const int count = std::min(BATCH_LANES, pairs - first);
+            int lane_scores[BATCH_LANES], lens[BATCH_LANES];
+            std::vector<char> buffers[BATCH_LANES];
+            char* A_1[BATCH_LANES];
+            char* A_2[BATCH_LANES];
+            for (int j=0; j<count; j++)
+            {
+                const BatchPair& p = batch[first + j];
+                buffers[j].resize(2 * (p.n + p.m) + 1);
+                A_1[j] = buffers[j].data();
+                A_2[j] = A_1[j] + p.n + p.m;
+            }
+            batch_score(&batch[first], count, sc, arena, lane_scores);
+            for (int j=0; j<count; j++)
+            {
+                check(lane_scores[j] == scores[first + j], "batch_score", s, first + j);
+            }
+            batch_align(&batch[first], count, sc, arena, lane_scores, A_1, A_2, lens);
+            for (int j=0; j<count; j++)
+            {
+                check(lane_scores[j] == scores[first + j], "batch_align score", s, first + j);
+                check(std::string(A_1[j], lens[j]) + std::string(A_2[j], lens[j]) == rows[first + j],
+                      "batch_align rows", s, first + j);
+            }
+        }
+
+        //STEP 3: the checkpoints, Four Russians and streaming engines, pair by pair
+        for (int k=0; k<pairs; k++)
+        {
+            const BatchPair& p = batch[k];
+            std::vector<char> A(2 * (p.n + p.m));
+            int len = 0;
+            const int score = Checkpoint_into(p.X, p.n, p.Y, p.m, sc, arena, A.data(), A.data() + p.n + p.m, len);
+            check(score == scores[k], "Checkpoint_into score", s, k);
+            check(std::string(A.data(), len) + std::string(A.data() + p.n + p.m, len) == rows[k],
+                  "Checkpoint_into rows", s, k);
+
+            check(four_russians_score(p.X, p.n, p.Y, p.m, sc, arena) == scores[k], "four_russians_score", s, k);
+
+            if (k % 8 != 0) continue;
+            std::string cigar, expected;
+            int stream_score;
+            cigar_from_rows(rows[k].data(), rows[k].data() + rows[k].size() / 2, rows[k].size() / 2, expected);
+            const bool streamed = stream_cigar(X[k], Y[k], sc, stream_score, cigar);
+            check(streamed && stream_score == scores[k], "stream_align score", s, k);
+            check(streamed && cigar == expected, "stream_align CIGAR", s, k);
+
+            AlignerConfig config = default_config();
+            config.scoring = sc;
+            config.engine = ENGINE_NEEDLEMAN_WUNSCH;
+            config.ties = TIES_RIGHT;
+            config.count_optimal = true;
+            const Aligner aligner(config);
+            AlignResult r = aligner.align(p.X, p.n, p.Y, p.m, arena);
+            const std::string right = std::string(r.A_1, r.length) + std::string(r.A_2, r.length);
+            const double count = r.optimal;
+            CoOptimalList list;
+            list.limit = 2;
+            r = aligner.co_optimal(p.X, p.n, p.Y, p.m, list, arena);
+            check(r.optimal == count && !list.alignments.empty()
+                  && list.alignments[0].first + list.alignments[0].second == right, "co_optimal first", s, k);
+        }
+
+        //STEP 4: the Realigner, a pair in ten
+        for (int k=0; k<pairs; k+=10)
+        {
+            check_realigner(X[k], Y[k], sc, rng, s, k, arena);
+        }
+    }
+
+    const char* names[3] = { "8-bit", "16-bit", "32-bit" };
+    for (int w=0; w<3; w++)
+    {
+        std::cout << names[w] << " lanes: " << widths[w] << " pairs" << std::endl;
+        if (widths[w] == 0)
+        {
+            std::cerr << "no pair reaches the " << names[w] << " range" << std::endl;
+            failures++;
+        }
+    }
+    if (failures > 0)
+    {
+        std::cerr << failures << " mismatches" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+    std::cout << "all engines agree on " << pairs * nscorings << " pairs" << std::endl;
+    return 0;
+}
+
+
+//Functions
+//random_sequence: len random DNA letters
+static std::string random_sequence(int len, std::mt19937& rng)
+{
+    std::string s(len, 'A');
+    for (int i=0; i<len; i++)
+    {
+        s[i] = DNA[rng() % 4];
+    }
+    return s;
+}
+
+//mutate: copy of X at the given identity (percent), 80% substitutions, 20% single-base indels
+static std::string mutate(const std::string& X, int identity, std::mt19937& rng)
+{
+    std::string Y;
+    for (std::size_t i=0; i<X.size(); i++)
+    {
+        if ((int)(rng() % 100) < identity)
+        {
+            Y += X[i];
+            continue;
+        }
+        const int kind = rng() % 10;
+        if (kind < 8) Y += DNA[(std::strchr(DNA, X[i]) - DNA + 1 + rng() % 3) % 4];
+        else if (kind == 9)
+        {
+            Y += X[i];
+            Y += DNA[rng() % 4];
+        }
+    }
+    return Y;
+}
+
+//cell_width: 0, 1 or 2 when every cell of the pair's matrix fits 8, 16 or 32-bit lanes
+static int cell_width(const std::string& X, const std::string& Y, const Scoring& sc)
+{
+    const int n = X.size(), m = Y.size();
+    std::vector<int> row(m + 1);
+    long range = 0;
+    for (int j=0; j<=m; j++)
+    {
+        row[j] = j * sc.gap;
+        range = std::max(range, std::labs(row[j]));
+    }
+    for (int i=1; i<=n; i++)
+    {
+        int diag = row[0];
+        row[0] += sc.gap;
+        range = std::max(range, std::labs(row[0]));
+        for (int j=1; j<=m; j++)
+        {
+            const int up = row[j];
+            row[j] = max3(row[j-1] + sc.gap, up + sc.gap, diag + match_or_mismatch(X[i-1], Y[j-1], sc));
+            diag = up;
+            range = std::max(range, std::labs(row[j]));
+        }
+    }
+    return range <= 127 ? 0 : range <= 32767 ? 1 : 2;
+}
+
+//check_realigner: TEST_EDITS random edits of X, every one checked against NWScore_row;
+//one edit in four is at the start of X, one in four at its end
+static void check_realigner(const std::string& X, const std::string& Y, const Scoring& sc, std::mt19937& rng,
+                            int s, int k, Arena& arena)
+{
+    Realigner realigner(X.data(), X.size(), Y.data(), Y.size(), sc, arena);
+    std::vector<int> Lastline(Y.size() + 1);
+    for (int e=0; e<TEST_EDITS; e++)
+    {
+        //a substitution, an insertion of 1 to 3 residues or a deletion of 1 to 3
+        const int n = realigner.sequence().size();
+        const int kind = rng() % 3;
+        const int erase = kind == 1 ? 0 : std::min<int>(kind == 0 ? 1 : 1 + rng() % 3, n);
+        const int count = kind == 2 ? 0 : kind == 0 ? erase : 1 + rng() % 3;
+        const int pos = e % 4 == 0 ? 0 : e % 4 == 1 ? n - erase : rng() % (n - erase + 1);
+        const std::string insert = random_sequence(count, rng);
+        const int score = realigner.edit(pos, erase, insert.data(), count, arena);
+
+        const std::string& S = realigner.sequence();
+        NWScore_row(S.data(), S.size(), Y.data(), Y.size(), false, sc, Lastline.data());
+        check(score == Lastline[Y.size()] && realigner.score() == score, "Realigner edit score", s, k);
+
+        const AlignResult r = realigner.alignment(arena);
+        std::string X_1, Y_1;
+        for (int t=0; t<r.length; t++)
+        {
+            if (r.A_1[t] != '-') X_1 += r.A_1[t];
+            if (r.A_2[t] != '-') Y_1 += r.A_2[t];
+        }
+        check(alignment_score(r.A_1, r.A_2, r.length, sc) == score && X_1 == S && Y_1 == Y,
+              "Realigner alignment", s, k);
+    }
+}
+
+//stream_cigar: stream_align of the pair from two temporary files, its CIGAR read back
+static bool stream_cigar(const std::string& X, const std::string& Y, const Scoring& sc, int& score,
+                         std::string& cigar)
+{
+    char paths[3][32] = { "/tmp/alntestXXXXXX", "/tmp/alntestXXXXXX", "/tmp/alntestXXXXXX" };
+    int fd[3];
+    for (int f=0; f<3; f++)
+    {
+        fd[f] = mkstemp(paths[f]);
+        if (fd[f] < 0) return false;
+    }
+    bool ok = write(fd[0], X.data(), X.size()) == (ssize_t)X.size()
+           && write(fd[1], Y.data(), Y.size()) == (ssize_t)Y.size();
+
+    MappedSequence MX, MY;
+    std::string error;
+    StreamConfig config = default_stream_config();
+    config.scoring = sc;
+    config.memory_limit = TEST_MEMORY;
+    config.strip_rows = TEST_STRIP_ROWS;
+    config.tile_columns = TEST_TILE_COLUMNS;
+    StreamResult result;
+    ok = ok && MX.open(paths[0], error) && MY.open(paths[1], error);
+    ok = ok && stream_align(MX, MY, config, fd[2], result, error);
+    if (ok)
+    {
+        score = result.score;
+        cigar.clear();
+        char buffer[4096];
+        ssize_t got;
+        for (off_t at=0; (got = pread(fd[2], buffer, sizeof(buffer), at)) > 0; at += got)
+        {
+            cigar.append(buffer, got);
+        }
+    }
+    else
+    {
+        std::cerr << error << std::endl;
+    }
+    for (int f=0; f<3; f++)
+    {
+        close(fd[f]);
+        unlink(paths[f]);
+    }
+    return ok;
+}
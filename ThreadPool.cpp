@@ -0,0 +1,165 @@
+/*
+ * ThreadPool: fixed set of worker threads with work stealing, see ThreadPool.h
+ */
+
+#include "Arena.h"
+#include "ThreadPool.h"
+
+static thread_local ThreadPool* current_pool = NULL;
+static thread_local int current_worker = -1;
+
+ThreadPool::ThreadPool(int threads) : injection(POOL_INJECTION_SLOTS)
+{
+    if (threads <= 0) threads = std::thread::hardware_concurrency();
+    if (threads <= 0) threads = 1;
+
+    //every deque exists before any worker starts stealing
+    for (int t=0; t<threads; t++)
+    {
+        workers.emplace_back(new Worker);
+    }
+    for (int t=0; t<threads; t++)
+    {
+        workers[t]->thread = std::thread(&ThreadPool::worker_main, this, t);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (std::size_t t=0; t<workers.size(); t++)
+    {
+        workers[t]->thread.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    unfinished++;
+    injection.push(new Task{ std::move(task), NULL });
+    queued();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    idle.wait(guard, [this]{ return unfinished.load() == 0; });
+}
+
+void ThreadPool::spawn(TaskGroup& group, std::function<void()> task)
+{
+    group.pending++;
+    unfinished++;
+    Task* t = new Task{ std::move(task), &group };
+    if (current_pool == this) workers[current_worker]->deque.push(t);
+    else injection.push(t);
+    queued();
+}
+
+void ThreadPool::wait(TaskGroup& group)
+{
+    const int index = current_pool == this ? current_worker : -1;
+    for (int attempt=0; group.pending.load(std::memory_order_acquire) > 0; )
+    {
+        Task* task = index >= 0 ? find(index, false) : NULL;
+        if (task)
+        {
+            run(task);
+            attempt = 0;
+        }
+        else
+        {
+            ring_backoff(attempt);
+        }
+    }
+}
+
+ThreadPool* ThreadPool::current()
+{
+    return current_pool;
+}
+
+int ThreadPool::worker_index()
+{
+    return current_worker;
+}
+
+
+void ThreadPool::worker_main(int index)
+{
+    current_pool = this;
+    current_worker = index;
+
+    //the workspace is allocated before the first task, not on its critical path
+    thread_arena();
+
+    for (int rounds=0; ; )
+    {
+        if (Task* task = find(index, true))
+        {
+            run(task);
+            rounds = 0;
+            continue;
+        }
+        if (++rounds < POOL_IDLE_ROUNDS)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        //sleep; queued() sees sleeping > 0 after its task is counted in available, or
+        //this check sees the task, so no wake-up is lost
+        std::unique_lock<std::mutex> guard(lock);
+        sleeping++;
+        ready.wait(guard, [this]{ return stopping || available.load() > 0; });
+        sleeping--;
+        if (stopping && available.load() == 0) return;
+        rounds = 0;
+    }
+}
+
+ThreadPool::Task* ThreadPool::find(int index, bool from_injection)
+{
+    Task* task = NULL;
+    if (workers[index]->deque.pop(task) || (from_injection && injection.try_pop(task)))
+    {
+        available--;
+        return task;
+    }
+    const int count = workers.size();
+    for (int k=1; k<count; k++)
+    {
+        if (workers[(index + k) % count]->deque.steal(task))
+        {
+            available--;
+            return task;
+        }
+    }
+    return NULL;
+}
+
+void ThreadPool::run(Task* task)
+{
+    task->run();
+    if (task->group) task->group->pending.fetch_sub(1, std::memory_order_release);
+    delete task;
+    if (--unfinished == 0)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        idle.notify_all();
+    }
+}
+
+void ThreadPool::queued()
+{
+    available++;
+    if (sleeping.load() > 0)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        ready.notify_one();
+    }
+}
@@ -0,0 +1,125 @@
+/*
+ * ThreadPool: fixed set of worker threads with work stealing
+ *
+ * Workers are started by the constructor and stay alive until the pool is
+ * destroyed, so their thread_arena() workspaces (Arena.h) are created once and
+ * stay warm across tasks. The destructor runs the tasks still queued, then joins.
+ *
+ * Tasks come from two places:
+ * - submit(): independent tasks (a batch, a tile, a connection) go to one shared
+ *   injection queue, a bounded MpmcRing (Rings.h), taken first come first served.
+ * - spawn(): subtasks of a running task, e.g. the two halves of a Hirschberg split, go
+ *   to the calling worker's own Chase-Lev deque (WorkDeque.h). The worker pops them
+ *   newest first; idle workers steal them oldest first, so the largest pieces of a
+ *   long pair move to the idle cores.
+ * A worker looks in its own deque, then the injection queue, then steals from the
+ * other workers in turn. When all three are empty for a while it sleeps until the
+ * next submit or spawn.
+ *
+ * wait(group) is the join of spawn(): while the group's subtasks are running elsewhere,
+ * the caller runs subtasks from the deques, never tasks from the injection queue. A
+ * subtask therefore runs on top of a suspended task that shares the thread's arena and
+ * must leave the arena as it found it (mark/rewind), as the engines do.
+ *
+ * Usage:
+ *   ThreadPool pool(threads);
+ *   pool.submit([&]{ ... });
+ *   pool.wait();
+ *
+ *   //inside a task
+ *   TaskGroup group;
+ *   ThreadPool::current()->spawn(group, [&]{ ... });
+ *   ...
+ *   ThreadPool::current()->wait(group);
+ *
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Rings.h"
+#include "WorkDeque.h"
+
+#define POOL_INJECTION_SLOTS 4096
+#define POOL_IDLE_ROUNDS 64             //empty searches before a worker sleeps
+
+//TaskGroup: subtasks spawned and not finished yet
+struct TaskGroup
+{
+    std::atomic<int> pending{0};
+};
+
+class ThreadPool
+{
+public:
+    //threads <= 0 uses one worker per hardware thread
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    //submit: queue task on the injection queue for the first idle worker; waits while it is full
+    void submit(std::function<void()> task);
+
+    //wait: blocks until every submitted task, and its subtasks, has finished; not from a task
+    void wait();
+
+    //spawn: queue task as a subtask of the calling task on the worker's deque (on the
+    //injection queue from outside the pool)
+    void spawn(TaskGroup& group, std::function<void()> task);
+
+    //wait: runs subtasks until every task spawned in group has finished
+    void wait(TaskGroup& group);
+
+    int size() const { return workers.size(); }
+
+    //current: pool of the calling worker thread, NULL outside any pool
+    static ThreadPool* current();
+
+    //worker_index: index of the calling worker in its pool [0...size()), -1 outside any pool
+    static int worker_index();
+
+private:
+    struct Task
+    {
+        std::function<void()> run;
+        TaskGroup* group;
+    };
+
+    struct alignas(RING_CACHE_LINE) Worker
+    {
+        WorkDeque<Task*> deque;
+        std::thread thread;
+    };
+
+    void worker_main(int index);
+
+    //find: a task from own deque, the injection queue (when allowed), then the others' deques
+    Task* find(int index, bool from_injection);
+
+    void run(Task* task);
+
+    //queued: a task became available, wakes a sleeping worker
+    void queued();
+
+    std::vector< std::unique_ptr<Worker> > workers;
+    MpmcRing<Task*> injection;
+    std::atomic<long> available{0};         //tasks queued and not taken yet
+    std::atomic<long> unfinished{0};        //tasks queued or running
+    std::atomic<int> sleeping{0};
+    std::mutex lock;
+    std::condition_variable ready;
+    std::condition_variable idle;
+    bool stopping = false;
+};
+
+#endif //THREAD_POOL_H
@@ -0,0 +1,138 @@
+/*
+ * WorkDeque: Chase-Lev work-stealing deque
+ *
+ * Each worker of a ThreadPool owns one. The owner pushes and pops at the bottom, last in
+ * first out, so it keeps working on the subtasks it spawned most recently, whose data is
+ * still in its cache. Other workers steal at the top, first in first out, which hands
+ * them the oldest and largest subtasks [1]. Owner operations touch only the bottom index
+ * unless the deque is down to its last item; a steal is one compare-and-swap on the top.
+ * The memory orders are those of the C11 version of [2], with the release fence of
+ * push() folded into the store of bottom.
+ *
+ * The array grows by doubling when full and never shrinks. A thief may still be reading
+ * a replaced array, so replaced arrays are kept until the deque is destroyed: at most
+ * as much again as the largest array.
+ *
+ * References:
+ * - [1] Chase, D., & Lev, Y. (2005). Dynamic circular work-stealing deque. SPAA '05, 21–28.
+ * - [2] Lê, N. M., Pop, A., Cohen, A., & Zappa Nardelli, F. (2013). Correct and efficient
+ *   work-stealing for weak memory models. PPoPP '13, 69–80.
+ *
+ * Usage:
+ *   WorkDeque<Task*> deque;
+ *   deque.push(task);                  //owner
+ *   if (deque.pop(task)) ...           //owner, newest first
+ *   if (other.steal(task)) ...         //any thread, oldest first
+ *
+ */
+
+#ifndef WORK_DEQUE_H
+#define WORK_DEQUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "Rings.h"
+
+#define WORK_DEQUE_SLOTS 256            //initial capacity
+
+//T must be trivially copyable: a pointer or an index
+template <typename T>
+class WorkDeque
+{
+public:
+    WorkDeque() : top(0), bottom(0), array(new Array(WORK_DEQUE_SLOTS))
+    {
+        arrays.emplace_back(array.load(std::memory_order_relaxed));
+    }
+
+    WorkDeque(const WorkDeque&) = delete;
+    WorkDeque& operator=(const WorkDeque&) = delete;
+
+    //push: owner only
+    void push(T value)
+    {
+        const long b = bottom.load(std::memory_order_relaxed);
+        const long t = top.load(std::memory_order_acquire);
+        Array* a = array.load(std::memory_order_relaxed);
+        if (b - t > (long)a->mask) a = grow(a, t, b);
+        a->put(b, value);
+        bottom.store(b + 1, std::memory_order_release);
+    }
+
+    //pop: owner only, the most recent push; false when empty or lost to a thief
+    bool pop(T& value)
+    {
+        const long b = bottom.load(std::memory_order_relaxed) - 1;
+        Array* a = array.load(std::memory_order_relaxed);
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        long t = top.load(std::memory_order_relaxed);
+        if (t > b)
+        {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        value = a->get(b);
+        if (t < b) return true;
+
+        //the last item: the owner and the thieves race for it on top
+        const bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+
+    //steal: any thread, the oldest push; false when empty or lost to another thread
+    bool steal(T& value)
+    {
+        long t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const long b = bottom.load(std::memory_order_acquire);
+        if (t >= b) return false;
+        Array* a = array.load(std::memory_order_acquire);
+        value = a->get(t);
+        return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    //empty: a hint, exact only for the owner with no thief active
+    bool empty() const
+    {
+        return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Array
+    {
+        explicit Array(std::size_t slots) : mask(slots - 1), items(new std::atomic<T>[slots])
+        {
+        }
+
+        T get(long k) const { return items[k & mask].load(std::memory_order_relaxed); }
+        void put(long k, T value) { items[k & mask].store(value, std::memory_order_relaxed); }
+
+        const std::size_t mask;
+        const std::unique_ptr<std::atomic<T>[]> items;
+    };
+
+    //grow: a twice larger array holding items [t...b), published for the thieves
+    Array* grow(Array* a, long t, long b)
+    {
+        Array* bigger = new Array(2 * (a->mask + 1));
+        for (long k=t; k<b; k++)
+        {
+            bigger->put(k, a->get(k));
+        }
+        arrays.emplace_back(bigger);
+        array.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+    alignas(RING_CACHE_LINE) std::atomic<long> top;
+    alignas(RING_CACHE_LINE) std::atomic<long> bottom;
+    std::atomic<Array*> array;
+    std::vector< std::unique_ptr<Array> > arrays;      //current and replaced, owner only
+};
+
+#endif //WORK_DEQUE_H